@@ -0,0 +1,287 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "mip_generator.h"
+#include "worker_pool.h"
+
+// BC1 (DXT1) compression for opaque RGBA8 sRGB textures. Endpoints come from the principal axis of
+// each 4x4 block and are refined by least squares against the chosen indices; the math runs on the
+// sRGB encoded values, which is where the hardware interpolates. Alpha is dropped, edge blocks repeat
+// the last row and column. Block rows are split across a Worker_pool.
+
+constexpr size_t BC1_BLOCK_BYTES = 8;
+
+inline size_t bc1_size(uint32_t width, uint32_t height){
+    return size_t{(width + 3) / 4} * ((height + 3) / 4) * BC1_BLOCK_BYTES;
+}
+
+namespace bc_detail{
+
+inline uint16_t pack_565(const float* color){
+    auto quantize = [](float value, float max){
+        return static_cast<uint16_t>(std::clamp(std::lround(value * max / 255.0f), 0l, static_cast<long>(max)));
+    };
+    return static_cast<uint16_t>(quantize(color[0], 31.0f) << 11 | quantize(color[1], 63.0f) << 5 | quantize(color[2], 31.0f));
+}
+
+inline void unpack_565(uint16_t packed, int32_t* color){
+    int32_t r = packed >> 11 & 31;
+    int32_t g = packed >> 5 & 63;
+    int32_t b = packed & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// The four colors the decoder derives from a pair of endpoints. With color0 <= color1 BC1 switches
+// to three colors and black, the encoder never emits that except for solid blocks.
+inline void palette(uint16_t color0, uint16_t color1, int32_t (*colors)[3]){
+    unpack_565(color0, colors[0]);
+    unpack_565(color1, colors[1]);
+    for(int channel = 0; channel < 3; channel++){
+        int32_t a = colors[0][channel];
+        int32_t b = colors[1][channel];
+        if(color0 > color1){
+            colors[2][channel] = (2 * a + b + 1) / 3;
+            colors[3][channel] = (a + 2 * b + 1) / 3;
+        }else{
+            colors[2][channel] = (a + b + 1) / 2;
+            colors[3][channel] = 0;
+        }
+    }
+}
+
+// Picks the closest four color palette entry for every texel, returns the summed squared error.
+inline int64_t assign_indices(const float (*texels)[3], uint16_t color0, uint16_t color1, uint8_t* indices){
+    // Four color palette in the given order; once the encoder sorts the endpoints it decodes the same.
+    int32_t colors[4][3];
+    unpack_565(color0, colors[0]);
+    unpack_565(color1, colors[1]);
+    for(int channel = 0; channel < 3; channel++){
+        colors[2][channel] = (2 * colors[0][channel] + colors[1][channel] + 1) / 3;
+        colors[3][channel] = (colors[0][channel] + 2 * colors[1][channel] + 1) / 3;
+    }
+    int64_t error{};
+    for(int texel = 0; texel < 16; texel++){
+        int64_t best = INT64_MAX;
+        for(uint8_t index = 0; index < 4; index++){
+            int64_t distance{};
+            for(int channel = 0; channel < 3; channel++){
+                auto delta = static_cast<int64_t>(texels[texel][channel]) - colors[index][channel];
+                distance += delta * delta;
+            }
+            if(distance < best){
+                best = distance;
+                indices[texel] = index;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// Least squares endpoints for fixed indices, false when every texel uses the same weight.
+inline bool fit_endpoints(const float (*texels)[3], const uint8_t* indices, float* endpoint0, float* endpoint1){
+    constexpr float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa{}, ab{}, bb{};
+    float ax[3]{}, bx[3]{};
+    for(int texel = 0; texel < 16; texel++){
+        float a = WEIGHTS[indices[texel]];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for(int channel = 0; channel < 3; channel++){
+            ax[channel] += a * texels[texel][channel];
+            bx[channel] += b * texels[texel][channel];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if(std::abs(determinant) < 1e-6f){
+        return false;
+    }
+    for(int channel = 0; channel < 3; channel++){
+        endpoint0[channel] = (bb * ax[channel] - ab * bx[channel]) / determinant;
+        endpoint1[channel] = (aa * bx[channel] - ab * ax[channel]) / determinant;
+    }
+    return true;
+}
+
+} // namespace bc_detail
+
+// Compresses 16 RGBA8 texels in row major order into one 8 byte block.
+inline void encode_bc1_block(const uint8_t* rgba, uint8_t* block){
+    float texels[16][3];
+    float mean[3]{};
+    for(int texel = 0; texel < 16; texel++){
+        for(int channel = 0; channel < 3; channel++){
+            texels[texel][channel] = rgba[texel * 4 + channel];
+            mean[channel] += texels[texel][channel] / 16.0f;
+        }
+    }
+    float covariance[6]{};
+    for(const auto& texel : texels){
+        float r = texel[0] - mean[0], g = texel[1] - mean[1], b = texel[2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+    // Power iteration for the principal axis, a few steps are plenty for a 3x3 matrix.
+    float axis[3]{1.0f, 1.0f, 1.0f};
+    for(int iteration = 0; iteration < 8; iteration++){
+        float next[3]{
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if(length < 1e-6f){
+            break;
+        }
+        for(int channel = 0; channel < 3; channel++){
+            axis[channel] = next[channel] / length;
+        }
+    }
+    float low = 0.0f, high = 0.0f;
+    for(const auto& texel : texels){
+        float projection = (texel[0] - mean[0]) * axis[0] + (texel[1] - mean[1]) * axis[1] + (texel[2] - mean[2]) * axis[2];
+        low = std::min(low, projection);
+        high = std::max(high, projection);
+    }
+    float endpoint0[3], endpoint1[3];
+    for(int channel = 0; channel < 3; channel++){
+        endpoint0[channel] = mean[channel] + axis[channel] * high;
+        endpoint1[channel] = mean[channel] + axis[channel] * low;
+    }
+
+    uint16_t color0 = bc_detail::pack_565(endpoint0);
+    uint16_t color1 = bc_detail::pack_565(endpoint1);
+    uint8_t indices[16];
+    int64_t error = bc_detail::assign_indices(texels, color0, color1, indices);
+    for(int iteration = 0; iteration < 2 && error > 0; iteration++){
+        if(!bc_detail::fit_endpoints(texels, indices, endpoint0, endpoint1)){
+            break;
+        }
+        uint16_t refined0 = bc_detail::pack_565(endpoint0);
+        uint16_t refined1 = bc_detail::pack_565(endpoint1);
+        uint8_t refined_indices[16];
+        int64_t refined_error = bc_detail::assign_indices(texels, refined0, refined1, refined_indices);
+        if(refined_error >= error){
+            break;
+        }
+        color0 = refined0;
+        color1 = refined1;
+        error = refined_error;
+        std::memcpy(indices, refined_indices, sizeof(indices));
+    }
+
+    // Four color mode needs color0 > color1; swapping the endpoints swaps index 0 with 1 and 2 with 3.
+    if(color0 < color1){
+        std::swap(color0, color1);
+        for(auto& index : indices){
+            index ^= 1;
+        }
+    }else if(color0 == color1){
+        std::memset(indices, 0, sizeof(indices));
+    }
+    uint32_t packed_indices{};
+    for(int texel = 0; texel < 16; texel++){
+        packed_indices |= uint32_t{indices[texel]} << (texel * 2);
+    }
+    block[0] = static_cast<uint8_t>(color0);
+    block[1] = static_cast<uint8_t>(color0 >> 8);
+    block[2] = static_cast<uint8_t>(color1);
+    block[3] = static_cast<uint8_t>(color1 >> 8);
+    for(int byte = 0; byte < 4; byte++){
+        block[4 + byte] = static_cast<uint8_t>(packed_indices >> (byte * 8));
+    }
+}
+
+// Expands one block to 16 opaque RGBA8 texels.
+inline void decode_bc1_block(const uint8_t* block, uint8_t* rgba){
+    auto color0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+    auto color1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+    int32_t colors[4][3];
+    bc_detail::palette(color0, color1, colors);
+    for(int texel = 0; texel < 16; texel++){
+        auto index = block[4 + texel / 4] >> (texel % 4 * 2) & 3;
+        for(int channel = 0; channel < 3; channel++){
+            rgba[texel * 4 + channel] = static_cast<uint8_t>(colors[index][channel]);
+        }
+        rgba[texel * 4 + 3] = 255;
+    }
+}
+
+// Compresses a width x height RGBA8 image into bc1_size(width, height) bytes at out.
+inline void encode_bc1_image(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint8_t* out, Worker_pool* pool = nullptr){
+    constexpr uint32_t BLOCK_ROWS_PER_TASK = 4;
+    const uint32_t blocks_wide = (width + 3) / 4;
+    const uint32_t blocks_high = (height + 3) / 4;
+    auto encode_rows = [&](uint32_t first_row, uint32_t last_row){
+        uint8_t texels[64];
+        for(uint32_t block_y = first_row; block_y < last_row; block_y++){
+            for(uint32_t block_x = 0; block_x < blocks_wide; block_x++){
+                for(uint32_t texel = 0; texel < 16; texel++){
+                    uint32_t x = std::min(block_x * 4 + texel % 4, width - 1);
+                    uint32_t y = std::min(block_y * 4 + texel / 4, height - 1);
+                    std::memcpy(texels + texel * 4, pixels.data() + (size_t{y} * width + x) * 4, 4);
+                }
+                encode_bc1_block(texels, out + (size_t{block_y} * blocks_wide + block_x) * BC1_BLOCK_BYTES);
+            }
+        }
+    };
+    const uint32_t task_count = (blocks_high + BLOCK_ROWS_PER_TASK - 1) / BLOCK_ROWS_PER_TASK;
+    if(!pool || task_count < 2){
+        encode_rows(0, blocks_high);
+        return;
+    }
+    pool->parallel_for(task_count, [&](size_t task){
+        auto first_row = static_cast<uint32_t>(task) * BLOCK_ROWS_PER_TASK;
+        encode_rows(first_row, std::min(first_row + BLOCK_ROWS_PER_TASK, blocks_high));
+    });
+}
+
+inline std::vector<uint8_t> decode_bc1_image(std::span<const uint8_t> blocks, uint32_t width, uint32_t height){
+    const uint32_t blocks_wide = (width + 3) / 4;
+    std::vector<uint8_t> pixels(size_t{width} * height * 4);
+    uint8_t texels[64];
+    for(uint32_t block_y = 0; block_y < (height + 3) / 4; block_y++){
+        for(uint32_t block_x = 0; block_x < blocks_wide; block_x++){
+            decode_bc1_block(blocks.data() + (size_t{block_y} * blocks_wide + block_x) * BC1_BLOCK_BYTES, texels);
+            for(uint32_t texel = 0; texel < 16; texel++){
+                uint32_t x = block_x * 4 + texel % 4;
+                uint32_t y = block_y * 4 + texel / 4;
+                if(x < width && y < height){
+                    std::memcpy(pixels.data() + (size_t{y} * width + x) * 4, texels + texel * 4, 4);
+                }
+            }
+        }
+    }
+    return pixels;
+}
+
+// Compresses every level of an RGBA8 chain. The result keeps the level sizes, its offsets and
+// pixels_ refer to tightly packed BC1 blocks.
+inline Mip_chain encode_bc1_chain(const Mip_chain& chain, Worker_pool* pool = nullptr){
+    Mip_chain compressed;
+    size_t offset{};
+    for(const auto& level : chain.levels_){
+        compressed.levels_.push_back({offset, level.width_, level.height_});
+        offset += bc1_size(level.width_, level.height_);
+    }
+    compressed.pixels_.resize(offset);
+    for(size_t level = 0; level < chain.levels_.size(); level++){
+        const auto& source = chain.levels_[level];
+        std::span<const uint8_t> pixels{chain.pixels_.data() + source.offset_, size_t{source.width_} * source.height_ * 4};
+        encode_bc1_image(pixels, source.width_, source.height_, compressed.pixels_.data() + compressed.levels_[level].offset_, pool);
+    }
+    return compressed;
+}
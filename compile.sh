@@ -1,6 +1,12 @@
 
 glslc vertex.vert -o vert.spv
+glslc -DPACKED_VERTEX vertex.vert -o vert_packed.spv
+glslc depth.vert -o depth.spv
+glslc -DPACKED_VERTEX depth.vert -o depth_packed.spv
 glslc fragment.frag -o frag.spv
+glslc -DBINDLESS_MATERIALS fragment.frag -o frag_bindless.spv
+glslc cull.comp -o cull.spv
+glslc meshlet_cull.comp -o meshlet_cull.spv
 
 mkdir -p build/shaders
 rm build/shaders/*.spv
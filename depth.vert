@@ -0,0 +1,41 @@
+#version 450
+
+// Depth prepass: reads only the position stream.
+layout(set = 0, binding = 0) uniform Uniform_buffer_object{
+    mat4 model_;
+    mat4 view_;
+    mat4 proj_;
+} ubo;
+
+struct Instance_data{
+    mat4 model_;
+    vec4 tint_;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instance_buffer{
+    Instance_data instances_[];
+};
+
+#ifdef PACKED_VERTEX
+layout(push_constant) uniform Vertex_dequantization{
+    vec4 position_scale_;
+    vec4 position_offset_;
+    vec4 tex_coord_scale_offset_;
+    vec4 color_;
+} dequantization;
+
+layout(location = 0) in vec4 in_packed_position;
+#else
+layout(location = 0) in vec3 in_position;
+#endif
+
+// Bit-identical to vertex.vert, the shaded pass tests for equal depth.
+invariant gl_Position;
+
+void main(){
+#ifdef PACKED_VERTEX
+    vec3 in_position = in_packed_position.xyz * dequantization.position_scale_.xyz + dequantization.position_offset_.xyz;
+#endif
+    Instance_data instance = instances_[gl_InstanceIndex];
+    gl_Position = ubo.proj_ * ubo.view_ * ubo.model_ * instance.model_ * vec4(in_position , 1.0);
+}
\ No newline at end of file
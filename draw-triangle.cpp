@@ -1,9 +1,642 @@
 #include "tiny-vulkan.h"
 #include "draw-triangle.h"
+#include "uv_sphere.h"
 #include <iostream>
 #include <format>
+#include <random>
+#include <string_view>
 
-int main(){
+static App_config parse_app_config(int argc, char** argv){
+    App_config config{};
+    bool interleaved_vertices = false;
+    for(int i = 1; i < argc; i++){
+        std::string_view arg = argv[i];
+        auto next_value = [&]() -> std::string_view {
+            if(i + 1 >= argc){
+                throw std::invalid_argument{std::format("missing value for {}", arg)};
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--headless"){
+            config.headless = true;
+        }else if(arg == "--frames"){
+            config.frame_count = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--dump-dir"){
+            config.dump_directory = next_value();
+        }else if(arg == "--pipeline-cache"){
+            config.pipeline_cache_path = next_value();
+        }else if(arg == "--bench-alloc"){
+            config.alloc_bench_count = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--no-upload-batching"){
+            config.batch_uploads = false;
+        }else if(arg == "--no-async-transfer"){
+            config.async_transfer = false;
+        }else if(arg == "--static-commands"){
+            config.static_command_buffers = true;
+        }else if(arg == "--record-threads"){
+            config.record_threads = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--draws"){
+            config.draw_count = std::max(1u, static_cast<uint32_t>(std::stoul(std::string{next_value()})));
+        }else if(arg == "--bench-record"){
+            config.record_bench = true;
+        }else if(arg == "--instances"){
+            config.instance_count = std::max(1u, static_cast<uint32_t>(std::stoul(std::string{next_value()})));
+        }else if(arg == "--bench-instances"){
+            config.instance_sweep = true;
+        }else if(arg == "--instance-spread"){
+            config.instance_spread = std::stof(std::string{next_value()});
+        }else if(arg == "--gpu-cull"){
+            config.gpu_culling = true;
+        }else if(arg == "--frames-in-flight"){
+            config.frames_in_flight = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--present-mode"){
+            auto name = next_value();
+            auto mode = present_mode_from_name(name);
+            if(!mode){
+                throw std::invalid_argument{std::format("unknown present mode {}, expected fifo, fifo_relaxed, mailbox or immediate", name)};
+            }
+            config.present_mode = *mode;
+        }else if(arg == "--swap-images"){
+            config.swap_chain_image_count = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--bench-present"){
+            config.present_sweep = true;
+        }else if(arg == "--mesh-cache"){
+            config.mesh_cache_directory = next_value();
+        }else if(arg == "--bench-mesh-load"){
+            config.mesh_load_bench = true;
+        }else if(arg == "--load-threads"){
+            config.load_threads = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--bench-weld"){
+            config.weld_bench = true;
+        }else if(arg == "--tinyobj"){
+            config.parallel_obj_parser = false;
+        }else if(arg == "--optimize-mesh"){
+            config.optimize_mesh = true;
+        }else if(arg == "--bench-mesh-opt"){
+            config.mesh_optimizer_bench = true;
+        }else if(arg == "--bench-vertex-format"){
+            config.vertex_format_bench = true;
+        }else if(arg == "--interleaved-vertices"){
+            interleaved_vertices = true;
+        }else if(arg == "--depth-prepass"){
+            config.depth_prepass = true;
+        }else if(arg == "--bench-vertex-streams"){
+            config.vertex_stream_bench = true;
+        }else if(arg == "--meshlets"){
+            config.meshlets = true;
+        }else if(arg == "--bench-meshlets"){
+            config.meshlet_bench = true;
+        }else if(arg == "--lods"){
+            config.lods = true;
+        }else if(arg == "--lod-pixels"){
+            config.lod_error_pixels = std::stof(std::string{next_value()});
+        }else if(arg == "--bench-lod"){
+            config.lod_bench = true;
+        }else if(arg == "--bench-lod-throughput"){
+            config.lod_sweep = true;
+        }else if(arg == "--cpu-mips"){
+            config.cpu_mipmaps = true;
+        }else if(arg == "--no-mip-cache"){
+            config.mip_cache = false;
+        }else if(arg == "--bench-mips"){
+            config.mip_bench = true;
+        }else if(arg == "--stream-textures"){
+            config.stream_textures = true;
+        }else if(arg == "--bench-texture-streaming"){
+            config.texture_stream_bench = true;
+        }else if(arg == "--compress-textures"){
+            config.compressed_textures = true;
+        }else if(arg == "--bench-texture-formats"){
+            config.texture_format_bench = true;
+        }else if(arg == "--materials"){
+            config.materials = true;
+        }else if(arg == "--synthetic-materials"){
+            config.synthetic_materials = static_cast<uint32_t>(std::stoul(std::string{next_value()}));
+        }else if(arg == "--bindless"){
+            config.bindless_materials = true;
+        }else if(arg == "--bench-materials"){
+            config.material_bench = true;
+        }else if(arg == "--profile-out"){
+            config.profile_output = next_value();
+        }else if(arg == "--dump-interval"){
+            config.dump_interval = std::max(1u, static_cast<uint32_t>(std::stoul(std::string{next_value()})));
+        }else{
+            throw std::invalid_argument{std::format("unknown option {}", arg)};
+        }
+    }
+    config.split_vertex_streams = config.depth_prepass && !interleaved_vertices;
+    return config;
+}
+
+// Runs the app once per case and prints a table of one row per run after the last, so the rows don't mix
+// with what the runs print. Runs are headless unless configure turns that off. configure(config, i) sets
+// case i up and returns false to leave it out, row(app, config, i) formats the columns after the case's
+// name. A case that throws, e.g. on a device without a feature, prints why it was skipped instead.
+template<typename Configure, typename Row>
+static void run_sweep(App_config config, uint32_t default_frame_count, const std::vector<std::string>& names, int name_width,
+    std::string_view header, Configure&& configure, Row&& row){
+    config.headless = true;
+    config.dump_directory.clear();
+    config.profile_output.clear();
+    if(config.frame_count == 0){
+        config.frame_count = default_frame_count;
+    }
+
+    std::vector<std::string> rows;
+    for(size_t i = 0; i < names.size(); i++){
+        auto case_config = config;
+        try{
+            if(!configure(case_config, i)){
+                continue;
+            }
+            HelloTriangleApp app{WIDTH, HEIGHT, "Vulkan", case_config};
+            app.run();
+            rows.push_back(std::format("{:>{}} {}", names[i], name_width, row(app, case_config, i)));
+        }catch(const std::exception& e){
+            rows.push_back(std::format("{:>{}} skipped: {}", names[i], name_width, e.what()));
+        }
+    }
+
+    std::cout << std::format("{} frames\n{}\n", config.frame_count, header);
+    for(const auto& line: rows){
+        std::cout << line << '\n';
+    }
+}
+
+// Renders headless with growing instance counts, reports CPU instance update, CPU frame and GPU time.
+static void run_instance_sweep(const App_config& config){
+    constexpr std::array<uint32_t, 5> COUNTS{1, 1000, 10000, 100000, 1000000};
+    std::vector<std::string> names;
+    for(auto count: COUNTS){
+        names.push_back(std::to_string(count));
+    }
+    run_sweep(config, 200, names, 10,
+        std::format("{:>10} {:>12} {:>12} {:>12} {:>12} {:>12}", "instances", "visible", "update (ms)", "frame (ms)", "frame p99", "gpu (ms)"),
+        [&](App_config& run_config, size_t i){
+            run_config.instance_count = COUNTS[i];
+            return true;
+        },
+        [&](HelloTriangleApp& app, const App_config& run_config, size_t){
+            auto stats = app.frame_profiler().summarize();
+            const auto& update = stats[static_cast<size_t>(Frame_phase::update_uniforms)];
+            const auto& frame = stats[FRAME_PHASE_COUNT];
+            const auto& gpu = stats[FRAME_PHASE_COUNT + 1];
+            return std::format("{:>12.1f} {:>12.3f} {:>12.3f} {:>12.3f} {:>12.3f}", run_config.gpu_culling ? app.mean_visible_objects() :
+                static_cast<double>(run_config.instance_count), update.mean_, frame.mean_, frame.p99_, gpu.mean_);
+        });
+}
+
+// Renders windowed with every present mode and 2 to 4 swap chain images, reports throughput and acquire-to-present latency.
+// A mode the surface doesn't support is reported once.
+static void run_present_sweep(const App_config& config){
+    constexpr std::array<uint32_t, 3> IMAGE_COUNTS{2, 3, 4};
+    std::vector<std::string> names;
+    for(auto [name, mode]: PRESENT_MODE_NAMES){
+        for(auto image_count: IMAGE_COUNTS){
+            names.push_back(std::format("{:>14} {:>7}", name, image_count));
+        }
+    }
+    std::vector<bool> unsupported(PRESENT_MODE_NAMES.size());
+    run_sweep(config, 300, names, 22,
+        std::format("{:>14} {:>7} {:>10} {:>12} {:>12} {:>12} {:>13}", "present mode", "images", "fps", "frame p99", "latency p50", "latency p99",
+            "measured by"),
+        [&](App_config& run_config, size_t i){
+            run_config.headless = false;
+            run_config.present_mode = PRESENT_MODE_NAMES[i / IMAGE_COUNTS.size()].second;
+            run_config.swap_chain_image_count = IMAGE_COUNTS[i % IMAGE_COUNTS.size()];
+            return !unsupported[i / IMAGE_COUNTS.size()];
+        },
+        [&](HelloTriangleApp& app, const App_config& run_config, size_t i){
+            if(app.present_mode() != run_config.present_mode){
+                unsupported[i / IMAGE_COUNTS.size()] = true;
+                return std::string{"unsupported"};
+            }
+            const auto& frame = app.frame_profiler().summarize()[FRAME_PHASE_COUNT];
+            auto latency = app.present_latency();
+            return std::format("{:>10.1f} {:>12.3f} {:>12.3f} {:>12.3f} {:>13} ({} images)", frame.mean_ > 0.0 ? 1000.0 / frame.mean_ : 0.0,
+                frame.p99_, latency.p50_, latency.p99_, app.present_latency_source(), app.swap_chain_image_count());
+        });
+}
+
+// Renders headless without a prepass, then with a depth prepass over interleaved and over split vertex
+// streams. Reports the bytes the prepass fetches per vertex and per frame next to the GPU time.
+static void run_vertex_stream_sweep(const App_config& config){
+    struct Variant{
+        std::string_view name_;
+        bool depth_prepass_;
+        bool split_vertex_streams_;
+    };
+    constexpr std::array<Variant, 3> VARIANTS{{
+        {"no prepass", false, false},
+        {"prepass, interleaved", true, false},
+        {"prepass, split", true, true},
+    }};
+    std::vector<std::string> names;
+    for(const auto& variant: VARIANTS){
+        names.emplace_back(variant.name_);
+    }
+    run_sweep(config, 200, names, 22,
+        std::format("{:>22} {:>14} {:>16} {:>12} {:>12}", "variant", "prepass B/vtx", "prepass MiB/frame", "gpu (ms)", "gpu p99"),
+        [&](App_config& run_config, size_t i){
+            run_config.depth_prepass = VARIANTS[i].depth_prepass_;
+            run_config.split_vertex_streams = VARIANTS[i].split_vertex_streams_;
+            return true;
+        },
+        [&](HelloTriangleApp& app, const App_config& run_config, size_t i){
+            const auto& gpu = app.frame_profiler().summarize()[FRAME_PHASE_COUNT + 1];
+            // Upper bound: every vertex of every instance fetched once, ignoring the post-transform cache.
+            auto prepass_bytes = VARIANTS[i].depth_prepass_ ?
+                static_cast<double>(app.model_vertex_count()) * run_config.instance_count * app.position_fetch_size() : 0.0;
+            return std::format("{:>14} {:>16.2f} {:>12.3f} {:>12.3f}", VARIANTS[i].depth_prepass_ ? app.position_fetch_size() : 0u,
+                prepass_bytes / 1048576.0, gpu.mean_, gpu.p99_);
+        });
+}
+
+// Welds synthetic grid meshes (6 corners per quad, 4 distinct vertices) with the node based
+// std::unordered_map of the original loader, the flat table and the sharded parallel path.
+static void run_weld_benchmark(const App_config& config){
+    const size_t threads = load_thread_count(config);
+    Worker_pool pool{threads};
+    constexpr std::array<uint32_t, 6> QUAD_CORNERS{0, 1, 2, 2, 1, 3};
+
+    std::cout << std::format("{:>10} {:>10} {:>16} {:>12} {:>16} {:>10}\n", "corners", "vertices", "unordered_map", "flat (ms)",
+        std::format("parallel x{}", threads), "identical");
+    for(size_t target: {size_t{1'000'000}, size_t{10'000'000}, size_t{50'000'000}}){
+        auto side = static_cast<size_t>(std::sqrt(static_cast<double>(target) / 6.0));
+        auto corner_count = side * side * 6;
+        auto corner = [&](size_t c){
+            auto quad = c / 6;
+            auto grid_corner = QUAD_CORNERS[c % 6];
+            auto x = static_cast<float>(quad % side + (grid_corner & 1));
+            auto y = static_cast<float>(quad / side + (grid_corner >> 1));
+            Vertex vertex{};
+            vertex.pos_ = {x, 0.0f, y};
+            vertex.color_ = {1.0f, 1.0f, 1.0f};
+            vertex.tex_coord_ = {x / static_cast<float>(side), y / static_cast<float>(side)};
+            return vertex;
+        };
+
+        std::vector<Vertex> map_vertices;
+        std::vector<uint32_t> map_indices;
+        auto map_ms = time_ms([&]{
+            std::unordered_map<Vertex, uint32_t> unique_vertices{};
+            for(size_t c = 0; c < corner_count; c++){
+                auto vertex = corner(c);
+                if(unique_vertices.count(vertex) == 0){
+                    unique_vertices[vertex] = static_cast<uint32_t>(unique_vertices.size());
+                    map_vertices.push_back(vertex);
+                }
+                map_indices.push_back(unique_vertices[vertex]);
+            }
+        });
+
+        std::vector<Vertex> flat_vertices;
+        std::vector<uint32_t> flat_indices;
+        auto flat_ms = time_ms([&]{ weld_vertices<Vertex, Vertex_hash>(corner_count, corner, flat_vertices, flat_indices); });
+
+        std::vector<Vertex> parallel_vertices;
+        std::vector<uint32_t> parallel_indices;
+        auto parallel_ms = time_ms([&]{ weld_vertices_parallel<Vertex, Vertex_hash>(corner_count, corner, pool, parallel_vertices, parallel_indices); });
+
+        auto same = [&](const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices){
+            return vertices.size() == map_vertices.size() && indices == map_indices &&
+                std::memcmp(vertices.data(), map_vertices.data(), vertices.size() * sizeof(Vertex)) == 0;
+        };
+        std::cout << std::format("{:>10} {:>10} {:>16.1f} {:>12.1f} {:>16.1f} {:>10}\n", corner_count, map_vertices.size(),
+            map_ms, flat_ms, parallel_ms, same(flat_vertices, flat_indices) && same(parallel_vertices, parallel_indices) ? "yes" : "NO");
+    }
+}
+
+// Runs the mesh optimizer on UV spheres with shuffled triangles and vertices, prints ACMR/ATVR and
+// timings per stage.
+static void run_mesh_optimizer_benchmark(){
+    std::cout << std::format("{:>10} {:>14} {:>14} {:>14} {:>10} {:>12} {:>12}\n", "triangles", "ACMR before", "ACMR tipsify",
+        "ACMR overdraw", "ATVR", "tipsify ms", "total ms");
+    for(uint32_t rings: {100u, 400u, 1000u}){
+        auto sphere = uv_sphere(rings);
+        auto& positions = sphere.positions_;
+        auto& indices = sphere.indices_;
+
+        // Worst case input: random triangle order and vertex numbering.
+        std::mt19937 random{rings};
+        std::vector<uint32_t> shuffle(positions.size());
+        std::iota(shuffle.begin(), shuffle.end(), 0u);
+        std::shuffle(shuffle.begin(), shuffle.end(), random);
+        apply_vertex_remap(positions, indices, shuffle);
+        std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+        std::memcpy(triangles.data(), indices.data(), indices.size() * sizeof(uint32_t));
+        std::shuffle(triangles.begin(), triangles.end(), random);
+        std::memcpy(indices.data(), triangles.data(), indices.size() * sizeof(uint32_t));
+
+        auto before = analyze_vertex_cache(indices, positions.size());
+        auto start_time = std::chrono::steady_clock::now();
+        auto clusters = optimize_vertex_cache(indices, positions.size());
+        auto tipsify_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        auto tipsified = analyze_vertex_cache(indices, positions.size());
+        optimize_overdraw(indices, clusters, [&](uint32_t vertex){ return positions[vertex]; });
+        auto remap = vertex_fetch_remap(indices, positions.size());
+        apply_vertex_remap(positions, indices, remap);
+        auto total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        auto after = analyze_vertex_cache(indices, positions.size());
+
+        std::cout << std::format("{:>10} {:>14.3f} {:>14.3f} {:>14.3f} {:>10.3f} {:>12.1f} {:>12.1f}\n", indices.size() / 3,
+            before.acmr_, tipsified.acmr_, after.acmr_, after.atvr_, tipsify_ms, total_ms);
+    }
+}
+
+// Builds meshlets from UV spheres in Tipsify order and reports how many the frustum and normal cone tests
+// reject from random viewpoints around the sphere.
+static void run_meshlet_benchmark(){
+    constexpr int VIEWS = 1000;
+    std::cout << std::format("{:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>12}\n", "triangles", "meshlets", "tris/mlt",
+        "verts/mlt", "build ms", "frustum %", "cone %", "visible %", "ns/meshlet");
+    for(uint32_t rings: {100u, 400u, 1000u}){
+        auto sphere = uv_sphere(rings);
+        auto& positions = sphere.positions_;
+        auto& indices = sphere.indices_;
+        optimize_vertex_cache(indices, positions.size());
+        auto position = [&](uint32_t vertex){ return positions[vertex]; };
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto meshlets = build_meshlets(indices, positions.size(), position);
+        auto build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        double vertex_sum{};
+        for(const auto& meshlet: meshlets){
+            vertex_sum += meshlet.vertex_count_;
+        }
+
+        // Cameras 1.5 to 4 radii away looking at the center, close ones only see part of the sphere.
+        std::mt19937 random{rings};
+        std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+        std::uniform_real_distribution<float> distance{1.5f, 4.0f};
+        uint64_t frustum_culled{}, cone_culled{}, visible{};
+        std::chrono::steady_clock::duration cull_time{};
+        for(int view = 0; view < VIEWS; view++){
+            glm::vec3 direction{unit(random), unit(random), unit(random)};
+            if(glm::length(direction) < 1e-3f){
+                direction = {1.0f, 0.0f, 0.0f};
+            }
+            auto eye = glm::normalize(direction) * distance(random);
+            auto up = std::abs(glm::normalize(direction).y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+            auto planes = frustum_planes(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 10.0f) * glm::lookAt(eye, glm::vec3(0.0f), up));
+            std::array<float, 3> camera{eye.x, eye.y, eye.z};
+
+            auto view_start = std::chrono::steady_clock::now();
+            for(const auto& meshlet: meshlets){
+                if(is_sphere_outside_frustum(meshlet.bounding_sphere_, planes)){
+                    frustum_culled++;
+                }else if(is_meshlet_backfacing(meshlet, camera)){
+                    cone_culled++;
+                }else{
+                    visible++;
+                }
+            }
+            cull_time += std::chrono::steady_clock::now() - view_start;
+        }
+        auto tested = static_cast<double>(meshlets.size()) * VIEWS;
+        std::cout << std::format("{:>10} {:>10} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>12.2f}\n", indices.size() / 3,
+            meshlets.size(), indices.size() / 3.0 / meshlets.size(), vertex_sum / meshlets.size(), build_ms,
+            100.0 * frustum_culled / tested, 100.0 * cone_culled / tested, 100.0 * visible / tested,
+            std::chrono::duration<double, std::nano>(cull_time).count() / tested);
+    }
+}
+
+// Times LOD chain builds of UV spheres and prints every LOD's recorded error.
+static void run_lod_benchmark(){
+    std::cout << std::format("{:>10} {:>5} {:>10} {:>12} {:>10}\n", "triangles", "lod", "lod tris", "error", "build ms");
+    for(uint32_t rings: {8u, 16u, 32u, 200u, 400u}){
+        auto sphere = uv_sphere(rings);
+        auto& positions = sphere.positions_;
+        auto& indices = sphere.indices_;
+        const auto full_detail_count = indices.size();
+        auto position = [&](uint32_t vertex){ return positions[vertex]; };
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto lods = build_lod_chain(indices, positions.size(), position);
+        auto build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        for(size_t lod = 0; lod < lods.size(); lod++){
+            std::cout << std::format("{:>10} {:>5} {:>10} {:>12.6f} {:>10.1f}\n", full_detail_count / 3, lod, lods[lod].index_count_ / 3,
+                lods[lod].error_, build_ms);
+        }
+    }
+}
+
+// Renders headless at full detail and with LODs at several pixel thresholds, reports the triangles drawn
+// per frame, frame and GPU time and GPU triangle throughput.
+static void run_lod_sweep(App_config config){
+    if(config.instance_count == 1){
+        config.instance_count = 10000;
+    }
+    // 0 draws every instance at full detail, the same as running without LODs.
+    constexpr std::array<float, 5> PIXELS{0.0f, 0.5f, 1.0f, 2.0f, 4.0f};
+    std::vector<std::string> names;
+    for(auto pixels: PIXELS){
+        names.push_back(pixels > 0.0f ? std::format("lod {:.1f} px", pixels) : std::string{"full detail"});
+    }
+    run_sweep(config, 200, names, 14,
+        std::format("{} instances\n{:>14} {:>14} {:>12} {:>12} {:>12}", config.instance_count, "mode", "triangles", "frame (ms)", "gpu (ms)", "Mtri/s"),
+        [&](App_config& run_config, size_t i){
+            run_config.lods = PIXELS[i] > 0.0f;
+            run_config.lod_error_pixels = PIXELS[i];
+            return true;
+        },
+        [&](HelloTriangleApp& app, const App_config& run_config, size_t){
+            auto stats = app.frame_profiler().summarize();
+            const auto& frame = stats[FRAME_PHASE_COUNT];
+            const auto& gpu = stats[FRAME_PHASE_COUNT + 1];
+            auto triangles = run_config.lods ? app.mean_lod_triangles() : static_cast<double>(app.model_triangle_count()) * run_config.instance_count;
+            return std::format("{:>14.0f} {:>12.3f} {:>12.3f} {:>12.1f}", triangles, frame.mean_, gpu.mean_,
+                gpu.mean_ > 0.0 ? triangles / gpu.mean_ / 1000.0 : 0.0);
+        });
+}
+
+// Times mip chains of noise images with the scalar reference and with mip_generator.h on one and on all
+// threads, and prints the largest difference to the reference.
+static void run_mip_benchmark(const App_config& config){
+    Worker_pool pool{load_thread_count(config)};
+    std::cout << std::format("{} path, {} threads\n{:>11} {:>7} {:>14} {:>14} {:>14} {:>10}\n", mip_simd_name(), pool.size(), "size",
+        "levels", "reference ms", "1 thread ms", "threads ms", "chain err");
+    for(auto [width, height]: {std::pair{257u, 129u}, std::pair{1024u, 1024u}, std::pair{2048u, 2048u}, std::pair{4096u, 2048u}}){
+        std::mt19937 random{width * height};
+        std::vector<uint8_t> pixels(size_t{width} * height * 4);
+        for(auto& value: pixels){
+            value = static_cast<uint8_t>(random());
+        }
+        Mip_chain reference, single, threaded;
+        auto reference_ms = time_ms([&]{ reference = generate_mip_chain_reference(pixels, width, height); });
+        auto single_ms = time_ms([&]{ single = generate_mip_chain(pixels, width, height); });
+        auto threaded_ms = time_ms([&]{ threaded = generate_mip_chain(pixels, width, height, &pool); });
+
+        // Errors compound down the chain, the per level error is in the test.
+        int chain_error{};
+        for(size_t i = 0; i < reference.pixels_.size(); i++){
+            chain_error = std::max(chain_error, std::abs(reference.pixels_[i] - single.pixels_[i]));
+        }
+        std::cout << std::format("{:>11} {:>7} {:>14.2f} {:>14.2f} {:>14.2f} {:>10}\n", std::format("{}x{}", width, height),
+            single.levels_.size(), reference_ms, single_ms, threaded_ms, chain_error);
+    }
+}
+
+// Renders headless with the texture loaded before the first frame and streamed after it, and prints
+// when the first frame was submitted and when the texture was complete at full resolution.
+static void run_texture_stream_sweep(App_config config){
+    config.compressed_textures = false;
+    struct Mode{
+        const char* name_;
+        bool stream_;
+        bool cpu_mipmaps_;
+        bool mip_cache_;
+    };
+    constexpr std::array<Mode, 4> MODES{{
+        {"blocking, GPU mips", false, false, false},
+        {"blocking, CPU mips", false, true, false},
+        {"streamed, decode", true, false, false},
+        {"streamed, mip cache", true, false, true},
+    }};
+    std::vector<std::string> names;
+    for(const auto& mode: MODES){
+        names.emplace_back(mode.name_);
+    }
+    run_sweep(config, 120, names, 20, std::format("{:>20} {:>16} {:>16} {:>14}", "mode", "first frame ms", "full res ms", "full res frame"),
+        [&](App_config& run_config, size_t i){
+            run_config.stream_textures = MODES[i].stream_;
+            run_config.cpu_mipmaps = MODES[i].cpu_mipmaps_;
+            run_config.mip_cache = MODES[i].mip_cache_;
+            if(MODES[i].mip_cache_){
+                // Warm run so the measured one reads the cache.
+                HelloTriangleApp{WIDTH, HEIGHT, "Vulkan", run_config}.run();
+            }
+            return true;
+        },
+        [&](HelloTriangleApp& app, const App_config&, size_t){
+            auto resident = app.texture_resident_ms() < 0.0 ? std::string{"not resident"} : std::format("{:.1f}", app.texture_resident_ms());
+            return std::format("{:>16.1f} {:>16} {:>14}", app.first_frame_ms(), resident, app.texture_resident_frame());
+        });
+}
+
+// Renders headless with the model split into growing numbers of materials, once binding a descriptor set per
+// material and once pushing an index into the bindless array. Every draw changes the material, so the record
+// phase shows what the switch costs per draw.
+static void run_material_sweep(App_config config){
+    config.materials = false;
+    constexpr std::array<uint32_t, 4> COUNTS{1, 16, 256, 1024};
+    std::vector<std::string> names;
+    for(auto count: COUNTS){
+        for(bool bindless: {false, true}){
+            names.push_back(std::format("{} {}", count, bindless ? "bindless" : "sets"));
+        }
+    }
+    run_sweep(config, 200, names, 16,
+        std::format("{:>16} {:>8} {:>12} {:>14} {:>12} {:>12}", "materials", "draws", "record (ms)", "per draw (us)", "frame (ms)", "gpu (ms)"),
+        [&](App_config& run_config, size_t i){
+            run_config.synthetic_materials = COUNTS[i / 2];
+            run_config.bindless_materials = i % 2 == 1;
+            return true;
+        },
+        [&](HelloTriangleApp& app, const App_config&, size_t){
+            auto stats = app.frame_profiler().summarize();
+            const auto& record = stats[static_cast<size_t>(Frame_phase::record)];
+            const auto& frame = stats[FRAME_PHASE_COUNT];
+            const auto& gpu = stats[FRAME_PHASE_COUNT + 1];
+            return std::format("{:>8} {:>12.3f} {:>14.3f} {:>12.3f} {:>12.3f}", app.draw_command_count(), record.mean_,
+                record.mean_ * 1000.0 / app.draw_command_count(), frame.mean_, gpu.mean_);
+        });
+}
+
+// Times BC1 compression of the app's texture and two synthetic images and prints sizes and PSNR, then
+// compares what a load costs: decoding the PNG and building RGBA8 mips against reading the BC1 file, and
+// how much of each goes to the GPU.
+static void run_texture_format_benchmark(const App_config& config){
+    Worker_pool pool{load_thread_count(config)};
+    struct Image{
+        std::string name_;
+        uint32_t width_;
+        uint32_t height_;
+        std::vector<uint8_t> pixels_;
+    };
+    std::vector<Image> images;
+    int tex_width{}, tex_height{}, tex_channels{};
+    if(stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha)){
+        images.push_back({TEXTURE_PATH, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height),
+            {pixels, pixels + static_cast<size_t>(tex_width) * tex_height * 4}});
+        stbi_image_free(pixels);
+    }else{
+        std::cerr << std::format("can't load {}, synthetic images only\n", TEXTURE_PATH);
+    }
+    // Smooth gradients with a little noise, closer to real albedo than white noise, which BC1 can't represent.
+    for(uint32_t size: {1024u, 2048u}){
+        std::mt19937 random{size};
+        Image image{std::format("synthetic {}x{}", size, size), size, size, std::vector<uint8_t>(size_t{size} * size * 4)};
+        for(uint32_t y = 0; y < size; y++){
+            for(uint32_t x = 0; x < size; x++){
+                auto* pixel = image.pixels_.data() + (size_t{y} * size + x) * 4;
+                pixel[0] = static_cast<uint8_t>(128 + 100 * std::sin(x * 0.02f) + random() % 8);
+                pixel[1] = static_cast<uint8_t>(128 + 100 * std::cos(y * 0.03f) + random() % 8);
+                pixel[2] = static_cast<uint8_t>((x + y) / 8 % 256);
+                pixel[3] = 255;
+            }
+        }
+        images.push_back(std::move(image));
+    }
+
+    std::cout << std::format("{} threads\n{:>28} {:>11} {:>11} {:>11} {:>7} {:>12} {:>12} {:>9}\n", pool.size(), "image", "size",
+        "RGBA8 KiB", "BC1 KiB", "ratio", "1 thread ms", "threads ms", "PSNR dB");
+    for(const auto& image: images){
+        auto chain = generate_mip_chain(image.pixels_, image.width_, image.height_, &pool);
+        Mip_chain single, threaded;
+        auto single_ms = time_ms([&]{ single = encode_bc1_chain(chain); });
+        auto threaded_ms = time_ms([&]{ threaded = encode_bc1_chain(chain, &pool); });
+
+        auto decoded = decode_bc1_image({single.pixels_.data(), bc1_size(image.width_, image.height_)}, image.width_, image.height_);
+        double squared_error{};
+        for(size_t i = 0; i < decoded.size(); i++){
+            if(i % 4 != 3){
+                double delta = static_cast<double>(decoded[i]) - chain.pixels_[i];
+                squared_error += delta * delta;
+            }
+        }
+        double mean_squared_error = squared_error / (decoded.size() / 4 * 3);
+        double psnr = mean_squared_error > 0 ? 10.0 * std::log10(255.0 * 255.0 / mean_squared_error) : 99.0;
+        std::cout << std::format("{:>28} {:>11} {:>11} {:>11} {:>7.2f} {:>12.2f} {:>12.2f} {:>9.2f}\n", image.name_,
+            std::format("{}x{}", image.width_, image.height_), chain.pixels_.size() / 1024, single.pixels_.size() / 1024,
+            double(chain.pixels_.size()) / single.pixels_.size(), single_ms, threaded_ms, psnr);
+    }
+
+    if(images.empty() || images[0].name_ != TEXTURE_PATH){
+        return;
+    }
+    // Load paths as the app runs them, from the page cache: PNG decode plus mips against mapping the KTX2 file.
+    const auto& texture = images[0];
+    Mip_chain png_chain;
+    auto png_ms = time_ms([&]{
+        Mapped_file png{TEXTURE_PATH};
+        int width{}, height{}, channels{};
+        stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(png.bytes().data()), static_cast<int>(png.bytes().size()),
+            &width, &height, &channels, STBI_rgb_alpha);
+        png_chain = generate_mip_chain({pixels, static_cast<size_t>(width) * height * 4}, static_cast<uint32_t>(width), static_cast<uint32_t>(height), &pool);
+        stbi_image_free(pixels);
+    });
+    auto blocks = encode_bc1_chain(png_chain, &pool);
+    auto file = encode_ktx2(KTX2_BC1_RGB_SRGB, blocks.levels_, blocks.pixels_, {});
+    auto ktx2_path = std::filesystem::temp_directory_path() / "tiny-vulkan-bench.ktx2";
+    std::ofstream{ktx2_path, std::ios::binary | std::ios::trunc}.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+    std::vector<uint8_t> staging;
+    std::optional<Ktx2_image> parsed;
+    auto ktx2_ms = time_ms([&]{
+        Mapped_file mapped{ktx2_path};
+        parsed = decode_ktx2(mapped.bytes());
+        if(parsed){
+            auto* data = reinterpret_cast<const uint8_t*>(mapped.bytes().data());
+            staging.assign(data + parsed->levels_.back().offset_, data + parsed->levels_.front().offset_ + bc1_size(texture.width_, texture.height_));
+        }
+    });
+    std::filesystem::remove(ktx2_path);
+    std::cout << std::format("load {}: PNG + RGBA8 mips {:.2f} ms, {} KiB uploaded; KTX2 BC1 {:.2f} ms, {} KiB uploaded\n",
+        TEXTURE_PATH, png_ms, png_chain.pixels_.size() / 1024, ktx2_ms, staging.size() / 1024);
+}
+
+int main(int argc, char** argv){
     uint32_t extensionCount {};
     vkEnumerateInstanceExtensionProperties(nullptr,&extensionCount,nullptr);
 
@@ -15,7 +648,56 @@ int main(){
     auto test = matrix * vec;
     
     
-    HelloTriangleApp app;
+    auto config = parse_app_config(argc, argv);
+    if(config.instance_sweep){
+        run_instance_sweep(config);
+        return 0;
+    }
+    if(config.present_sweep){
+        run_present_sweep(config);
+        return 0;
+    }
+    if(config.vertex_stream_bench){
+        run_vertex_stream_sweep(config);
+        return 0;
+    }
+    if(config.weld_bench){
+        run_weld_benchmark(config);
+        return 0;
+    }
+    if(config.meshlet_bench){
+        run_meshlet_benchmark();
+        return 0;
+    }
+    if(config.lod_sweep){
+        run_lod_sweep(config);
+        return 0;
+    }
+    if(config.lod_bench){
+        run_lod_benchmark();
+        return 0;
+    }
+    if(config.mip_bench){
+        run_mip_benchmark(config);
+        return 0;
+    }
+    if(config.texture_stream_bench){
+        run_texture_stream_sweep(config);
+        return 0;
+    }
+    if(config.texture_format_bench){
+        run_texture_format_benchmark(config);
+        return 0;
+    }
+    if(config.material_bench){
+        run_material_sweep(config);
+        return 0;
+    }
+    if(config.mesh_optimizer_bench){
+        run_mesh_optimizer_benchmark();
+        return 0;
+    }
+    HelloTriangleApp app{WIDTH, HEIGHT, "Vulkan", config};
     app.run();
 
 
@@ -6,6 +6,20 @@
 #include "glm/ext/vector_float2.hpp"
 #include "glm/ext/vector_float3.hpp"
 #include "glm/trigonometric.hpp"
+#include "frame_profiler.h"
+#include "mapped_file.h"
+#include "memory_allocator.h"
+#include "mesh_optimizer.h"
+#include "meshlet_builder.h"
+#include "mip_generator.h"
+#include "mesh_simplifier.h"
+#include "bc_encoder.h"
+#include "ktx2.h"
+#include "material_sort.h"
+#include "obj_parser.h"
+#include "vertex_format.h"
+#include "vertex_welder.h"
+#include "worker_pool.h"
 #include "swap_chain.h"
 #include "tiny-vulkan.h"
  
@@ -42,6 +56,9 @@
 #include <algorithm>
 #include <cstring>
 #include <chrono>
+#include <deque>
+#include <future>
+#include <filesystem>
 
 #include <stb/stb_image.h>
 #include <tinyobjloader/tiny_obj_loader.h>
@@ -55,69 +72,321 @@ false;
 #else
 true;
 #endif
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Bounds and default of App_config::frames_in_flight.
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+// Start and end of the render pass.
+constexpr uint32_t TIMESTAMPS_PER_FRAME = 2;
 constexpr uint32_t WIDTH = 800;
 constexpr uint32_t HEIGHT = 600;
 
 const std::string MODEL_PATH = "models/test_model.obj";
 const std::string TEXTURE_PATH = "textures/test_texture.png";
 
-struct Queue_family_indices{
-    std::optional <uint32_t> graphics_family;
-    std::optional<uint32_t> present_family;
+// Acquire-to-present samples waiting for vkWaitForPresentKHR, older ones are dropped.
+constexpr size_t MAX_PENDING_PRESENTS = 64;
+
+// Below this many OBJ corners welding stays on the calling thread.
+constexpr size_t PARALLEL_WELD_MIN_CORNERS = size_t{1} << 22;
+
+// Frames rendered by a headless run when no explicit count is given.
+constexpr uint32_t DEFAULT_HEADLESS_FRAME_COUNT = 100;
+
+// Staging bytes a frame uploads for a streamed texture, at least one level always goes.
+constexpr size_t TEXTURE_STREAM_BYTES_PER_FRAME = size_t{1} << 20;
+
+// Size of the bindless material texture array, lowered to what the device can bind to one stage.
+constexpr uint32_t MAX_BINDLESS_MATERIALS = 1024;
+
+// Near plane of the camera, also the closest distance LOD selection assumes.
+constexpr float NEAR_PLANE = 0.1f;
+
+struct App_config{
+    // Render into offscreen images instead of a window surface and swap chain.
+    bool headless = false;
+    // Stop after this many frames, 0 means run until the window is closed.
+    uint32_t frame_count = 0;
+    // Headless only: write every dump_interval-th frame as a PPM into this directory.
+    std::string dump_directory;
+    uint32_t dump_interval = 1;
+    // Per-phase frame timings are written to <profile_output>.csv/.json at exit, empty disables.
+    std::string profile_output = "frame_times";
+    // Pipeline cache blob loaded at startup and written back at exit, empty disables.
+    std::string pipeline_cache_path = "pipeline_cache.bin";
+    // Buffers to create per path in the allocation benchmark, 0 runs the app normally.
+    uint32_t alloc_bench_count = 0;
+    // Record startup copies and layout transitions into one command buffer instead of a submit + idle each.
+    bool batch_uploads = true;
+    // Run staging copies on a transfer-only queue family when the device has one.
+    bool async_transfer = true;
+    // Record the scene once per (frame slot, swap chain image) instead of every frame.
+    bool static_command_buffers = false;
+    // Threads recording secondary command buffers, 0 records inline on the main thread.
+    uint32_t record_threads = 0;
+    // Number of draws the model is split into.
+    uint32_t draw_count = 1;
+    // Time recording for a range of thread and draw counts instead of running the app.
+    bool record_bench = false;
+    // Copies of the model drawn per draw command, laid out on a grid.
+    uint32_t instance_count = 1;
+    // Handled by main(): run headless once per instance count and print a table.
+    bool instance_sweep = false;
+    // Half size of the instance grid, larger values push copies out of the view.
+    float instance_spread = 1.0f;
+    // Frustum cull instances in a compute pass and draw the survivors indirectly.
+    bool gpu_culling = false;
+    // Frames the CPU may run ahead of the GPU, 1..MAX_FRAMES_IN_FLIGHT. Lower means less latency.
+    uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+    // Requested present mode, FIFO is used when the surface doesn't support it.
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+    // Requested swap chain images, 0 means minImageCount + 1. Clamped to the surface limits.
+    uint32_t swap_chain_image_count = 0;
+    // Handled by main(): run windowed once per present mode and image count and print a table.
+    bool present_sweep = false;
+    // Directory of binary meshes keyed by the OBJ content hash, empty always parses the OBJ.
+    std::string mesh_cache_directory = "mesh_cache";
+    // Time OBJ parsing against mesh cache loads instead of running the app.
+    bool mesh_load_bench = false;
+    // Threads used to load the model, 0 uses every hardware thread.
+    uint32_t load_threads = 0;
+    // Parse OBJs with obj_parser.h, tinyobj remains the fallback for what it doesn't handle.
+    bool parallel_obj_parser = true;
+    // Reorder the loaded model for the post-transform cache, overdraw and vertex fetch.
+    bool optimize_mesh = false;
+    // Check the packed vertex quantization error on the model and print both layouts' sizes instead of running the app.
+    bool vertex_format_bench = false;
+    // Positions in their own vertex stream, the other attributes in a second one. Off like depth_prepass,
+    // parse_app_config() turns it on with the prepass, the only pass that reads positions alone.
+    bool split_vertex_streams = false;
+    // Lay down depth with a position-only pipeline before the shaded pass.
+    bool depth_prepass = false;
+    // Handled by main(): run headless without prepass and with a prepass over interleaved and split streams.
+    bool vertex_stream_bench = false;
+    // Draw the model as meshlets, culled per frame on the CPU or, with gpu_culling, in a compute pass.
+    bool meshlets = false;
+    // Handled by main(): build meshlets from synthetic meshes and measure culling rates.
+    bool meshlet_bench = false;
+    // Simplify the model into a LOD chain and draw every instance with the coarsest LOD that looks the same.
+    bool lods = false;
+    // Largest screen space error of a selected LOD, in pixels.
+    float lod_error_pixels = 1.0f;
+    // Handled by main(): time the simplifier and print the recorded LOD errors.
+    bool lod_bench = false;
+    // Handled by main(): run headless at full detail and with LODs at several pixel errors and print a table.
+    bool lod_sweep = false;
+    // Build the texture's mips on the CPU and upload every level in one copy instead of blitting them on
+    // the GPU. Used anyway when the texture format can't be blitted with a linear filter.
+    bool cpu_mipmaps = false;
+    // Keep CPU built mips in a file next to the texture, keyed by the texture's content hash.
+    bool mip_cache = true;
+    // Handled by main(): time the CPU mip generator against the scalar reference.
+    bool mip_bench = false;
+    // Decode the texture on a loader thread and start drawing with a placeholder; the levels are uploaded
+    // smallest first over the following frames.
+    bool stream_textures = false;
+    // Handled by main(): compare time to first frame and to a full resolution texture with and without streaming.
+    bool texture_stream_bench = false;
+    // Upload the texture as BC1 blocks from a KTX2 file next to it, encoded on first use. Falls back to
+    // RGBA8 when the device can't sample BC1.
+    bool compressed_textures = false;
+    // Handled by main(): time the BC1 encoder, compare sizes, quality and load times with RGBA8.
+    bool texture_format_bench = false;
+    // Load the OBJ's material library and draw each material's triangles with its diffuse texture.
+    bool materials = false;
+    // Split the model into this many materials that all sample the app's texture instead, 0 disables.
+    uint32_t synthetic_materials = 0;
+    // Select the material with a push constant index into one array of every texture instead of binding a
+    // descriptor set per material.
+    bool bindless_materials = false;
+    // Handled by main(): run headless with growing material counts, binding sets per material and bindless.
+    bool material_bench = false;
+    // Handled by main(): time the mesh optimizer on synthetic meshes and print its cache metrics.
+    bool mesh_optimizer_bench = false;
+    // Handled by main(): time vertex welding on synthetic meshes and print a table.
+    bool weld_bench = false;
+};
 
-    bool is_complete()const{
-        return graphics_family.has_value() && present_family.has_value();
+// Worker threads for loading: config.load_threads, or one per hardware thread when that's 0.
+inline size_t load_thread_count(const App_config& config){
+    return config.load_threads ? config.load_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Wall time of one call in milliseconds.
+template<typename Function>
+double time_ms(Function&& function){
+    auto start_time = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Writes the parts one after another next to path and renames the result over it, so a crash never
+// leaves a half written file behind and a reader never maps one. Failures are reported, not thrown.
+inline void write_file_atomically(const std::filesystem::path& path, std::initializer_list<std::span<const std::byte>> parts){
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        for(auto part: parts){
+            file.write(reinterpret_cast<const char*>(part.data()), static_cast<std::streamsize>(part.size()));
+        }
+        if(!file){
+            std::cerr << std::format("failed to write {}\n", temp_path.string());
+            return;
+        }
     }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if(error){
+        std::cerr << std::format("failed to replace {}: {}\n", path.string(), error.message());
+    }
+}
+
+struct Cull_push_constants{
+    glm::vec4 bounding_sphere_;
+    uint32_t object_count_;
+    uint32_t index_count_;
 };
 
-struct Vertex{
-    glm::vec3 pos_;
-    glm::vec3 color_;
-    glm::vec2 tex_coord_;
+// One indexed draw, a contiguous range of the model's triangles for a range of instances.
+struct Draw_command{
+    uint32_t first_index_;
+    uint32_t index_count_;
+    int32_t vertex_offset_;
+    uint32_t first_instance_;
+    uint32_t instance_count_;
+    // Texture slot sampled by the draw, 0 is the app's texture.
+    uint32_t material_{};
+};
 
-    bool operator==(const Vertex& other) const {
-        return pos_ == other.pos_ && color_ == other.color_ && tex_coord_ == other.tex_coord_;
-    }
+// A texture loaded for a material of the OBJ's material library.
+struct Material_texture{
+    VkImage image_{};
+    Allocation memory_{};
+    VkImageView view_{};
+};
 
-    static VkVertexInputBindingDescription get_binding_description(){
-        VkVertexInputBindingDescription binding_description{};
+// Transfer commands recorded since the last flush and the staging buffers they read from.
+struct Upload_batch{
+    VkCommandBuffer command_buffer_{};
+    VkCommandPool command_pool_{};
+    // Timeline of the queue it was submitted to and the value it signals there.
+    VkSemaphore timeline_{};
+    uint64_t timeline_value_{};
+    // Transfer timeline value this batch acquires resources from, 0 for none.
+    uint64_t wait_transfer_value_{};
+    std::vector<std::pair<VkBuffer, Allocation>> staging_buffers_;
+};
 
-        binding_description.binding = 0;
-        binding_description.stride = sizeof(Vertex);
-        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+// State of a texture uploaded level by level with config_.stream_textures.
+struct Texture_stream{
+    std::future<Mip_chain> loader_;
+    Mip_chain chain_;
+    // Finest level holding texture data; until the first upload only the coarsest level exists, as a placeholder.
+    uint32_t uploaded_level_{};
+    // The view each frame slot's descriptor set points at, and replaced views not yet destroyed.
+    std::vector<VkImageView> frame_views_;
+    std::vector<VkImageView> retired_views_;
+    double decoded_ms_ = -1.0;
+    double resident_ms_ = -1.0;
+    uint64_t resident_frame_{};
+};
 
-        return binding_description;
-    }
-    static std::array<VkVertexInputAttributeDescription, 3> get_attribute_descriptions(){
-        std::array<VkVertexInputAttributeDescription, 3> attributes_description{};
+struct Upload_stats{
+    uint32_t submits_{};
+    // CPU waits for upload completion.
+    uint32_t blocking_waits_{};
+};
 
-        attributes_description[0].binding = 0;
-        attributes_description[0].location = 0;
-        attributes_description[0].format =  VK_FORMAT_R32G32B32_SFLOAT;
-        attributes_description[0].offset = offsetof(Vertex, pos_);
+// Prefix of the pipeline cache file, ties the blob to the exact device and driver build.
+struct Pipeline_cache_file_header{
+    static constexpr uint32_t MAGIC = 0x43505654; // "TVPC"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic_;
+    uint32_t version_;
+    uint32_t vendor_id_;
+    uint32_t device_id_;
+    uint32_t driver_version_;
+    uint8_t pipeline_cache_uuid_[VK_UUID_SIZE];
+    uint64_t data_size_;
+};
+
+// Prefix of a mesh cache file, followed by vertex_count_ vertices and index_count_ uint32 indices.
+struct Mesh_cache_file_header{
+    static constexpr uint32_t MAGIC = 0x434D5654; // "TVMC"
+    static constexpr uint32_t VERSION = 3;
+    // The arrays went through the mesh optimizer.
+    static constexpr uint32_t FLAG_OPTIMIZED = 1;
+    // tinyobj parsed the OBJ. Both parsers fan polygons the same way but may differ on what they accept.
+    static constexpr uint32_t FLAG_TINYOBJ = 2;
+    // obj_parser.h rejected the OBJ and tinyobj parsed it, which either parser setting ends up with.
+    static constexpr uint32_t FLAG_OBJ_PARSER_REJECTED = 4;
+
+    uint32_t magic_;
+    uint32_t version_;
+    // Catches a changed Vertex layout that forgot to bump VERSION.
+    uint32_t vertex_size_;
+    uint32_t index_size_;
+    uint64_t source_hash_;
+    uint32_t flags_;
+    uint32_t reserved_;
+    uint64_t vertex_count_;
+    uint64_t index_count_;
+};
+
+// Prefix of a mip cache file, followed by every level packed like Mip_chain::pixels_.
+struct Mip_cache_file_header{
+    static constexpr uint32_t MAGIC = 0x504D5654; // "TVMP"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic_;
+    uint32_t version_;
+    uint64_t source_hash_;
+    uint32_t width_;
+    uint32_t height_;
+    uint64_t data_size_;
+};
 
-        attributes_description[1].binding = 0;
-        attributes_description[1].location = 1;
-        attributes_description[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributes_description[1].offset = offsetof(Vertex, color_);
+// KTX2 key holding the content hash of the PNG a compressed texture cache was encoded from.
+constexpr const char* KTX2_SOURCE_HASH_KEY = "tinyvk.sourceHash";
 
-        attributes_description[2].binding = 0;
-        attributes_description[2].location = 2;
-        attributes_description[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributes_description[2].offset = offsetof(Vertex, tex_coord_);
+struct Queue_family_indices{
+    std::optional <uint32_t> graphics_family;
+    std::optional<uint32_t> present_family;
+    // Only set for a transfer-only family, optional.
+    std::optional<uint32_t> transfer_family;
 
-        return attributes_description;
+    bool is_complete()const{
+        return graphics_family.has_value() && present_family.has_value();
     }
 };
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos_) ^
-                   (hash<glm::vec3>()(vertex.color_) << 1)) >> 1) ^
-                   (hash<glm::vec2>()(vertex.tex_coord_) << 1);
-        }
-    };
+
+// The bindless fragment shader's material index follows the vertex stage's push constant, see fragment.frag.
+constexpr uint32_t MATERIAL_PUSH_CONSTANT_OFFSET = sizeof(Vertex_dequantization);
+static_assert(MATERIAL_PUSH_CONSTANT_OFFSET == 64);
+
+// Vertex layout of the vertex buffer and the shader variant reading it, picked at build time.
+#if defined(PACKED_VERTEX)
+constexpr bool PACKED_VERTICES = true;
+const std::string VERTEX_SHADER_PATH = "shaders/vert_packed.spv";
+const std::string DEPTH_PREPASS_SHADER_PATH = "shaders/depth_packed.spv";
+#else
+constexpr bool PACKED_VERTICES = false;
+const std::string VERTEX_SHADER_PATH = "shaders/vert.spv";
+const std::string DEPTH_PREPASS_SHADER_PATH = "shaders/depth.spv";
+#endif
+using Gpu_vertex = std::conditional_t<PACKED_VERTICES, Packed_vertex, Vertex>;
+
+// Gribb/Hartmann planes of the clip space volume of matrix (z in [0, 1]), a point p is inside when
+// dot(plane.xyz, p) + plane.w >= 0 for all six. Same planes as cull.comp.
+inline std::array<std::array<float, 4>, 6> frustum_planes(const glm::mat4& matrix){
+    auto row = [&](int i){ return glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]); };
+    std::array<glm::vec4, 6> planes{row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2)};
+    std::array<std::array<float, 4>, 6> result{};
+    for(size_t i = 0; i < planes.size(); i++){
+        result[i] = {planes[i].x, planes[i].y, planes[i].z, planes[i].w};
+    }
+    return result;
 }
 
 struct Uniform_buffer_object{
@@ -125,6 +394,12 @@ struct Uniform_buffer_object{
     alignas(16) glm::mat4 view_;
     alignas(16) glm::mat4 proj_;
 };
+
+// std430 element of the instance storage buffer (binding 2), indexed with gl_InstanceIndex.
+struct Instance_data{
+    alignas(16) glm::mat4 model_;
+    alignas(16) glm::vec4 tint_;
+};
  
 const std::vector<const char*> validation_layer_name_pointers{
     "VK_LAYER_KHRONOS_validation"
@@ -161,20 +436,118 @@ inline void DestroyDebugUtilsMessengerEXT(
 
 class HelloTriangleApp{
     public:
-    HelloTriangleApp(uint32_t width=800,uint32_t height=600,std::string title = "Vulkan"):title_(std::move(title)),width_{width},height_{height}{
-        command_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
-        image_available_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-        render_finish_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-        in_flight_fences_.resize(MAX_FRAMES_IN_FLIGHT);
+    HelloTriangleApp(uint32_t width=800,uint32_t height=600,std::string title = "Vulkan", App_config config = {}):title_(std::move(title)),config_(std::move(config)),width_{width},height_{height}{
+        frames_in_flight_ = std::clamp(config_.frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT);
+        command_buffers_.resize(frames_in_flight_);
+        image_available_semaphores_.resize(frames_in_flight_);
+        render_finish_semaphores_.resize(frames_in_flight_);
+        frame_timeline_values_.resize(frames_in_flight_);
+        pending_frame_dumps_.resize(frames_in_flight_);
+        cull_result_pending_.resize(frames_in_flight_);
+
+        if(config_.headless && config_.frame_count == 0){
+            config_.frame_count = DEFAULT_HEADLESS_FRAME_COUNT;
+        }
+        if(config_.meshlets && config_.instance_count > 1){
+            throw std::invalid_argument{"meshlets are culled for a single instance."};
+        }
+        if(config_.meshlets && config_.static_command_buffers && !config_.gpu_culling){
+            throw std::invalid_argument{"CPU meshlet culling changes the draws every frame, use --gpu-cull with static command buffers."};
+        }
+        if(config_.lods && (config_.meshlets || config_.gpu_culling || config_.static_command_buffers || config_.draw_count > 1)){
+            throw std::invalid_argument{"LODs are selected per frame on the CPU with one draw per LOD, they don't combine with meshlets, GPU culling, static command buffers or split draws."};
+        }
+        if(config_.stream_textures && (config_.static_command_buffers || config_.compressed_textures)){
+            throw std::invalid_argument{"streamed textures are RGBA8 and change their descriptor between frames, they don't combine with compressed textures or static command buffers."};
+        }
+        if(material_draws() && (config_.meshlets || config_.lods || config_.gpu_culling || config_.draw_count > 1 || config_.optimize_mesh
+            || config_.stream_textures)){
+            throw std::invalid_argument{"materials draw one range of triangles per material, they don't combine with meshlets, LODs, GPU culling, split draws, mesh optimization or streamed textures."};
+        }
+        if(config_.materials && config_.synthetic_materials > 0){
+            throw std::invalid_argument{"synthetic materials replace the OBJ's materials."};
+        }
+        if(!config_.headless){
+            device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
     }
 
     ~HelloTriangleApp(){
     }
+    const Frame_profiler& frame_profiler() const{
+        return frame_profiler_;
+    }
+    double mean_visible_objects() const{
+        return cull_stats_.frames_ ? static_cast<double>(cull_stats_.visible_) / cull_stats_.frames_ : 0.0;
+    }
+    // Triangles drawn per frame summed over instances, counted by LOD selection only.
+    double mean_lod_triangles() const{
+        return lod_stats_.frames_ ? static_cast<double>(lod_stats_.triangles_) / lod_stats_.frames_ : 0.0;
+    }
+    Percentiles present_latency() const{
+        return compute_percentiles(present_latencies_ms_);
+    }
+    // Until the image is on screen with present_wait, otherwise until vkQueuePresentKHR returned.
+    std::string_view present_latency_source() const{
+        return present_wait_ ? "present_wait" : "cpu";
+    }
+    // Bytes the vertex fetch of a position-only pass reads per vertex.
+    uint32_t position_fetch_size() const{
+        return config_.split_vertex_streams ? sizeof(Gpu_vertex::pos_) : sizeof(Gpu_vertex);
+    }
+    size_t model_vertex_count() const{
+        return model_vertices_.size();
+    }
+    // Triangles of the full detail model.
+    size_t model_triangle_count() const{
+        return full_detail_index_count() / 3;
+    }
+    VkPresentModeKHR present_mode() const{
+        return present_mode_;
+    }
+    // Milliseconds from run() to the first frame's submission.
+    double first_frame_ms() const{
+        return first_frame_ms_;
+    }
+    // Milliseconds from run() until every texture level was uploaded, negative if streaming never finished.
+    double texture_resident_ms() const{
+        return config_.stream_textures ? texture_stream_.resident_ms_ : first_frame_ms_;
+    }
+    uint64_t texture_resident_frame() const{
+        return config_.stream_textures ? texture_stream_.resident_frame_ : 0;
+    }
+    // Texture slots the draws select from, 0 without materials.
+    size_t material_count() const{
+        return material_views_.size();
+    }
+    size_t draw_command_count() const{
+        return draw_commands_.size();
+    }
+    uint32_t swap_chain_image_count() const{
+        return static_cast<uint32_t>(swap_chain_images_.size());
+    }
     void run(){
-        init_window();
+        if(config_.mesh_load_bench){
+            benchmark_model_loading();
+            return;
+        }
+        if(config_.vertex_format_bench){
+            benchmark_vertex_format();
+            return;
+        }
+        start_time_ = std::chrono::steady_clock::now();
+        if(!config_.headless){
+            init_window();
+        }
         init_vulkan();
 
-        main_loop();
+        if(config_.alloc_bench_count > 0){
+            benchmark_memory_allocation(config_.alloc_bench_count);
+        }else if(config_.record_bench){
+            benchmark_recording();
+        }else{
+            main_loop();
+        }
 
         cleanup();
     }
@@ -196,74 +569,189 @@ class HelloTriangleApp{
         glfwSetFramebufferSizeCallback(window_, framebuffer_resize_callback);
     }
     void init_vulkan(){
+        auto start_time = std::chrono::steady_clock::now();
         create_instance();
         setup_debug_messenger();
 
-        create_surface();
+        if(!config_.headless){
+            create_surface();
+        }
 
         pick_physical_device();
         create_logical_device();
+        allocator_.init(physical_device_, device_);
+        create_timeline_semaphores();
         create_swap_chain();
         create_image_views();
         create_render_pass();
         create_descriptor_set_layout();
+        create_pipeline_cache();
         create_graphics_pipeline();
         create_command_pool();
         create_color_resources();
         create_depth_resource();
         create_frame_buffers();
-        create_texture_image();
+        if(config_.stream_textures){
+            start_texture_stream();
+        }else{
+            create_texture_image();
+        }
         create_texture_image_view();
         create_texture_sampler();
         load_model();
+        compute_model_bounding_sphere();
+        if(config_.meshlets){
+            build_model_meshlets();
+        }
+        if(config_.lods){
+            build_model_lods();
+        }
+        draw_commands_ = material_draws() ? make_material_draws() : split_into_draws(full_detail_index_count(), config_.draw_count, config_.instance_count);
+        if(material_draws()){
+            create_material_textures();
+        }
         create_vertex_buffer();
         create_index_buffer();
         create_uniform_buffers();
+        create_instance_buffers();
         create_descriptor_pool();
         create_descriptor_sets();
+        if(config_.gpu_culling){
+            create_culling_resources();
+        }
         create_command_buffers();
+        create_record_pools();
         create_sync_objects();
+        create_timestamp_query_pool();
+        if(config_.headless && !config_.dump_directory.empty()){
+            create_readback_buffers();
+        }
+        flush_uploads();
+        print_memory_stats();
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("startup: {:.3f} ms, uploads {}: {} submits, {} blocking waits.\n", elapsed,
+            config_.batch_uploads ? "batched" : "per copy", upload_stats_.submits_, upload_stats_.blocking_waits_);
     }
     void main_loop(){
+        if(config_.headless){
+            while(frame_number_ < config_.frame_count){
+                draw_frame();
+            }
+            vkDeviceWaitIdle(device_);
+            write_pending_frame_dumps();
+            report_frame_profile();
+            return;
+        }
+
         while(!glfwWindowShouldClose(window_)){
-            showFPS(window_);
+            show_frame_stats();
             glfwPollEvents();
             draw_frame();
+            if(config_.frame_count && frame_number_ >= config_.frame_count){
+                break;
+            }
         }
         vkDeviceWaitIdle(device_);
+        report_frame_profile();
+    }
+    void report_frame_profile(){
+        // Called after the final wait, the last frames' queries are complete but their slots were never reused.
+        for(uint32_t i = 0; i < gpu_timestamp_frames_.size(); i++){
+            collect_gpu_timestamps((current_frame_ + i) % frames_in_flight_);
+        }
+        frame_profiler_.print_summary(std::cout);
+        if(!config_.headless){
+            poll_present_completion(true);
+            auto latency = present_latency();
+            std::cout << std::format("present: {} with {} images, acquire-to-present ({}) p50 {:.3f} ms, p99 {:.3f} ms.\n",
+                present_mode_name(present_mode_), swap_chain_image_count(), present_latency_source(), latency.p50_, latency.p99_);
+        }
+        if(config_.gpu_culling){
+            std::cout << std::format("gpu culling: {:.1f} of {} objects visible on average.\n", mean_visible_objects(), config_.instance_count);
+        }
+        if(config_.lods){
+            std::cout << std::format("lods: {:.0f} triangles per frame on average, {} at full detail.\n", mean_lod_triangles(),
+                full_detail_index_count() / 3 * static_cast<uint64_t>(config_.instance_count));
+        }
+        if(config_.profile_output.empty()){
+            return;
+        }
+        frame_profiler_.export_csv(config_.profile_output + ".csv");
+        frame_profiler_.export_json(config_.profile_output + ".json");
     }
     void cleanup(){
+        flush_uploads();
+        collect_finished_uploads(true);
         cleanup_swap_chain();
 
+        // The loader reads config_ and the texture file, let it finish before anything goes away.
+        if(texture_stream_.loader_.valid()){
+            texture_stream_.loader_.wait();
+        }
+        for(auto view: texture_stream_.retired_views_){
+            vkDestroyImageView(device_, view, nullptr);
+        }
+        for(auto& texture: material_textures_){
+            vkDestroyImageView(device_, texture.view_, nullptr);
+            vkDestroyImage(device_, texture.image_, nullptr);
+            allocator_.free(texture.memory_);
+        }
         vkDestroySampler(device_, texture_sampler_, nullptr);
         vkDestroyImageView(device_, texture_image_view_, nullptr);
         vkDestroyImage(device_, texture_image_, nullptr);
-        vkFreeMemory(device_, texture_image_memory_, nullptr);
+        allocator_.free(texture_image_memory_);
 
-        for(size_t i = 0 ; i < MAX_FRAMES_IN_FLIGHT; i++){
+        for(size_t i = 0 ; i < frames_in_flight_; i++){
             vkDestroyBuffer(device_, uniform_buffers_[i], nullptr);
-            vkFreeMemory(device_, uniform_buffers_memory_[i], nullptr);
+            allocator_.free(uniform_buffers_memory_[i]);
+            vkDestroyBuffer(device_, instance_buffers_[i], nullptr);
+            allocator_.free(instance_buffers_memory_[i]);
         }
 
         vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
         vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
+        if(config_.gpu_culling){
+            destroy_culling_resources();
+        }
 
         vkDestroyBuffer(device_, index_buffer_, nullptr);
-        vkFreeMemory(device_, index_buffer_memory_, nullptr);
+        allocator_.free(index_buffer_memory_);
         vkDestroyBuffer(device_, vertex_buffer_, nullptr);
-        vkFreeMemory(device_, vertex_buffer_memory_, nullptr);
+        allocator_.free(vertex_buffer_memory_);
+
+        for(size_t i = 0; i < readback_buffers_.size(); i++){
+            vkDestroyBuffer(device_, readback_buffers_[i], nullptr);
+            allocator_.free(readback_buffers_memory_[i]);
+        }
         
-        for(size_t i=0;i<MAX_FRAMES_IN_FLIGHT;i++){
-            vkDestroyFence(device_, in_flight_fences_[i], nullptr);
+        vkDestroySemaphore(device_, graphics_timeline_, nullptr);
+        vkDestroySemaphore(device_, transfer_timeline_, nullptr);
+        for(size_t i=0;i<frames_in_flight_;i++){
             vkDestroySemaphore(device_, render_finish_semaphores_[i], nullptr);
             vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
         }
 
         vkDestroyCommandPool(device_, command_pool_, nullptr);
+        for(auto& pools: record_pools_){
+            for(auto pool: pools){
+                vkDestroyCommandPool(device_, pool, nullptr);
+            }
+        }
+        if(transfer_command_pool_){
+            vkDestroyCommandPool(device_, transfer_command_pool_, nullptr);
+        }
+        vkDestroyQueryPool(device_, timestamp_query_pool_, nullptr);
 
         vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
+        if(depth_prepass_pipeline_){
+            vkDestroyPipeline(device_, depth_prepass_pipeline_, nullptr);
+        }
         vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+        save_pipeline_cache();
+        vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
         vkDestroyRenderPass(device_, render_pass_, nullptr);
+        allocator_.destroy();
         vkDestroyDevice(device_,nullptr);
 
         if constexpr (ENABLE_VALIDATION_LAYERS){
@@ -279,10 +767,24 @@ class HelloTriangleApp{
             vkDestroyInstance(instance_,nullptr);
             instance_ = nullptr;
         }
-        glfwTerminate();
+        if(!config_.headless){
+            glfwTerminate();
+        }
     }
 
     std::vector<const char*> get_required_extensions(){
+        if(config_.headless){
+            // No surface, so no window system extensions.
+            std::vector<const char*> extensions;
+            if constexpr(ENABLE_VALIDATION_LAYERS){
+                extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            }
+            #ifdef __APPLE__
+                extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+            #endif
+            return extensions;
+        }
+
         uint32_t glfw_extensions_count {};
         const char**  glfw_exntensions = glfwGetRequiredInstanceExtensions(&glfw_extensions_count);
         if(glfw_exntensions == nullptr){
@@ -314,7 +816,7 @@ class HelloTriangleApp{
         app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         app_info.pEngineName = "Void Engine";
         app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_0;
+        app_info.apiVersion = VK_API_VERSION_1_2;
 
         VkInstanceCreateInfo create_info {};
         create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -457,6 +959,9 @@ class HelloTriangleApp{
             indices.graphics_family.value(),
             indices.present_family.value()
         };
+        if(indices.transfer_family){
+            unique_queue_families.insert(*indices.transfer_family);
+        }
         for(auto queue_family: unique_queue_families){
             VkDeviceQueueCreateInfo  queue_create_info{};
             queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -468,6 +973,15 @@ class HelloTriangleApp{
 
         VkPhysicalDeviceFeatures device_features{};
         device_features.samplerAnisotropy = VK_TRUE;
+        if(config_.gpu_culling){
+            enable_culling_features(device_features);
+        }
+        if(config_.compressed_textures){
+            VkPhysicalDeviceFeatures supported{};
+            vkGetPhysicalDeviceFeatures(physical_device_, &supported);
+            device_features.textureCompressionBC = supported.textureCompressionBC;
+            texture_compression_bc_ = supported.textureCompressionBC;
+        }
 
 
         VkDeviceCreateInfo create_info{};
@@ -481,12 +995,49 @@ class HelloTriangleApp{
 
         create_info.pEnabledFeatures = & device_features;
 
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore = VK_TRUE;
+        create_info.pNext = &features12;
+        if(config_.bindless_materials){
+            enable_bindless_features(device_features, features12);
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+        present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+        present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        if(!config_.headless && supports_present_wait()){
+            device_extensions_.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            device_extensions_.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            create_info.enabledExtensionCount = device_extensions_.size();
+            create_info.ppEnabledExtensionNames = device_extensions_.data();
+            present_id_features.presentId = VK_TRUE;
+            present_wait_features.presentWait = VK_TRUE;
+            present_id_features.pNext = &present_wait_features;
+            features12.pNext = &present_id_features;
+            present_wait_ = true;
+        }
+
         if(vkCreateDevice(physical_device_,&create_info,nullptr,&device_) != VK_SUCCESS){
             throw  std::runtime_error {"failed to create logical device."};
         }
 
         vkGetDeviceQueue(device_, indices.graphics_family.value(), 0,&graphics_queue_);
         vkGetDeviceQueue(device_, indices.present_family.value(), 0,&present_queue_);
+        if(indices.transfer_family){
+            vkGetDeviceQueue(device_, *indices.transfer_family, 0, &transfer_queue_);
+        }
+        queue_family_indices_ = indices;
+        if(present_wait_){
+            wait_for_present_ = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device_, "vkWaitForPresentKHR"));
+        }
+        if(config_.gpu_culling && std::find_if(device_extensions_.begin(), device_extensions_.end(), [](const char* name){
+            return std::string_view{name} == VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME; }) != device_extensions_.end()){
+            cmd_draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(device_, "vkCmdDrawIndexedIndirectCountKHR"));
+        }
+        std::cout << std::format("uploads run on the {} queue.\n", use_transfer_queue() ? "dedicated transfer" : "graphics");
 
     }
 
@@ -498,14 +1049,25 @@ class HelloTriangleApp{
         vkGetPhysicalDeviceFeatures(device,&device_feature);
 
         const bool extensions_supported = check_extension_support(device);
-        bool swap_chain_adequate {false};
+        bool swap_chain_adequate {config_.headless};
 
-        if(extensions_supported){
+        if(extensions_supported && !config_.headless){
             auto swap_chain_support = query_swap_chain_details(device);
             swap_chain_adequate = !swap_chain_support.formats_.empty() && ! swap_chain_support.present_modes_.empty();
         }
 
-        return find_queue_families(device).is_complete() && extensions_supported && swap_chain_adequate && device_feature.samplerAnisotropy;
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features12;
+        const bool vulkan_1_2 = device_properties.apiVersion >= VK_API_VERSION_1_2;
+        if(vulkan_1_2){
+            vkGetPhysicalDeviceFeatures2(device, &features2);
+        }
+
+        return find_queue_families(device).is_complete() && extensions_supported && swap_chain_adequate && device_feature.samplerAnisotropy &&
+            vulkan_1_2 && features12.timelineSemaphore;
     }
 
     Queue_family_indices find_queue_families(VkPhysicalDevice device){
@@ -521,11 +1083,16 @@ class HelloTriangleApp{
             if(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT){
                     indices.graphics_family = i;
             }
+            if(config_.headless){
+                // Nothing is presented, the graphics queue stands in for the present queue.
+                indices.present_family = indices.graphics_family;
+            }else{
                 VkBool32 present_support = false;
                 vkGetPhysicalDeviceSurfaceSupportKHR(device,i,surface_,& present_support);
                 if(present_support){
                     indices.present_family = i;
                 }
+            }
 
             if(indices.is_complete()){
                 break;
@@ -533,6 +1100,15 @@ class HelloTriangleApp{
             i++;
         }
 
+        // Transfer-only families map to the copy engines, which run beside the graphics queue.
+        for(uint32_t i = 0; config_.async_transfer && i < queue_families.size(); i++){
+            auto flags = queue_families[i].queueFlags;
+            if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))){
+                indices.transfer_family = i;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -542,6 +1118,72 @@ class HelloTriangleApp{
         }
     }
 
+    bool device_supports_extension(VkPhysicalDevice device, std::string_view name){
+        uint32_t extension_count{};
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> available_extensions(extension_count);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+        return std::any_of(available_extensions.begin(), available_extensions.end(), [&](const auto& extension){
+            return name == extension.extensionName;
+        });
+    }
+
+    bool supports_present_wait(){
+        if(!device_supports_extension(physical_device_, VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+            !device_supports_extension(physical_device_, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)){
+            return false;
+        }
+        VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+        present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+        present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        present_id_features.pNext = &present_wait_features;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &present_id_features;
+        vkGetPhysicalDeviceFeatures2(physical_device_, &features2);
+        return present_id_features.presentId && present_wait_features.presentWait;
+    }
+
+    // firstInstance carries the object index, the rest only decides how the draws are issued.
+    void enable_culling_features(VkPhysicalDeviceFeatures& device_features){
+        VkPhysicalDeviceFeatures supported{};
+        vkGetPhysicalDeviceFeatures(physical_device_, &supported);
+        if(!supported.drawIndirectFirstInstance){
+            throw std::runtime_error{"gpu culling needs the drawIndirectFirstInstance feature."};
+        }
+        device_features.drawIndirectFirstInstance = VK_TRUE;
+        device_features.multiDrawIndirect = supported.multiDrawIndirect;
+        multi_draw_indirect_ = supported.multiDrawIndirect;
+        if(device_supports_extension(physical_device_, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)){
+            device_extensions_.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+    }
+
+    // Descriptor indexing is core in Vulkan 1.2: a runtime sized texture array, partially written and indexed
+    // with a push constant.
+    void enable_bindless_features(VkPhysicalDeviceFeatures& device_features, VkPhysicalDeviceVulkan12Features& features12){
+        VkPhysicalDeviceVulkan12Features supported12{};
+        supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supported{};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &supported12;
+        vkGetPhysicalDeviceFeatures2(physical_device_, &supported);
+        if(!supported.features.shaderSampledImageArrayDynamicIndexing || !supported12.runtimeDescriptorArray || !supported12.descriptorBindingPartiallyBound){
+            throw std::runtime_error{"bindless materials need shaderSampledImageArrayDynamicIndexing, runtimeDescriptorArray and descriptorBindingPartiallyBound."};
+        }
+        device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+
+        // The fragment stage also has binding 1 and the color attachment.
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+        const auto& limits = properties.limits;
+        material_capacity_ = std::min({MAX_BINDLESS_MATERIALS, limits.maxPerStageDescriptorSamplers - 1, limits.maxPerStageDescriptorSampledImages - 1,
+            limits.maxDescriptorSetSamplers - 1, limits.maxDescriptorSetSampledImages - 1, limits.maxPerStageResources - 2});
+    }
+
     bool check_extension_support(VkPhysicalDevice device){
         uint32_t extension_count{};
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
@@ -589,15 +1231,29 @@ class HelloTriangleApp{
         return available_formats.front();
     }
 
+    // MAILBOX is known as triple buffering, IMMEDIATE tears but has the lowest latency.
     VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes){
         for(auto& available_present_mode:available_present_modes){
-            if(available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR){ // Known as triple buffering.
+            if(available_present_mode == config_.present_mode){
                 return available_present_mode;
             }
         }
 
+        if(config_.present_mode != VK_PRESENT_MODE_FIFO_KHR){
+            std::cout << std::format("present mode {} not supported, using fifo.\n", present_mode_name(config_.present_mode));
+        }
         return VK_PRESENT_MODE_FIFO_KHR; // Guaranteed to be available.
     }
+
+    uint32_t choose_swap_image_count(const VkSurfaceCapabilitiesKHR& capabilities){
+        // Additional one to avoid wait on the driver to complete internal operations before we can accquire another image to render to.
+        uint32_t image_count = config_.swap_chain_image_count ? config_.swap_chain_image_count : capabilities.minImageCount + 1;
+        image_count = std::max(image_count, capabilities.minImageCount);
+        if(capabilities.maxImageCount > 0){ // 0 means no limit.
+            image_count = std::min(image_count, capabilities.maxImageCount);
+        }
+        return image_count;
+    }
     VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities){
         if(capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()){
             return capabilities.currentExtent;
@@ -622,11 +1278,11 @@ class HelloTriangleApp{
     void cleanup_swap_chain(){
         vkDestroyImageView(device_, color_image_view_, nullptr);
         vkDestroyImage(device_, color_image_, nullptr);
-        vkFreeMemory(device_, color_image_memory_, nullptr);
+        allocator_.free(color_image_memory_);
 
         vkDestroyImageView(device_, depth_image_view_, nullptr);
         vkDestroyImage(device_, depth_image_, nullptr);
-        vkFreeMemory(device_, depth_image_memory_, nullptr);
+        allocator_.free(depth_image_memory_);
 
         for(size_t i = 0; i < swap_chain_frame_buffers_.size();i++){
             vkDestroyFramebuffer(device_, swap_chain_frame_buffers_[i], nullptr);
@@ -635,17 +1291,45 @@ class HelloTriangleApp{
         for(size_t i = 0; i < swap_chain_image_views_.size(); i++){
             vkDestroyImageView(device_, swap_chain_image_views_[i], nullptr);
         }
+        if(config_.headless){
+            for(size_t i = 0; i < swap_chain_images_.size(); i++){
+                vkDestroyImage(device_, swap_chain_images_[i], nullptr);
+                allocator_.free(offscreen_images_memory_[i]);
+            }
+            return;
+        }
+        // Present ids belong to the old swap chain.
+        pending_presents_.clear();
         vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
     }
 
+    // Headless stand-in for the swap chain: one resolve target per frame in flight.
+    void create_offscreen_images(){
+        swap_chain_image_format_ = find_supported_format(
+            {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB},
+            VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+        swap_chain_extent_ = {width_, height_};
+
+        swap_chain_images_.resize(frames_in_flight_);
+        offscreen_images_memory_.resize(frames_in_flight_);
+        for(size_t i = 0; i < swap_chain_images_.size(); i++){
+            create_image(swap_chain_extent_.width, swap_chain_extent_.height, 1, VK_SAMPLE_COUNT_1_BIT, swap_chain_image_format_, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swap_chain_images_[i], offscreen_images_memory_[i]);
+        }
+    }
+
     void create_swap_chain(){
+        if(config_.headless){
+            create_offscreen_images();
+            return;
+        }
         auto swap_chain_support = query_swap_chain_details(physical_device_);
 
         auto surface_format = choose_swap_surface_format(swap_chain_support.formats_);
         auto present_mode = choose_swap_present_mode(swap_chain_support.present_modes_);
         auto extent = choose_swap_extent(swap_chain_support.capabilities_);
+        present_mode_ = present_mode;
 
-        uint32_t image_count = swap_chain_support.capabilities_.minImageCount + 1; // Additional one to avoid wait on the driver to complete internal operations before we can accquire another image to render to.
+        uint32_t image_count = choose_swap_image_count(swap_chain_support.capabilities_);
 
         VkSwapchainCreateInfoKHR create_info{};
         // fill create info for create swap chain.
@@ -715,6 +1399,7 @@ class HelloTriangleApp{
         create_color_resources();
         create_depth_resource();
         create_frame_buffers();
+        mark_scene_dirty();
     }
 
     void create_image_views(){
@@ -725,8 +1410,8 @@ class HelloTriangleApp{
         }
     }
     void create_graphics_pipeline(){
-        auto vert_shader_code = read_file("shaders/vert.spv");
-        auto frag_shader_code = read_file("shaders/frag.spv");
+        auto vert_shader_code = read_file(VERTEX_SHADER_PATH);
+        auto frag_shader_code = read_file(config_.bindless_materials ? "shaders/frag_bindless.spv" : "shaders/frag.spv");
 
         auto vert_shader_module = create_shader_module(vert_shader_code);
         auto frag_shader_module = create_shader_module(frag_shader_code);
@@ -765,13 +1450,12 @@ class HelloTriangleApp{
         VkPipelineVertexInputStateCreateInfo vertex_input_info{};
         vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
         
-        auto binding_description = Vertex::get_binding_description();
-        auto attribute_descriptions = Vertex::get_attribute_descriptions();
+        auto input_layout = Gpu_vertex::get_input_layout(config_.split_vertex_streams, false);
 
-        vertex_input_info.vertexBindingDescriptionCount = 1;
-        vertex_input_info.pVertexBindingDescriptions = &binding_description;
-        vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-        vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
+        vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(input_layout.bindings_.size());
+        vertex_input_info.pVertexBindingDescriptions = input_layout.bindings_.data();
+        vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(input_layout.attributes_.size());
+        vertex_input_info.pVertexAttributeDescriptions = input_layout.attributes_.data();
 
         VkPipelineInputAssemblyStateCreateInfo input_assembly{};
         input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -802,8 +1486,9 @@ class HelloTriangleApp{
         VkPipelineDepthStencilStateCreateInfo depth_stencil{};
         depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
         depth_stencil.depthTestEnable = VK_TRUE;
-        depth_stencil.depthWriteEnable = VK_TRUE;
-        depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        // After a prepass the depth is final, the shaded pass only tests against it.
+        depth_stencil.depthWriteEnable = config_.depth_prepass ? VK_FALSE : VK_TRUE;
+        depth_stencil.depthCompareOp = config_.depth_prepass ? VK_COMPARE_OP_LESS_OR_EQUAL : VK_COMPARE_OP_LESS;
         
         depth_stencil.depthBoundsTestEnable = VK_FALSE;
         depth_stencil.minDepthBounds = 0.0f;
@@ -871,12 +1556,20 @@ class HelloTriangleApp{
         color_blending.pAttachments = &color_blend_attachment;
         
         // Pipeline layout
+        std::vector<VkPushConstantRange> push_constant_ranges;
+        if constexpr(PACKED_VERTICES){
+            push_constant_ranges.push_back({VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Vertex_dequantization)});
+        }
+        if(config_.bindless_materials){
+            push_constant_ranges.push_back({VK_SHADER_STAGE_FRAGMENT_BIT, MATERIAL_PUSH_CONSTANT_OFFSET, sizeof(uint32_t)});
+        }
+
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipeline_layout_info.setLayoutCount = 1;
         pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
-        pipeline_layout_info.pushConstantRangeCount = 0;
-        pipeline_layout_info.pPushConstantRanges = nullptr;
+        pipeline_layout_info.pushConstantRangeCount = static_cast<uint32_t>(push_constant_ranges.size());
+        pipeline_layout_info.pPushConstantRanges = push_constant_ranges.empty() ? nullptr : push_constant_ranges.data();
 
         if(vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_)!=VK_SUCCESS){
             throw std::runtime_error{"failed to create pipeline layout"};
@@ -904,12 +1597,122 @@ class HelloTriangleApp{
         pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
         pipeline_info.basePipelineIndex = -1;
 
-        if(vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline_) != VK_SUCCESS){
+        auto start_time = std::chrono::steady_clock::now();
+        if(vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_info, nullptr, &graphics_pipeline_) != VK_SUCCESS){
             throw std::runtime_error{"failed to create graphics pipeline."};
         }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("graphics pipeline created in {:.3f} ms ({} pipeline cache).\n", elapsed, pipeline_cache_loaded_ ? "warm" : "cold");
         
         vkDestroyShaderModule(device_, vert_shader_module, nullptr);
         vkDestroyShaderModule(device_, frag_shader_module, nullptr);
+
+        if(config_.depth_prepass){
+            // Same state with only the position stream, no fragment shader and no color writes.
+            auto depth_shader_module = create_shader_module(read_file(DEPTH_PREPASS_SHADER_PATH));
+            vert_shader_create_info.module = depth_shader_module;
+            auto depth_input_layout = Gpu_vertex::get_input_layout(config_.split_vertex_streams, true);
+            vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(depth_input_layout.bindings_.size());
+            vertex_input_info.pVertexBindingDescriptions = depth_input_layout.bindings_.data();
+            vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(depth_input_layout.attributes_.size());
+            vertex_input_info.pVertexAttributeDescriptions = depth_input_layout.attributes_.data();
+            depth_stencil.depthWriteEnable = VK_TRUE;
+            depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+            color_blend_attachment.colorWriteMask = 0;
+            pipeline_info.stageCount = 1;
+            pipeline_info.pStages = &vert_shader_create_info;
+            if(vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_info, nullptr, &depth_prepass_pipeline_) != VK_SUCCESS){
+                throw std::runtime_error{"failed to create depth prepass pipeline."};
+            }
+            vkDestroyShaderModule(device_, depth_shader_module, nullptr);
+        }
+    }
+
+    // Returns the cached blob, or nothing if it is missing or was produced by another device/driver.
+    std::vector<char> load_pipeline_cache_data(const VkPhysicalDeviceProperties& properties){
+        if(config_.pipeline_cache_path.empty() || !std::filesystem::exists(config_.pipeline_cache_path)){
+            return {};
+        }
+        auto file = read_file(config_.pipeline_cache_path);
+
+        Pipeline_cache_file_header header{};
+        if(file.size() < sizeof(header)){
+            std::cout << "pipeline cache: file too small, ignored.\n";
+            return {};
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if(header.magic_ != Pipeline_cache_file_header::MAGIC || header.version_ != Pipeline_cache_file_header::VERSION ||
+            header.data_size_ != file.size() - sizeof(header)){
+            std::cout << "pipeline cache: unknown or truncated file, ignored.\n";
+            return {};
+        }
+        if(header.vendor_id_ != properties.vendorID || header.device_id_ != properties.deviceID ||
+            header.driver_version_ != properties.driverVersion ||
+            memcmp(header.pipeline_cache_uuid_, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0){
+            std::cout << "pipeline cache: written by another device or driver, ignored.\n";
+            return {};
+        }
+
+        std::vector<char> data(file.begin() + sizeof(header), file.end());
+
+        // The driver validates its own header too, but a mismatch there may just be silently ignored.
+        VkPipelineCacheHeaderVersionOne vk_header{};
+        if(data.size() < sizeof(vk_header)){
+            return {};
+        }
+        memcpy(&vk_header, data.data(), sizeof(vk_header));
+        if(vk_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || vk_header.vendorID != properties.vendorID ||
+            vk_header.deviceID != properties.deviceID ||
+            memcmp(vk_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0){
+            std::cout << "pipeline cache: driver header mismatch, ignored.\n";
+            return {};
+        }
+        return data;
+    }
+
+    void create_pipeline_cache(){
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+        auto data = load_pipeline_cache_data(properties);
+        pipeline_cache_loaded_ = !data.empty();
+
+        VkPipelineCacheCreateInfo cache_info{};
+        cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cache_info.initialDataSize = data.size();
+        cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+        if(vkCreatePipelineCache(device_, &cache_info, nullptr, &pipeline_cache_) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create pipeline cache."};
+        }
+    }
+
+    void save_pipeline_cache(){
+        if(config_.pipeline_cache_path.empty() || !pipeline_cache_){
+            return;
+        }
+        size_t size{};
+        vkGetPipelineCacheData(device_, pipeline_cache_, &size, nullptr);
+        std::vector<char> data(size);
+        if(vkGetPipelineCacheData(device_, pipeline_cache_, &size, data.data()) != VK_SUCCESS){
+            std::cerr << "failed to read pipeline cache data.\n";
+            return;
+        }
+        data.resize(size);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+        Pipeline_cache_file_header header{};
+        header.magic_ = Pipeline_cache_file_header::MAGIC;
+        header.version_ = Pipeline_cache_file_header::VERSION;
+        header.vendor_id_ = properties.vendorID;
+        header.device_id_ = properties.deviceID;
+        header.driver_version_ = properties.driverVersion;
+        memcpy(header.pipeline_cache_uuid_, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.data_size_ = data.size();
+
+        write_file_atomically(config_.pipeline_cache_path, {std::as_bytes(std::span{&header, 1}), std::as_bytes(std::span{data})});
     }
 
     void create_render_pass(){
@@ -954,7 +1757,7 @@ class HelloTriangleApp{
         color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment_resolve.finalLayout = config_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference color_attachment_resolve_ref{};
         color_attachment_resolve_ref.attachment = 2;
@@ -1034,6 +1837,14 @@ class HelloTriangleApp{
         if(vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_)!=VK_SUCCESS){
             throw std::runtime_error{"failed to create command pool."};
         }
+
+        if(queue_family_indices.transfer_family){
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            pool_info.queueFamilyIndex = *queue_family_indices.transfer_family;
+            if(vkCreateCommandPool(device_, &pool_info, nullptr, &transfer_command_pool_) != VK_SUCCESS){
+                throw std::runtime_error{"failed to create transfer command pool."};
+            }
+        }
     }
     void create_command_buffers(){
         VkCommandBufferAllocateInfo alloc_info{};
@@ -1047,7 +1858,7 @@ class HelloTriangleApp{
         }
     }
 
-    void record_command_buffer(VkCommandBuffer command_buffer,uint32_t image_index){
+    void record_command_buffer(VkCommandBuffer command_buffer,uint32_t image_index, uint32_t frame, uint32_t record_threads = 0){
         VkCommandBufferBeginInfo begin_info{};
         begin_info.sType =VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         begin_info.flags = 0;
@@ -1057,6 +1868,16 @@ class HelloTriangleApp{
             throw std::runtime_error{"failed to begin record commmand buffer."};
         }
 
+        const uint32_t first_query = frame * TIMESTAMPS_PER_FRAME;
+        if(timestamp_query_pool_){
+            vkCmdResetQueryPool(command_buffer, timestamp_query_pool_, first_query, TIMESTAMPS_PER_FRAME);
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool_, first_query);
+        }
+
+
+        if(config_.gpu_culling){
+            record_culling(command_buffer, frame);
+        }
 
         // Starting a render pass
         VkRenderPassBeginInfo render_pass_info{};
@@ -1073,11 +1894,32 @@ class HelloTriangleApp{
         render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
         render_pass_info.pClearValues = clear_values.data();
 
-        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        // Culling leaves a single indirect draw, nothing to spread over threads.
+        if(record_threads > 0 && !config_.gpu_culling){
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            auto secondaries = record_secondary_command_buffers(image_index, frame, record_threads);
+            vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+        }else{
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+            record_draws(command_buffer, frame, 0, draw_commands_.size());
+        }
 
-        // Basic drawing commands
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+        // Finishing up
+        vkCmdEndRenderPass(command_buffer);
+        if(timestamp_query_pool_){
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool_, first_query + 1);
+        }
+        if(pending_frame_dumps_[frame]){
+            record_frame_readback(command_buffer, image_index);
+        }
+        if(vkEndCommandBuffer(command_buffer)!=VK_SUCCESS){
+            throw  std::runtime_error{"failed to record command buffer."};
+        }
+    }
 
+    // Draws draw_commands_[first, last) with all the state they need, usable inline or in a secondary buffer.
+    // With a prepass every range lays down its own depth first, ranges recorded on other threads stay correct.
+    void record_draws(VkCommandBuffer command_buffer, uint32_t frame, size_t first, size_t last){
         VkViewport viewport{};
         viewport.x = 0;
         viewport.y = 0;
@@ -1092,72 +1934,316 @@ class HelloTriangleApp{
         scissor.extent = swap_chain_extent_;
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
-        
-        VkBuffer vertex_buffers[] = {vertex_buffer_};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-
         vkCmdBindIndexBuffer(command_buffer, index_buffer_, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_sets_[current_frame_], 0, nullptr);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_sets_[frame], 0, nullptr);
+        if constexpr(PACKED_VERTICES){
+            vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Vertex_dequantization), &vertex_dequantization_);
+        }
 
-        vkCmdDrawIndexed(command_buffer, static_cast<uint32_t>(indices_.size()), 1, 0, 0, 0);
+        auto draw_all = [&]{
+            if(config_.gpu_culling){
+                record_indirect_draws(command_buffer, frame);
+                return;
+            }
+            for(size_t i = first; i < last; i++){
+                const auto& draw = draw_commands_[i];
+                vkCmdDrawIndexed(command_buffer, draw.index_count_, draw.instance_count_, draw.first_index_, draw.vertex_offset_, draw.first_instance_);
+            }
+        };
+        if(config_.depth_prepass){
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depth_prepass_pipeline_);
+            bind_vertex_streams(command_buffer, true);
+            draw_all();
+        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+        bind_vertex_streams(command_buffer, false);
+        if(material_draws()){
+            record_material_draws(command_buffer, frame, first, last);
+            return;
+        }
+        draw_all();
+    }
 
-        // Finishing up
-        vkCmdEndRenderPass(command_buffer);
-        if(vkEndCommandBuffer(command_buffer)!=VK_SUCCESS){
-            throw  std::runtime_error{"failed to record command buffer."};
+    // The shaded pass of a material list, which changes the material only between draws that differ. The set
+    // bound above is material 0's, the bindless index is always pushed once since nothing set it yet.
+    void record_material_draws(VkCommandBuffer command_buffer, uint32_t frame, size_t first, size_t last){
+        uint32_t material = config_.bindless_materials ? UINT32_MAX : 0;
+        for(size_t i = first; i < last; i++){
+            const auto& draw = draw_commands_[i];
+            if(draw.material_ != material){
+                material = draw.material_;
+                if(config_.bindless_materials){
+                    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_FRAGMENT_BIT, MATERIAL_PUSH_CONSTANT_OFFSET, sizeof(material), &material);
+                }else{
+                    auto set = material_descriptor_sets_[frame * material_views_.size() + material];
+                    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &set, 0, nullptr);
+                }
+            }
+            vkCmdDrawIndexed(command_buffer, draw.index_count_, draw.instance_count_, draw.first_index_, draw.vertex_offset_, draw.first_instance_);
         }
     }
 
-    void draw_frame(){
-        vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+    // Position-only passes bind just the position stream, with interleaved vertices that is the whole buffer.
+    void bind_vertex_streams(VkCommandBuffer command_buffer, bool position_only){
+        VkBuffer vertex_buffers[] = {vertex_buffer_, vertex_buffer_};
+        VkDeviceSize offsets[] = {0, vertex_attribute_offset_};
+        uint32_t stream_count = config_.split_vertex_streams && !position_only ? 2 : 1;
+        vkCmdBindVertexBuffers(command_buffer, 0, stream_count, vertex_buffers, offsets);
+    }
 
-        uint32_t image_index{};
-        VkResult result =  vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+    // Each thread resets its own pool and records an even slice of the draw list.
+    std::span<VkCommandBuffer> record_secondary_command_buffers(uint32_t image_index, uint32_t frame, uint32_t thread_count){
+        auto& buffers = secondary_command_buffers_[frame];
+        thread_count = std::min<uint32_t>(thread_count, static_cast<uint32_t>(buffers.size()));
+
+        worker_pool_->parallel_for(thread_count, [&](size_t thread){
+            vkResetCommandPool(device_, record_pools_[frame][thread], 0);
+
+            VkCommandBufferInheritanceInfo inheritance_info{};
+            inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance_info.renderPass = render_pass_;
+            inheritance_info.subpass = 0;
+            inheritance_info.framebuffer = swap_chain_frame_buffers_[image_index];
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            begin_info.pInheritanceInfo = &inheritance_info;
+            if(vkBeginCommandBuffer(buffers[thread], &begin_info) != VK_SUCCESS){
+                throw std::runtime_error{"failed to begin secondary command buffer."};
+            }
 
-        if(result == VK_ERROR_OUT_OF_DATE_KHR){
-            recreate_swap_chain();
+            auto first = draw_commands_.size() * thread / thread_count;
+            auto last = draw_commands_.size() * (thread + 1) / thread_count;
+            record_draws(buffers[thread], frame, first, last);
+
+            if(vkEndCommandBuffer(buffers[thread]) != VK_SUCCESS){
+                throw std::runtime_error{"failed to record secondary command buffer."};
+            }
+        });
+        return {buffers.data(), thread_count};
+    }
+
+    // Per frame slot and thread: a transient pool with one secondary buffer, pools are never shared between threads.
+    void create_record_pools(){
+        uint32_t thread_count = config_.record_threads;
+        if(config_.record_bench){
+            thread_count = std::max(thread_count, std::max(1u, std::thread::hardware_concurrency()));
+        }
+        if(thread_count == 0){
             return;
-        }else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR){
-            throw std::runtime_error{"failed to acquire swap chain image."};
         }
+        worker_pool_ = std::make_unique<Worker_pool>(thread_count);
+
+        record_pools_.resize(frames_in_flight_);
+        secondary_command_buffers_.resize(frames_in_flight_);
+        for(size_t frame = 0; frame < frames_in_flight_; frame++){
+            record_pools_[frame].resize(thread_count);
+            secondary_command_buffers_[frame].resize(thread_count);
+            for(uint32_t thread = 0; thread < thread_count; thread++){
+                VkCommandPoolCreateInfo pool_info{};
+                pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                pool_info.queueFamilyIndex = queue_family_indices_.graphics_family.value();
+                if(vkCreateCommandPool(device_, &pool_info, nullptr, &record_pools_[frame][thread]) != VK_SUCCESS){
+                    throw std::runtime_error{"failed to create record command pool."};
+                }
 
-        vkResetFences(device_, 1, &in_flight_fences_[current_frame_]);
+                VkCommandBufferAllocateInfo alloc_info{};
+                alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                alloc_info.commandPool = record_pools_[frame][thread];
+                alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                alloc_info.commandBufferCount = 1;
+                if(vkAllocateCommandBuffers(device_, &alloc_info, &secondary_command_buffers_[frame][thread]) != VK_SUCCESS){
+                    throw std::runtime_error{"failed to allocate secondary command buffer."};
+                }
+            }
+        }
+    }
 
-        // call before submitting next frame.
-        update_uniform_buffer(current_frame_);
+    static std::vector<Draw_command> split_into_draws(size_t index_count, uint32_t draw_count, uint32_t instance_count){
+        auto triangle_count = index_count / 3;
+        draw_count = std::max<uint32_t>(1, static_cast<uint32_t>(std::min<size_t>(draw_count, triangle_count)));
+        std::vector<Draw_command> draws(draw_count);
+        for(uint32_t i = 0; i < draw_count; i++){
+            auto first = triangle_count * i / draw_count;
+            auto last = triangle_count * (i + 1) / draw_count;
+            draws[i] = {static_cast<uint32_t>(first * 3), static_cast<uint32_t>((last - first) * 3), 0, 0, instance_count};
+        }
+        return draws;
+    }
 
-        // record commands.
-        vkResetCommandBuffer(command_buffers_[current_frame_], 0);
-        record_command_buffer(command_buffers_[current_frame_], image_index);
-        
-        // submit commands.
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // Records frame 0 into a primary buffer repeatedly, nothing is submitted.
+    void benchmark_recording(){
+        constexpr int ITERATIONS = 20;
+        auto saved_draws = std::move(draw_commands_);
+        std::vector<uint32_t> thread_counts{0};
+        for(uint32_t threads = 1; threads <= worker_pool_->size(); threads *= 2){
+            thread_counts.push_back(threads);
+        }
 
-        VkSemaphore wait_semaphores [] = {image_available_semaphores_[current_frame_]};
-        VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submit_info.waitSemaphoreCount = 1;
+        std::cout << std::format("{:>8} {:>8} {:>12}\n", "draws", "threads", "record (ms)");
+        for(uint32_t draws: {100u, 1000u, 10000u, 100000u}){
+            draw_commands_ = split_into_draws(full_detail_index_count(), draws, config_.instance_count);
+            for(auto threads: thread_counts){
+                auto start_time = std::chrono::steady_clock::now();
+                for(int i = 0; i < ITERATIONS; i++){
+                    vkResetCommandBuffer(command_buffers_[0], 0);
+                    record_command_buffer(command_buffers_[0], 0, 0, threads);
+                }
+                auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+                std::cout << std::format("{:>8} {:>8} {:>12.3f}\n", draw_commands_.size(), threads == 0 ? "inline" : std::to_string(threads), elapsed / ITERATIONS);
+            }
+        }
+        draw_commands_ = std::move(saved_draws);
+    }
+
+    // One command buffer per (frame slot, swap chain image), only the uniform buffers change between frames.
+    void record_static_command_buffers(){
+        if(!static_command_buffers_.empty()){
+            vkFreeCommandBuffers(device_, command_pool_, static_cast<uint32_t>(static_command_buffers_.size()), static_command_buffers_.data());
+        }
+        static_command_buffers_.resize(frames_in_flight_ * swap_chain_images_.size());
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = command_pool_;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = static_cast<uint32_t>(static_command_buffers_.size());
+        if(vkAllocateCommandBuffers(device_, &alloc_info, static_command_buffers_.data()) != VK_SUCCESS){
+            throw std::runtime_error{"failed to allocate static command buffers."};
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        for(uint32_t frame = 0; frame < frames_in_flight_; frame++){
+            for(uint32_t image = 0; image < swap_chain_images_.size(); image++){
+                record_command_buffer(static_command_buffers_[static_command_buffer_index(frame, image)], image, frame);
+            }
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("recorded {} static command buffers in {:.3f} ms, {:.3f} us of recording saved per frame.\n",
+            static_command_buffers_.size(), elapsed, elapsed * 1000.0 / static_command_buffers_.size());
+        static_command_buffers_dirty_ = false;
+    }
+
+    size_t static_command_buffer_index(uint32_t frame, uint32_t image_index) const{
+        return frame * swap_chain_images_.size() + image_index;
+    }
+
+    // Call when anything recorded into the command buffers changes, they are re-recorded before the next frame.
+    void mark_scene_dirty(){
+        static_command_buffers_dirty_ = true;
+    }
+
+    void draw_frame(){
+        frame_profiler_.begin_frame();
+        // The slot's resources are free once its last submission reached the timeline.
+        wait_timeline(graphics_timeline_, frame_timeline_values_[current_frame_]);
+        frame_profiler_.end_phase(Frame_phase::fence_wait);
+        poll_present_completion(false);
+        collect_gpu_timestamps(current_frame_);
+        collect_cull_stats(current_frame_);
+        if(config_.stream_textures){
+            stream_texture_levels();
+        }
+        // Uploads recorded since the last frame (e.g. by a swap chain recreation) go ahead of it on the queue.
+        flush_uploads();
+        collect_finished_uploads(false);
+        if(config_.static_command_buffers && static_command_buffers_dirty_){
+            // Other frame slots may still be executing their static buffers.
+            wait_timeline(graphics_timeline_, *std::max_element(frame_timeline_values_.begin(), frame_timeline_values_.end()));
+            record_static_command_buffers();
+        }
+
+        uint32_t image_index{};
+        VkResult result{VK_SUCCESS};
+        if(config_.headless){
+            // The offscreen image of this frame slot is free once its timeline value has been reached.
+            write_frame_dump(current_frame_);
+            image_index = current_frame_;
+            if(!config_.dump_directory.empty() && frame_number_ % config_.dump_interval == 0){
+                pending_frame_dumps_[current_frame_] = frame_number_;
+            }
+        }else{
+            result =  vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+
+            if(result == VK_ERROR_OUT_OF_DATE_KHR){
+                recreate_swap_chain();
+                return;
+            }else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR){
+                throw std::runtime_error{"failed to acquire swap chain image."};
+            }
+            acquire_time_ = std::chrono::steady_clock::now();
+        }
+        // Headless: draining the readback of the reused image counts as its acquire.
+        frame_profiler_.end_phase(Frame_phase::acquire);
+
+        // call before submitting next frame.
+        update_uniform_buffer(current_frame_);
+        frame_profiler_.end_phase(Frame_phase::update_uniforms);
+
+        // record commands, static buffers can't carry the readback of a frame dump.
+        VkCommandBuffer command_buffer = command_buffers_[current_frame_];
+        if(config_.static_command_buffers && !pending_frame_dumps_[current_frame_]){
+            command_buffer = static_command_buffers_[static_command_buffer_index(current_frame_, image_index)];
+        }else{
+            vkResetCommandBuffer(command_buffer, 0);
+            record_command_buffer(command_buffer, image_index, current_frame_, config_.record_threads);
+        }
+        frame_profiler_.end_phase(Frame_phase::record);
+        gpu_timestamp_frames_[current_frame_] = frame_number_;
+        cull_result_pending_[current_frame_] = config_.gpu_culling;
+        
+        // submit commands.
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore wait_semaphores [] = {image_available_semaphores_[current_frame_]};
+        VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        submit_info.waitSemaphoreCount = config_.headless ? 0 : 1;
         submit_info.pWaitSemaphores = wait_semaphores;
         submit_info.pWaitDstStageMask = wait_stages;
 
         submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffers_[current_frame_];
+        submit_info.pCommandBuffers = &command_buffer;
 
-        VkSemaphore signal_semaphores[] = {render_finish_semaphores_[current_frame_]};
-        submit_info.signalSemaphoreCount =1;
+        // Binary semaphores ignore their value entries.
+        const uint64_t signal_value = next_timeline_value();
+        VkSemaphore signal_semaphores[] = {graphics_timeline_, render_finish_semaphores_[current_frame_]};
+        uint64_t signal_values[] = {signal_value, 0};
+        uint64_t wait_values[] = {0};
+        submit_info.signalSemaphoreCount = config_.headless ? 1 : 2;
         submit_info.pSignalSemaphores = signal_semaphores;
 
-        if(vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[current_frame_])!=VK_SUCCESS){
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = submit_info.waitSemaphoreCount;
+        timeline_info.pWaitSemaphoreValues = wait_values;
+        timeline_info.signalSemaphoreValueCount = submit_info.signalSemaphoreCount;
+        timeline_info.pSignalSemaphoreValues = signal_values;
+        submit_info.pNext = &timeline_info;
+
+        if(vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE)!=VK_SUCCESS){
             throw std::runtime_error{"failed to submit draw command buffer."};
         }
+        frame_timeline_values_[current_frame_] = signal_value;
+        frame_profiler_.end_phase(Frame_phase::submit);
+        if(frame_number_ == 0){
+            first_frame_ms_ = elapsed_ms();
+            std::cout << std::format("first frame: submitted {:.1f} ms after start.\n", first_frame_ms_);
+        }
+
+        if(config_.headless){
+            frame_profiler_.end_frame(frame_number_++);
+            current_frame_ = (current_frame_ + 1) % frames_in_flight_;
+            return;
+        }
 
         VkPresentInfoKHR present_info{};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
         present_info.waitSemaphoreCount = 1;
-        present_info.pWaitSemaphores = signal_semaphores;
+        present_info.pWaitSemaphores = &render_finish_semaphores_[current_frame_];
 
         VkSwapchainKHR swap_chains[] = {swap_chain_};
         present_info.swapchainCount = 1;
@@ -1165,7 +2251,27 @@ class HelloTriangleApp{
         present_info.pImageIndices = &image_index;
         present_info.pResults = nullptr;
 
+        // Ids only have to grow per swap chain, the frame number does.
+        const uint64_t present_id = frame_number_ + 1;
+        VkPresentIdKHR present_id_info{};
+        present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        present_id_info.swapchainCount = 1;
+        present_id_info.pPresentIds = &present_id;
+        if(present_wait_){
+            present_info.pNext = &present_id_info;
+        }
+
         result = vkQueuePresentKHR(graphics_queue_, &present_info);
+        if(present_wait_){
+            if(pending_presents_.size() == MAX_PENDING_PRESENTS){
+                pending_presents_.pop_front();
+            }
+            pending_presents_.push_back({present_id, acquire_time_});
+        }else{
+            record_present_latency(acquire_time_);
+        }
+        frame_profiler_.end_phase(Frame_phase::present);
+        frame_profiler_.end_frame(frame_number_++);
         if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized_){
             framebuffer_resized_ = false;
             recreate_swap_chain();
@@ -1174,20 +2280,182 @@ class HelloTriangleApp{
             throw std::runtime_error{"failed to present swap chain image."};
         }
 
-        current_frame_ = (current_frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+        current_frame_ = (current_frame_ + 1) % frames_in_flight_;
+    }
+    // Turns presents that reached the screen into latency samples. Polls with a zero timeout unless
+    // wait is set, so the resolution is one frame.
+    void poll_present_completion(bool wait){
+        while(!pending_presents_.empty()){
+            auto [present_id, acquire_time] = pending_presents_.front();
+            auto result = wait_for_present_(device_, swap_chain_, present_id, wait ? 100'000'000 : 0);
+            if(result == VK_TIMEOUT){
+                return;
+            }
+            pending_presents_.pop_front();
+            if(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR){
+                record_present_latency(acquire_time);
+            }
+        }
+    }
+
+    void record_present_latency(std::chrono::steady_clock::time_point acquire_time){
+        present_latencies_ms_.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquire_time).count());
+    }
+
+    void create_readback_buffers(){
+        VkDeviceSize size = static_cast<VkDeviceSize>(swap_chain_extent_.width) * swap_chain_extent_.height * 4;
+
+        readback_buffers_.resize(frames_in_flight_);
+        readback_buffers_memory_.resize(frames_in_flight_);
+        readback_buffers_mapped_.resize(frames_in_flight_);
+
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            readback_buffers_[i], readback_buffers_memory_[i]);
+
+            readback_buffers_mapped_[i] = readback_buffers_memory_[i].mapped_;
+        }
+        std::filesystem::create_directories(config_.dump_directory);
+    }
+
+    void record_frame_readback(VkCommandBuffer command_buffer, uint32_t image_index){
+        // The render pass already left the image in TRANSFER_SRC, only wait for the resolve writes.
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swap_chain_images_[image_index];
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer,
+         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+         0, 0, nullptr, 0, nullptr,
+         1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {swap_chain_extent_.width, swap_chain_extent_.height, 1};
+
+        vkCmdCopyImageToBuffer(command_buffer, swap_chain_images_[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffers_[current_frame_], 1, &region);
+
+        VkBufferMemoryBarrier host_barrier{};
+        host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        host_barrier.buffer = readback_buffers_[current_frame_];
+        host_barrier.offset = 0;
+        host_barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(command_buffer,
+         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+         0, 0, nullptr, 1, &host_barrier,
+         0, nullptr);
     }
+
+    // Call only after the fence of `frame` has signaled.
+    void write_frame_dump(uint32_t frame){
+        auto& pending = pending_frame_dumps_[frame];
+        if(!pending){
+            return;
+        }
+        auto path = std::filesystem::path{config_.dump_directory} / std::format("frame_{:05}.ppm", *pending);
+        pending.reset();
+
+        std::ofstream file(path, std::ios::binary);
+        if(!file.is_open()){
+            throw std::runtime_error{std::format("can't open file {}", path.string())};
+        }
+        const auto width = swap_chain_extent_.width;
+        const auto height = swap_chain_extent_.height;
+        file << std::format("P6\n{} {}\n255\n", width, height);
+
+        const bool bgra = swap_chain_image_format_ == VK_FORMAT_B8G8R8A8_SRGB;
+        auto pixels = static_cast<const uint8_t*>(readback_buffers_mapped_[frame]);
+        std::vector<char> row(width * 3);
+        for(uint32_t y = 0; y < height; y++){
+            for(uint32_t x = 0; x < width; x++){
+                auto texel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+                row[x * 3 + 0] = static_cast<char>(texel[bgra ? 2 : 0]);
+                row[x * 3 + 1] = static_cast<char>(texel[1]);
+                row[x * 3 + 2] = static_cast<char>(texel[bgra ? 0 : 2]);
+            }
+            file.write(row.data(), row.size());
+        }
+    }
+
+    void write_pending_frame_dumps(){
+        for(uint32_t i = 0; i < frames_in_flight_; i++){
+            write_frame_dump(i);
+        }
+    }
+
+    void create_timestamp_query_pool(){
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+        uint32_t queue_family_count {};
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, queue_families.data());
+
+        auto graphics_family = find_queue_families(physical_device_).graphics_family.value();
+        timestamp_valid_bits_ = queue_families[graphics_family].timestampValidBits;
+        timestamp_period_ = properties.limits.timestampPeriod;
+        if(timestamp_valid_bits_ == 0){
+            std::cout << "GPU timestamps are not supported on the graphics queue.\n";
+            return;
+        }
+
+        VkQueryPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = frames_in_flight_ * TIMESTAMPS_PER_FRAME;
+
+        if(vkCreateQueryPool(device_, &pool_info, nullptr, &timestamp_query_pool_) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create timestamp query pool."};
+        }
+        gpu_timestamp_frames_.assign(frames_in_flight_, std::nullopt);
+    }
+
+    // Call only after the fence of `frame` has signaled, the queries of its last submission are then
+    // complete and reading them never stalls.
+    void collect_gpu_timestamps(uint32_t frame){
+        if(!timestamp_query_pool_ || !gpu_timestamp_frames_[frame]){
+            return;
+        }
+        std::array<uint64_t, TIMESTAMPS_PER_FRAME> timestamps{};
+        auto result = vkGetQueryPoolResults(device_, timestamp_query_pool_, frame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+            sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if(result != VK_SUCCESS){
+            return;
+        }
+
+        const uint64_t mask = timestamp_valid_bits_ >= 64 ? ~0ull : (1ull << timestamp_valid_bits_) - 1;
+        const uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+        const double gpu_ms = static_cast<double>(ticks) * timestamp_period_ / 1e6;
+        frame_profiler_.record_gpu_time(*gpu_timestamp_frames_[frame], static_cast<float>(gpu_ms));
+        gpu_timestamp_frames_[frame].reset();
+    }
+
     void create_sync_objects(){
         VkSemaphoreCreateInfo semaphore_info{};
         semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fence_info{};
-        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        for(size_t i =0;i<MAX_FRAMES_IN_FLIGHT;i++){
+        // Binary semaphores are only needed for the swap chain, frame pacing uses graphics_timeline_.
+        for(size_t i =0;i<frames_in_flight_;i++){
             if(
                 vkCreateSemaphore(device_, &semaphore_info, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device_, &semaphore_info, nullptr, &render_finish_semaphores_[i]) != VK_SUCCESS ||
-                vkCreateFence(device_, &fence_info, nullptr, &in_flight_fences_[i])
+                vkCreateSemaphore(device_, &semaphore_info, nullptr, &render_finish_semaphores_[i]) != VK_SUCCESS
             ){
                 throw  std::runtime_error{"failed to create semaphores."};
             }
@@ -1195,34 +2463,51 @@ class HelloTriangleApp{
     }
 
     void create_vertex_buffer(){
-        VkDeviceSize size =  sizeof(vertices_[0]) * vertices_.size();
+        VkDeviceSize size = model_vertices_.size() * sizeof(Gpu_vertex);
         
         VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
+        Allocation staging_buffer_memory;
 
         create_buffer(size, 
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
             staging_buffer,staging_buffer_memory);
 
-         
-        void * data{};
-        vkMapMemory(device_, staging_buffer_memory, 0,size, 0, &data);
-        memcpy(data, vertices_.data(), static_cast<size_t>(size));
-        vkUnmapMemory(device_, staging_buffer_memory);
+        // Packed vertices are quantized here, the float vertices stay the cached format.
+        std::vector<Packed_vertex> packed;
+        auto interleaved = std::as_bytes(model_vertices_);
+        if constexpr(PACKED_VERTICES){
+            vertex_dequantization_ = compute_vertex_dequantization(model_vertices_);
+            packed.resize(model_vertices_.size());
+            for(size_t i = 0; i < model_vertices_.size(); i++){
+                packed[i] = pack_vertex(model_vertices_[i], vertex_dequantization_);
+            }
+            interleaved = std::as_bytes(std::span{packed});
+            std::cout << std::format("vertex buffer: {} vertices x {} B = {:.2f} MiB packed, {:.2f} MiB as Vertex.\n",
+                model_vertices_.size(), sizeof(Packed_vertex), size / 1048576.0, model_vertices_.size_bytes() / 1048576.0);
+        }
+
+        // Split streams share one buffer, the attribute stream starts after the last position.
+        auto mapped = static_cast<std::byte*>(staging_buffer_memory.mapped_);
+        if(config_.split_vertex_streams){
+            split_vertex_streams(interleaved, model_vertices_.size(), sizeof(Gpu_vertex::pos_), mapped);
+            vertex_attribute_offset_ = model_vertices_.size() * sizeof(Gpu_vertex::pos_);
+        }else{
+            memcpy(mapped, interleaved.data(), interleaved.size());
+            vertex_attribute_offset_ = 0;
+        }
 
         create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT| VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer_, vertex_buffer_memory_);
 
         copy_buffer(staging_buffer, vertex_buffer_, size);
         
-        vkDestroyBuffer(device_, staging_buffer, nullptr);
-        vkFreeMemory(device_, staging_buffer_memory, nullptr);
+        release_staging_buffer(staging_buffer, staging_buffer_memory);
     }
     void create_index_buffer(){
-        VkDeviceSize size =  sizeof(indices_[0]) *indices_.size();
+        VkDeviceSize size =  model_indices_.size_bytes();
         
         VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
+        Allocation staging_buffer_memory;
 
         create_buffer(size, 
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -1230,17 +2515,13 @@ class HelloTriangleApp{
             staging_buffer,staging_buffer_memory);
 
          
-        void * data{};
-        vkMapMemory(device_, staging_buffer_memory, 0,size, 0, &data);
-        memcpy(data, indices_.data(), static_cast<size_t>(size));
-        vkUnmapMemory(device_, staging_buffer_memory);
+        memcpy(staging_buffer_memory.mapped_, model_indices_.data(), static_cast<size_t>(size));
 
         create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT| VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer_, index_buffer_memory_);
 
         copy_buffer(staging_buffer, index_buffer_, size);
         
-        vkDestroyBuffer(device_, staging_buffer, nullptr);
-        vkFreeMemory(device_, staging_buffer_memory, nullptr);
+        release_staging_buffer(staging_buffer, staging_buffer_memory);
     }
     uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties){
         VkPhysicalDeviceMemoryProperties mem_properties;
@@ -1254,7 +2535,7 @@ class HelloTriangleApp{
         throw std::runtime_error{"failed to find suitable memory type."};
     }
     
-    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory){
+    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& buffer_memory){
         VkBufferCreateInfo buffer_info{};
         buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         buffer_info.size = size;
@@ -1268,18 +2549,85 @@ class HelloTriangleApp{
         VkMemoryRequirements mem_requirements{};
         vkGetBufferMemoryRequirements(device_, buffer,&mem_requirements);
 
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
+        buffer_memory = allocator_.allocate(mem_requirements, find_memory_type(mem_requirements.memoryTypeBits, properties), true);
+        vkBindBufferMemory(device_, buffer, buffer_memory.memory_, buffer_memory.offset_);
+    }
+    void print_memory_stats(){
+        auto stats = allocator_.stats();
+        std::cout << std::format("memory: {} allocations in {} blocks ({} vkAllocateMemory calls), {:.2f} of {:.2f} MiB used.\n",
+            stats.live_allocations_, stats.live_blocks_, stats.device_allocations_,
+            stats.used_bytes_ / (1024.0 * 1024.0), stats.reserved_bytes_ / (1024.0 * 1024.0));
+    }
+
+    // Creates and frees count small buffers with one vkAllocateMemory each, then through the allocator.
+    void benchmark_memory_allocation(uint32_t count){
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+        // The dedicated path would fail past maxMemoryAllocationCount, leave headroom for the app's own.
+        auto dedicated_count = std::min(count, properties.limits.maxMemoryAllocationCount / 2);
+
+        auto buffer_size = [](uint32_t i) -> VkDeviceSize { return VkDeviceSize{256} << (i % 8); };
+        auto make_buffer = [&](VkDeviceSize size){
+            VkBufferCreateInfo buffer_info{};
+            buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            buffer_info.size = size;
+            buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            VkBuffer buffer{};
+            if(vkCreateBuffer(device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS){
+                throw std::runtime_error{"failed to create buffer"};
+            }
+            return buffer;
+        };
 
-        if(vkAllocateMemory(device_, &alloc_info, nullptr, &buffer_memory) !=VK_SUCCESS)   {
-            throw std::runtime_error{"failed to allocate vertex buffer for merory"};
+        std::vector<VkBuffer> buffers(count);
+        std::vector<VkDeviceMemory> memories(dedicated_count);
+        auto start_time = std::chrono::steady_clock::now();
+        for(uint32_t i = 0; i < dedicated_count; i++){
+            buffers[i] = make_buffer(buffer_size(i));
+            VkMemoryRequirements mem_requirements{};
+            vkGetBufferMemoryRequirements(device_, buffers[i], &mem_requirements);
+
+            VkMemoryAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.allocationSize = mem_requirements.size;
+            alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if(vkAllocateMemory(device_, &alloc_info, nullptr, &memories[i]) != VK_SUCCESS){
+                throw std::runtime_error{"failed to allocate buffer memory."};
+            }
+            vkBindBufferMemory(device_, buffers[i], memories[i], 0);
+        }
+        for(uint32_t i = 0; i < dedicated_count; i++){
+            vkDestroyBuffer(device_, buffers[i], nullptr);
+            vkFreeMemory(device_, memories[i], nullptr);
+        }
+        auto dedicated_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+        std::vector<Allocation> allocations(count);
+        auto calls_before = allocator_.stats().device_allocations_;
+        start_time = std::chrono::steady_clock::now();
+        for(uint32_t i = 0; i < count; i++){
+            buffers[i] = make_buffer(buffer_size(i));
+            VkMemoryRequirements mem_requirements{};
+            vkGetBufferMemoryRequirements(device_, buffers[i], &mem_requirements);
+            allocations[i] = allocator_.allocate(mem_requirements, find_memory_type(mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), true);
+            vkBindBufferMemory(device_, buffers[i], allocations[i].memory_, allocations[i].offset_);
         }
-        vkBindBufferMemory(device_, buffer, buffer_memory, 0);
+        auto calls = allocator_.stats().device_allocations_ - calls_before;
+        for(uint32_t i = 0; i < count; i++){
+            vkDestroyBuffer(device_, buffers[i], nullptr);
+            allocator_.free(allocations[i]);
+        }
+        auto allocator_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+        std::cout << std::format("dedicated: {} buffers, {} vkAllocateMemory calls, {:.3f} ms ({:.3f} us/buffer)\n",
+            dedicated_count, dedicated_count, dedicated_ms, dedicated_ms * 1000.0 / std::max(dedicated_count, 1u));
+        std::cout << std::format("allocator: {} buffers, {} vkAllocateMemory calls, {:.3f} ms ({:.3f} us/buffer)\n",
+            count, calls, allocator_ms, allocator_ms * 1000.0 / count);
     }
+
     void copy_buffer(VkBuffer src_buffer,VkBuffer dst_buffer, VkDeviceSize size){
-         VkCommandBuffer command_buffer = begin_single_time_commands();
+         VkCommandBuffer command_buffer = use_transfer_queue() ? begin_transfer_commands() : begin_single_time_commands();
 
         VkBufferCopy copy_region{};
         copy_region.dstOffset = 0;
@@ -1287,7 +2635,11 @@ class HelloTriangleApp{
         copy_region.size = size;
         
         vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-        
+
+        if(use_transfer_queue()){
+            transfer_buffer_ownership(command_buffer, dst_buffer);
+            return;
+        }
         end_single_time_commands(command_buffer);
     }
 
@@ -1307,15 +2659,38 @@ class HelloTriangleApp{
         sampler_layout_binging.pImmutableSamplers = nullptr;
         sampler_layout_binging.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
+        VkDescriptorSetLayoutBinding instance_layout_binding{};
+        instance_layout_binding.binding = 2;
+        instance_layout_binding.descriptorCount = 1;
+        instance_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        instance_layout_binding.pImmutableSamplers = nullptr;
+        instance_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        // Every material texture for the bindless shader; only the slots in use are written.
+        VkDescriptorSetLayoutBinding material_layout_binding{};
+        material_layout_binding.binding = 3;
+        material_layout_binding.descriptorCount = material_capacity_;
+        material_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        material_layout_binding.pImmutableSamplers = nullptr;
+        material_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings = {
             ubo_layout_binging,
             sampler_layout_binging,
+            instance_layout_binding,
+            material_layout_binding,
         };
-        
+        std::array<VkDescriptorBindingFlags, 4> binding_flags{0, 0, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT};
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+        binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        binding_flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+        binding_flags_info.pBindingFlags = binding_flags.data();
+
         VkDescriptorSetLayoutCreateInfo layout_info{};
         layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.bindingCount = config_.bindless_materials ? 4 : 3;
         layout_info.pBindings = bindings.data();
+        layout_info.pNext = config_.bindless_materials ? &binding_flags_info : nullptr;
 
         if(vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS){
             throw std::runtime_error{"failed to create descriptor set layout."};
@@ -1325,16 +2700,16 @@ class HelloTriangleApp{
     void create_uniform_buffers(){
         VkDeviceSize buffer_size = sizeof(Uniform_buffer_object);
 
-        uniform_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
-        uniform_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
-        uniform_buffers_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
+        uniform_buffers_.resize(frames_in_flight_);
+        uniform_buffers_memory_.resize(frames_in_flight_);
+        uniform_buffers_mapped_.resize(frames_in_flight_);
 
-        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT ;i++){
+        for(size_t i = 0; i < frames_in_flight_ ;i++){
             create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
             , uniform_buffers_[i], uniform_buffers_memory_[i]);
 
-            vkMapMemory(device_, uniform_buffers_memory_[i], 0, buffer_size, 0, &uniform_buffers_mapped_[i]);
+            uniform_buffers_mapped_[i] = uniform_buffers_memory_[i].mapped_;
         }
     }
 
@@ -1349,24 +2724,93 @@ class HelloTriangleApp{
         ubo.model_ = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),glm::vec3(0,0,1));
         ubo.view_ = glm::lookAt(glm::vec3(2,2,2), glm::vec3(0,0,0), glm::vec3(0,0,1));
         const auto FOV = glm::radians(45.0f);
-        ubo.proj_ = glm::perspective(FOV, static_cast<float>(swap_chain_extent_.width)/static_cast<float>(swap_chain_extent_.height), 0.1f, 10.0f);
+        ubo.proj_ = glm::perspective(FOV, static_cast<float>(swap_chain_extent_.width)/static_cast<float>(swap_chain_extent_.height), NEAR_PLANE, 10.0f);
         ubo.proj_[1][1] *= -1;
         memcpy(uniform_buffers_mapped_[current_image], &ubo, sizeof ubo);
+        if(config_.meshlets && !config_.gpu_culling){
+            cull_meshlets(ubo);
+        }
+
+        update_instance_buffer(current_image, time, ubo);
+    }
+
+    void create_instance_buffers(){
+        VkDeviceSize buffer_size = sizeof(Instance_data) * config_.instance_count;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+        if(buffer_size > properties.limits.maxStorageBufferRange){
+            throw std::runtime_error{std::format("{} instances exceed maxStorageBufferRange ({} bytes).", config_.instance_count, properties.limits.maxStorageBufferRange)};
+        }
+
+        instance_buffers_.resize(frames_in_flight_);
+        instance_buffers_memory_.resize(frames_in_flight_);
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            create_buffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            instance_buffers_[i], instance_buffers_memory_[i]);
+        }
+    }
+
+    void update_instance_buffer(uint32_t frame, float time, const Uniform_buffer_object& ubo){
+        auto* instances = static_cast<Instance_data*>(instance_buffers_memory_[frame].mapped_);
+        if(config_.lods){
+            // Written to the side first, select_lods() copies them grouped by LOD.
+            unsorted_instances_.resize(config_.instance_count);
+            instances = unsorted_instances_.data();
+        }
+        if(config_.instance_count == 1){
+            instances[0] = {glm::mat4(1.0f), glm::vec4(1.0f)};
+        }else{
+            update_instance_grid(instances, time);
+        }
+        if(config_.lods){
+            select_lods(frame, ubo);
+        }
+    }
+
+    // Square grid over [-spread, spread]^2, every copy spins at its own rate. A single instance keeps the identity.
+    void update_instance_grid(Instance_data* instances, float time){
+        const uint32_t count = config_.instance_count;
+
+        const auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const float spread = config_.instance_spread;
+        const float spacing = 2.0f * spread / static_cast<float>(side);
+        const float scale = 2.0f / static_cast<float>(side) * 0.8f;
+        for(uint32_t i = 0; i < count; i++){
+            auto x = static_cast<float>(i % side);
+            auto y = static_cast<float>(i / side);
+            glm::vec3 position{-spread + spacing * (x + 0.5f), -spread + spacing * (y + 0.5f), 0.0f};
+
+            auto model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, time * (0.5f + static_cast<float>(i % 7) * 0.25f), glm::vec3(0, 0, 1));
+            model = glm::scale(model, glm::vec3(scale));
+            // Write straight into the mapped buffer, no staging copy per frame.
+            instances[i].model_ = model;
+            instances[i].tint_ = {0.6f + 0.4f * (x / side), 0.6f + 0.4f * (y / side), 1.0f, 1.0f};
+        }
     }
 
     void create_descriptor_pool(){
-        std::array<VkDescriptorPoolSize,2> pool_sizes{};
+        // Without bindless every material has a full set per frame slot, with it the set carries the whole array.
+        const auto set_count = static_cast<uint32_t>(frames_in_flight_ * (1 + material_descriptor_set_count()));
+        const uint32_t array_size = config_.bindless_materials ? material_capacity_ : 0;
+
+        std::array<VkDescriptorPoolSize,3> pool_sizes{};
         pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        pool_sizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        pool_sizes[0].descriptorCount = set_count;
 
         pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        pool_sizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        pool_sizes[1].descriptorCount = set_count + static_cast<uint32_t>(frames_in_flight_) * array_size;
+
+        pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[2].descriptorCount = set_count;
 
         VkDescriptorPoolCreateInfo pool_info{};
         pool_info.sType =  VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
         pool_info.pPoolSizes = pool_sizes.data();
-        pool_info.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        pool_info.maxSets = set_count;
 
         if(vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS){
             throw std::runtime_error{"failed to create descriptor pool."};
@@ -1374,55 +2818,125 @@ class HelloTriangleApp{
     }
 
     void create_descriptor_sets(){
-        std::vector<VkDescriptorSetLayout> layouts (MAX_FRAMES_IN_FLIGHT,descriptor_set_layout_);
+        descriptor_sets_ = allocate_descriptor_sets(frames_in_flight_);
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            write_descriptor_set(descriptor_sets_[i], i, texture_image_view_);
+        }
+        if(config_.bindless_materials){
+            write_material_array();
+        }
+        if(material_descriptor_set_count() > 0){
+            // Set frame * materials + material.
+            material_descriptor_sets_ = allocate_descriptor_sets(frames_in_flight_ * material_descriptor_set_count());
+            for(size_t i = 0; i < material_descriptor_sets_.size(); i++){
+                write_descriptor_set(material_descriptor_sets_[i], i / material_views_.size(), material_views_[i % material_views_.size()]);
+            }
+        }
+        if(config_.stream_textures){
+            texture_stream_.frame_views_.assign(frames_in_flight_, texture_image_view_);
+        }
+    }
+
+    size_t material_descriptor_set_count() const{
+        return config_.bindless_materials ? 0 : material_views_.size();
+    }
+
+    std::vector<VkDescriptorSet> allocate_descriptor_sets(size_t count){
+        std::vector<VkDescriptorSetLayout> layouts (count,descriptor_set_layout_);
 
         VkDescriptorSetAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         alloc_info.descriptorPool = descriptor_pool_;
-        alloc_info.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        alloc_info.descriptorSetCount = static_cast<uint32_t>(count);
         alloc_info.pSetLayouts = layouts.data();
 
-        descriptor_sets_.resize(MAX_FRAMES_IN_FLIGHT);
-        if(vkAllocateDescriptorSets(device_, &alloc_info, descriptor_sets_.data()) != VK_SUCCESS){
+        std::vector<VkDescriptorSet> sets(count);
+        if(vkAllocateDescriptorSets(device_, &alloc_info, sets.data()) != VK_SUCCESS){
             throw std::runtime_error{"failed to allocate descriptor sets."};
         }
+        return sets;
+    }
 
-        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++){
-            VkDescriptorBufferInfo buffer_info{};
-            buffer_info.buffer = uniform_buffers_[i];
-            buffer_info.offset = 0;
-            buffer_info.range = sizeof(Uniform_buffer_object);
-            
-            VkDescriptorImageInfo image_info{};
-            image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            image_info.sampler = texture_sampler_;
-            image_info.imageView = texture_image_view_;
-
-            std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
-            descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[0].dstSet = descriptor_sets_[i];
-            descriptor_writes[0].dstBinding = 0;
-            descriptor_writes[0].dstArrayElement = 0;
-
-            descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptor_writes[0].descriptorCount = 1;
-
-            descriptor_writes[0].pBufferInfo = &buffer_info;
-            descriptor_writes[0].pImageInfo = nullptr;
-            descriptor_writes[0].pTexelBufferView = nullptr;
-
-            descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[1].dstSet = descriptor_sets_[i];
-            descriptor_writes[1].dstBinding = 1;
-            descriptor_writes[1].dstArrayElement = 0;
-            descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptor_writes[1].descriptorCount = 1;
-            descriptor_writes[1].pImageInfo = &image_info;
-            vkUpdateDescriptorSets(device_, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+    // Points the set at frame slot frame's buffers and samples texture_view through binding 1.
+    void write_descriptor_set(VkDescriptorSet set, size_t frame, VkImageView texture_view){
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = uniform_buffers_[frame];
+        buffer_info.offset = 0;
+        buffer_info.range = sizeof(Uniform_buffer_object);
+
+        VkDescriptorImageInfo image_info{};
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.sampler = texture_sampler_;
+        image_info.imageView = texture_view;
+
+        VkDescriptorBufferInfo instance_buffer_info{};
+        instance_buffer_info.buffer = instance_buffers_[frame];
+        instance_buffer_info.offset = 0;
+        instance_buffer_info.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
+        descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[0].dstSet = set;
+        descriptor_writes[0].dstBinding = 0;
+        descriptor_writes[0].dstArrayElement = 0;
+
+        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptor_writes[0].descriptorCount = 1;
+
+        descriptor_writes[0].pBufferInfo = &buffer_info;
+        descriptor_writes[0].pImageInfo = nullptr;
+        descriptor_writes[0].pTexelBufferView = nullptr;
+
+        descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[1].dstSet = set;
+        descriptor_writes[1].dstBinding = 1;
+        descriptor_writes[1].dstArrayElement = 0;
+        descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_writes[1].descriptorCount = 1;
+        descriptor_writes[1].pImageInfo = &image_info;
+
+        descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[2].dstSet = set;
+        descriptor_writes[2].dstBinding = 2;
+        descriptor_writes[2].dstArrayElement = 0;
+        descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptor_writes[2].descriptorCount = 1;
+        descriptor_writes[2].pBufferInfo = &instance_buffer_info;
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+    }
+
+    // Binding 3 of every frame slot's set, one element per material slot.
+    void write_material_array(){
+        std::vector<VkDescriptorImageInfo> image_infos(material_views_.size());
+        for(size_t i = 0; i < material_views_.size(); i++){
+            image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            image_infos[i].sampler = texture_sampler_;
+            image_infos[i].imageView = material_views_[i];
         }
+        std::vector<VkWriteDescriptorSet> descriptor_writes(frames_in_flight_);
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_writes[i].dstSet = descriptor_sets_[i];
+            descriptor_writes[i].dstBinding = 3;
+            descriptor_writes[i].dstArrayElement = 0;
+            descriptor_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptor_writes[i].descriptorCount = static_cast<uint32_t>(image_infos.size());
+            descriptor_writes[i].pImageInfo = image_infos.data();
+        }
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
     }
 
     void create_texture_image(){
+        if(config_.compressed_textures && create_compressed_texture_image()){
+            return;
+        }
+        VkFormatProperties format_properties{};
+        vkGetPhysicalDeviceFormatProperties(physical_device_, VK_FORMAT_R8G8B8A8_SRGB, &format_properties);
+        if(config_.cpu_mipmaps || !(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)){
+            create_texture_image_with_cpu_mips();
+            return;
+        }
+
         int tex_width{};
         int tex_height{};
         int tex_channels{};
@@ -1434,36 +2948,383 @@ class HelloTriangleApp{
         
         VkDeviceSize image_size = tex_height * tex_width * 4;
         VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
+        Allocation staging_buffer_memory;
         
         mip_levels_ = static_cast<uint32_t>(std::floor(std::log2(std::max(tex_width,tex_height)))) + 1;
 
         create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
 
-        {
-            void *data;
-            vkMapMemory(device_, staging_buffer_memory, 0, image_size, 0, &data);
-            memcpy(data, pixels, image_size);
-            vkUnmapMemory(device_, staging_buffer_memory);
-        }
+        memcpy(staging_buffer_memory.mapped_, pixels, image_size);
         stbi_image_free(pixels);
         pixels = nullptr;        
 
-        create_image(static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_width), mip_levels_, VK_SAMPLE_COUNT_1_BIT,VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |VK_IMAGE_USAGE_SAMPLED_BIT,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image_, texture_image_memory_);
+        create_image(static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height), mip_levels_, VK_SAMPLE_COUNT_1_BIT,VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |VK_IMAGE_USAGE_SAMPLED_BIT,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image_, texture_image_memory_);
 
-        transition_image_layout(texture_image_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels_);
-        copy_buffer_to_image(staging_buffer, texture_image_, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
+        const Mip_level base_level{0, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height)};
+        if(use_transfer_queue()){
+            upload_image_on_transfer_queue(staging_buffer, texture_image_, {&base_level, 1}, mip_levels_);
+        }else{
+            transition_image_layout(texture_image_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels_);
+            copy_buffer_to_image(staging_buffer, texture_image_, {&base_level, 1});
+        }
 
         // transition_image_layout(texture_image_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mip_levels_);
 
 
-        vkDestroyBuffer(device_, staging_buffer, nullptr);
-        vkFreeMemory(device_, staging_buffer_memory, nullptr);
+        release_staging_buffer(staging_buffer, staging_buffer_memory);
         
         generate_mipmaps(texture_image_, VK_FORMAT_R8G8B8A8_SRGB, tex_width, tex_height, mip_levels_);
     }
+
+    // Every level comes from the mip cache or mip_generator.h and goes up in one staging copy, no blits.
+    void create_texture_image_with_cpu_mips(){
+        auto start_time = std::chrono::steady_clock::now();
+        bool cached{};
+        auto chain = load_texture_mip_chain(&cached);
+        VkBuffer staging_buffer;
+        Allocation staging_buffer_memory;
+        create_buffer(chain.pixels_.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+        memcpy(staging_buffer_memory.mapped_, chain.pixels_.data(), chain.pixels_.size());
+
+        create_texture_image_from_levels(VK_FORMAT_R8G8B8A8_SRGB, staging_buffer, staging_buffer_memory, chain.levels_);
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("texture: {} CPU mip levels {} in {:.1f} ms.\n", mip_levels_, cached ? "read from the mip cache" : "generated", duration);
+    }
+
+    // Creates the texture with every level of levels, copied out of the staging buffer, and releases the buffer.
+    void create_texture_image_from_levels(VkFormat format, VkBuffer staging_buffer, Allocation& staging_buffer_memory, std::span<const Mip_level> levels){
+        texture_format_ = format;
+        mip_levels_ = static_cast<uint32_t>(levels.size());
+        create_image_from_levels(format, staging_buffer, staging_buffer_memory, levels, texture_image_, texture_image_memory_);
+    }
+
+    void create_image_from_levels(VkFormat format, VkBuffer staging_buffer, Allocation& staging_buffer_memory, std::span<const Mip_level> levels,
+        VkImage& image, Allocation& image_memory){
+        const auto level_count = static_cast<uint32_t>(levels.size());
+        create_image(levels[0].width_, levels[0].height_, level_count, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, image_memory);
+        if(use_transfer_queue()){
+            upload_image_on_transfer_queue(staging_buffer, image, levels, level_count);
+        }else{
+            transition_image_layout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_count);
+            copy_buffer_to_image(staging_buffer, image, levels);
+        }
+        transition_image_layout(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, level_count);
+        release_staging_buffer(staging_buffer, staging_buffer_memory);
+    }
+
+    double elapsed_ms() const{
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time_).count();
+    }
+
+    // Creates the full texture with a flat placeholder in its coarsest level and hands the decode to a loader
+    // thread; only the PNG header is read here. stream_texture_levels() uploads the rest between frames.
+    void start_texture_stream(){
+        int tex_width{};
+        int tex_height{};
+        int tex_channels{};
+        if(!stbi_info(TEXTURE_PATH.c_str(), &tex_width, &tex_height, &tex_channels)){
+            throw std::runtime_error{"failed to load texture image."};
+        }
+        texture_stream_.loader_ = std::async(std::launch::async, [this]{
+            return load_texture_mip_chain();
+        });
+
+        texture_format_ = VK_FORMAT_R8G8B8A8_SRGB;
+        mip_levels_ = static_cast<uint32_t>(mip_chain_layout(static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height)).size());
+        texture_stream_.uploaded_level_ = mip_levels_ - 1;
+        create_image(static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height), mip_levels_, VK_SAMPLE_COUNT_1_BIT, texture_format_,
+            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            texture_image_, texture_image_memory_);
+
+        auto command_buffer = begin_stream_commands();
+        record_texture_barrier(command_buffer, 0, mip_levels_, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        const VkClearColorValue grey{{0.5f, 0.5f, 0.5f, 1.0f}};
+        const VkImageSubresourceRange placeholder{VK_IMAGE_ASPECT_COLOR_BIT, mip_levels_ - 1, 1, 0, 1};
+        vkCmdClearColorImage(command_buffer, texture_image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &grey, 1, &placeholder);
+        record_texture_barrier(command_buffer, mip_levels_ - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    // The cached chain or a decode with CPU mips, nothing here touches Vulkan so the stream's loader thread
+    // runs it too. Sets *cached when the chain came from the mip cache.
+    Mip_chain load_texture_mip_chain(bool* cached = nullptr){
+        auto source_hash = content_hash(Mapped_file{TEXTURE_PATH}.bytes());
+        const std::filesystem::path cache_path = TEXTURE_PATH + ".mips";
+        Mapped_file cache_file;
+        std::vector<Mip_level> levels;
+        if(config_.mip_cache && map_mip_cache(cache_path, source_hash, cache_file, levels)){
+            auto* data = reinterpret_cast<const uint8_t*>(cache_file.bytes().data()) + sizeof(Mip_cache_file_header);
+            auto size = mip_chain_size(levels);
+            if(cached){
+                *cached = true;
+            }
+            return {std::move(levels), {data, data + size}};
+        }
+        int tex_width{};
+        int tex_height{};
+        int tex_channels{};
+        stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
+        if(!pixels){
+            throw std::runtime_error{"failed to load texture image."};
+        }
+        Worker_pool pool{load_thread_count()};
+        auto chain = generate_mip_chain({pixels, static_cast<size_t>(tex_width) * tex_height * 4}, static_cast<uint32_t>(tex_width),
+            static_cast<uint32_t>(tex_height), &pool);
+        stbi_image_free(pixels);
+        if(config_.mip_cache){
+            write_mip_cache(cache_path, source_hash, chain);
+        }
+        return chain;
+    }
+
+    // Called by draw_frame() once the slot is free. Uploads the next levels, coarsest first and about
+    // TEXTURE_STREAM_BYTES_PER_FRAME at a time, behind the frame on the same queue, so the new view is
+    // usable by this frame already. Each slot's descriptor set follows the newest view when its turn comes.
+    void stream_texture_levels(){
+        auto& stream = texture_stream_;
+        if(stream.loader_.valid() && stream.loader_.wait_for(std::chrono::seconds{0}) == std::future_status::ready){
+            stream.chain_ = stream.loader_.get();
+            if(stream.chain_.levels_.size() != mip_levels_){
+                throw std::runtime_error{"texture changed size while it was streamed."};
+            }
+            stream.decoded_ms_ = elapsed_ms();
+            // The placeholder level is replaced with real data first.
+            stream.uploaded_level_ = mip_levels_;
+        }
+
+        if(!stream.chain_.levels_.empty() && stream.uploaded_level_ > 0){
+            const auto& levels = stream.chain_.levels_;
+            auto level_end = [&](uint32_t level){
+                return level + 1 < levels.size() ? levels[level + 1].offset_ : stream.chain_.pixels_.size();
+            };
+            const uint32_t last = stream.uploaded_level_;
+            uint32_t first = last - 1;
+            while(first > 0 && level_end(last - 1) - levels[first - 1].offset_ <= TEXTURE_STREAM_BYTES_PER_FRAME){
+                first--;
+            }
+            const size_t begin = levels[first].offset_;
+            const size_t size = level_end(last - 1) - begin;
+
+            VkBuffer staging_buffer;
+            Allocation staging_buffer_memory;
+            create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+            memcpy(staging_buffer_memory.mapped_, stream.chain_.pixels_.data() + begin, size);
+            std::vector<Mip_level> regions(levels.begin() + first, levels.begin() + last);
+            for(auto& region : regions){
+                region.offset_ -= begin;
+            }
+
+            auto command_buffer = begin_stream_commands();
+            if(last == mip_levels_){
+                record_texture_barrier(command_buffer, mip_levels_ - 1, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            }
+            record_copy_buffer_to_image(command_buffer, staging_buffer, texture_image_, regions, first);
+            record_texture_barrier(command_buffer, first, last - first, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            release_staging_buffer(staging_buffer, staging_buffer_memory);
+
+            // Until now the view started at last, or at the placeholder when this was the first upload.
+            stream.uploaded_level_ = first;
+            if(first < std::min(last, mip_levels_ - 1)){
+                stream.retired_views_.push_back(texture_image_view_);
+                create_texture_image_view();
+            }
+            if(first == 0){
+                stream.chain_ = {};
+                stream.resident_ms_ = elapsed_ms();
+                stream.resident_frame_ = frame_number_;
+                std::cout << std::format("texture: decoded after {:.1f} ms, all {} levels streamed by frame {} after {:.1f} ms.\n",
+                    stream.decoded_ms_, mip_levels_, frame_number_, stream.resident_ms_);
+            }
+        }
+
+        if(stream.frame_views_[current_frame_] == texture_image_view_){
+            return;
+        }
+        VkDescriptorImageInfo image_info{};
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.imageView = texture_image_view_;
+        image_info.sampler = texture_sampler_;
+        VkWriteDescriptorSet descriptor_write{};
+        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet = descriptor_sets_[current_frame_];
+        descriptor_write.dstBinding = 1;
+        descriptor_write.dstArrayElement = 0;
+        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_write.descriptorCount = 1;
+        descriptor_write.pImageInfo = &image_info;
+        vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+        stream.frame_views_[current_frame_] = texture_image_view_;
+
+        // A slot's earlier frames are done by the time its set is rewritten, so a view no set points at is unused.
+        std::erase_if(stream.retired_views_, [&](VkImageView view){
+            if(std::find(stream.frame_views_.begin(), stream.frame_views_.end(), view) != stream.frame_views_.end()){
+                return false;
+            }
+            vkDestroyImageView(device_, view, nullptr);
+            return true;
+        });
+    }
+
+    // Streaming records into the open upload batch whatever config_.batch_uploads says, flush_uploads()
+    // submits it ahead of the frame without a CPU wait.
+    VkCommandBuffer begin_stream_commands(){
+        if(!open_upload_batch_.command_buffer_){
+            open_upload_batch_.command_buffer_ = begin_upload_command_buffer(command_pool_);
+            open_upload_batch_.command_pool_ = command_pool_;
+        }
+        return open_upload_batch_.command_buffer_;
+    }
+
+    // Layout change of a level range of the texture between transfers and fragment shader reads.
+    void record_texture_barrier(VkCommandBuffer command_buffer, uint32_t base_level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout){
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = old_layout;
+        barrier.newLayout = new_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = texture_image_;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, base_level, level_count, 0, 1};
+        VkPipelineStageFlags source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkPipelineStageFlags destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        if(old_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+            // Frames submitted earlier may still sample the level; write after read needs no access mask.
+            source_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }else if(new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+        vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // BC1 blocks for every level from <texture>.ktx2, encoded from the PNG when the file is missing or
+    // stale. Returns false without touching anything when the device can't sample BC1.
+    bool create_compressed_texture_image(){
+        try{
+            if(!texture_compression_bc_){
+                throw std::runtime_error{"textureCompressionBC isn't supported."};
+            }
+            find_supported_format({VK_FORMAT_BC1_RGB_SRGB_BLOCK}, VK_IMAGE_TILING_OPTIMAL,
+                VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT);
+        }catch(const std::runtime_error& error){
+            std::cerr << std::format("BC1 textures unavailable ({}), uploading RGBA8.\n", error.what());
+            return false;
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto source_hash = std::format("{:016x}", content_hash(Mapped_file{TEXTURE_PATH}.bytes()));
+        const std::filesystem::path cache_path = TEXTURE_PATH + ".ktx2";
+        Mapped_file cache_file;
+        std::vector<uint8_t> encoded;
+        std::span<const std::byte> file_bytes;
+        std::optional<Ktx2_image> image;
+        if(config_.mip_cache){
+            image = map_texture_cache(cache_path, source_hash, cache_file);
+        }
+        const bool cached = image.has_value();
+        if(cached){
+            file_bytes = cache_file.bytes();
+        }else{
+            int tex_width{};
+            int tex_height{};
+            int tex_channels{};
+            stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
+            if(!pixels){
+                throw std::runtime_error{"failed to load texture image."};
+            }
+            Worker_pool pool{load_thread_count()};
+            auto chain = generate_mip_chain({pixels, static_cast<size_t>(tex_width) * tex_height * 4}, static_cast<uint32_t>(tex_width),
+                static_cast<uint32_t>(tex_height), &pool);
+            stbi_image_free(pixels);
+            auto blocks = encode_bc1_chain(chain, &pool);
+            encoded = encode_ktx2(KTX2_BC1_RGB_SRGB, blocks.levels_, blocks.pixels_, {{KTX2_SOURCE_HASH_KEY, source_hash}, {"KTXwriter", "tiny-vulkan"}});
+            if(config_.mip_cache){
+                write_texture_cache(cache_path, encoded);
+            }
+            file_bytes = std::as_bytes(std::span{encoded});
+            image = decode_ktx2(file_bytes);
+        }
+
+        // Levels sit smallest first at the end of the file, one copy moves all of them; offsets stay block aligned.
+        auto levels = image->levels_;
+        const size_t data_begin = levels.back().offset_;
+        const size_t data_size = levels.front().offset_ + image->format_.level_size(levels.front().width_, levels.front().height_) - data_begin;
+        for(auto& level : levels){
+            level.offset_ -= data_begin;
+        }
+        VkBuffer staging_buffer;
+        Allocation staging_buffer_memory;
+        create_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+        memcpy(staging_buffer_memory.mapped_, file_bytes.data() + data_begin, data_size);
+        create_texture_image_from_levels(VK_FORMAT_BC1_RGB_SRGB_BLOCK, staging_buffer, staging_buffer_memory, levels);
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("texture: {} BC1 mip levels {} in {:.1f} ms, {} KiB instead of {} KiB as RGBA8.\n", mip_levels_,
+            cached ? "read from the KTX2 cache" : "encoded", duration, data_size / 1024,
+            mip_chain_size(mip_chain_layout(levels[0].width_, levels[0].height_)) / 1024);
+        return true;
+    }
+
+    // Returns the parsed file, left mapped in file, when path holds BC1 levels of the texture with source_hash.
+    std::optional<Ktx2_image> map_texture_cache(const std::filesystem::path& path, std::string_view source_hash, Mapped_file& file){
+        std::error_code error;
+        if(!std::filesystem::is_regular_file(path, error)){
+            return std::nullopt;
+        }
+        Mapped_file mapped{path};
+        auto image = decode_ktx2(mapped.bytes());
+        if(!image || image->format_.format_ != VK_FORMAT_BC1_RGB_SRGB_BLOCK || image->value(KTX2_SOURCE_HASH_KEY) != source_hash){
+            std::cerr << std::format("ignoring stale or corrupt texture cache {}\n", path.string());
+            return std::nullopt;
+        }
+        file = std::move(mapped);
+        return image;
+    }
+
+    void write_texture_cache(const std::filesystem::path& path, std::span<const uint8_t> bytes){
+        write_file_atomically(path, {std::as_bytes(bytes)});
+    }
+
+    // Leaves file mapped and levels filled when path holds the chain of the texture with source_hash.
+    bool map_mip_cache(const std::filesystem::path& path, uint64_t source_hash, Mapped_file& file, std::vector<Mip_level>& levels){
+        std::error_code error;
+        if(!std::filesystem::is_regular_file(path, error)){
+            return false;
+        }
+        Mapped_file mapped{path};
+        auto bytes = mapped.bytes();
+        Mip_cache_file_header header{};
+        if(bytes.size() < sizeof(header)){
+            return false;
+        }
+        memcpy(&header, bytes.data(), sizeof(header));
+        if(header.magic_ != Mip_cache_file_header::MAGIC || header.version_ != Mip_cache_file_header::VERSION || header.source_hash_ != source_hash ||
+            header.width_ == 0 || header.height_ == 0 || header.data_size_ != mip_chain_size(mip_chain_layout(header.width_, header.height_)) ||
+            bytes.size() != sizeof(header) + header.data_size_){
+            std::cerr << std::format("ignoring stale or corrupt mip cache {}\n", path.string());
+            return false;
+        }
+        levels = mip_chain_layout(header.width_, header.height_);
+        file = std::move(mapped);
+        return true;
+    }
+
+    void write_mip_cache(const std::filesystem::path& path, uint64_t source_hash, const Mip_chain& chain){
+        Mip_cache_file_header header{};
+        header.magic_ = Mip_cache_file_header::MAGIC;
+        header.version_ = Mip_cache_file_header::VERSION;
+        header.source_hash_ = source_hash;
+        header.width_ = chain.levels_[0].width_;
+        header.height_ = chain.levels_[0].height_;
+        header.data_size_ = chain.pixels_.size();
+        write_file_atomically(path, {std::as_bytes(std::span{&header, 1}), std::as_bytes(std::span{chain.pixels_})});
+    }
     
-    void create_image(uint32_t width, uint32_t height,uint32_t mip_levels, VkSampleCountFlagBits num_samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,VkImage& image, VkDeviceMemory& image_memory){
+    void create_image(uint32_t width, uint32_t height,uint32_t mip_levels, VkSampleCountFlagBits num_samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,VkImage& image, Allocation& image_memory){
         VkImageCreateInfo image_info{};
         image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         image_info.imageType = VK_IMAGE_TYPE_2D;
@@ -1481,55 +3342,265 @@ class HelloTriangleApp{
         image_info.samples = num_samples;
         image_info.flags = 0;
 
-        if(vkCreateImage(device_, &image_info, nullptr, &image) != VK_SUCCESS){
-            throw std::runtime_error{"failed to create image."};
+        if(vkCreateImage(device_, &image_info, nullptr, &image) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create image."};
+        }
+
+        VkMemoryRequirements mem_requirements{};
+        vkGetImageMemoryRequirements(device_, image, &mem_requirements);
+
+        image_memory = allocator_.allocate(mem_requirements, find_memory_type(mem_requirements.memoryTypeBits, properties), tiling == VK_IMAGE_TILING_LINEAR);
+        vkBindImageMemory(device_, image, image_memory.memory_, image_memory.offset_);
+    }
+    
+    // With batch_uploads the commands go into the open upload batch, submitted by flush_uploads().
+    VkCommandBuffer begin_single_time_commands(){
+        if(config_.batch_uploads && open_upload_batch_.command_buffer_){
+            return open_upload_batch_.command_buffer_;
+        }
+        auto command_buffer = begin_upload_command_buffer(command_pool_);
+        if(config_.batch_uploads){
+            open_upload_batch_.command_buffer_ = command_buffer;
+            open_upload_batch_.command_pool_ = command_pool_;
+        }
+        return command_buffer;
+    }
+
+    void end_single_time_commands(VkCommandBuffer command_buffer){
+        if(config_.batch_uploads){
+            return;
+        }
+        vkEndCommandBuffer(command_buffer);
+
+        auto signal_value = next_timeline_value();
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &signal_value;
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = &timeline_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &graphics_timeline_;
+
+        vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE);
+        wait_timeline(graphics_timeline_, signal_value);
+        vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+        upload_stats_.submits_++;
+        upload_stats_.blocking_waits_++;
+    }
+
+    VkCommandBuffer begin_upload_command_buffer(VkCommandPool command_pool){
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandPool = command_pool;
+        alloc_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
+
+        VkCommandBufferBeginInfo being_info{};
+        being_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        being_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        
+        vkBeginCommandBuffer(command_buffer, &being_info);
+        return command_buffer;
+    }
+
+    // Copies run on the dedicated transfer queue when there is one, batching is required to overlap them.
+    bool use_transfer_queue() const{
+        return config_.batch_uploads && transfer_queue_ != VK_NULL_HANDLE;
+    }
+
+    VkCommandBuffer begin_transfer_commands(){
+        if(!open_transfer_batch_.command_buffer_){
+            open_transfer_batch_.command_buffer_ = begin_upload_command_buffer(transfer_command_pool_);
+            open_transfer_batch_.command_pool_ = transfer_command_pool_;
+        }
+        return open_transfer_batch_.command_buffer_;
+    }
+
+    // Hands a buffer written on the transfer queue over to the graphics queue.
+    void transfer_buffer_ownership(VkCommandBuffer transfer_command_buffer, VkBuffer buffer){
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = queue_family_indices_.transfer_family.value();
+        barrier.dstQueueFamilyIndex = queue_family_indices_.graphics_family.value();
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(transfer_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(begin_single_time_commands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    // Same for all mips of an image, which stays in TRANSFER_DST for generate_mipmaps().
+    void transfer_image_ownership(VkCommandBuffer transfer_command_buffer, VkImage image, uint32_t mip_levels){
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = queue_family_indices_.transfer_family.value();
+        barrier.dstQueueFamilyIndex = queue_family_indices_.graphics_family.value();
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mip_levels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(transfer_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(begin_single_time_commands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // Staging buffers must outlive the batch that reads them.
+    void release_staging_buffer(VkBuffer buffer, Allocation& memory){
+        for(auto* batch: {&open_transfer_batch_, &open_upload_batch_}){
+            if(batch->command_buffer_){
+                batch->staging_buffers_.emplace_back(buffer, memory);
+                memory = {};
+                return;
+            }
+        }
+        vkDestroyBuffer(device_, buffer, nullptr);
+        allocator_.free(memory);
+    }
+
+    void flush_uploads(){
+        if(open_transfer_batch_.command_buffer_){
+            // The graphics batch holds the acquire barriers, it waits for the copies on the GPU only.
+            begin_single_time_commands();
+            open_upload_batch_.wait_transfer_value_ = submit_upload_batch(transfer_queue_, transfer_timeline_, open_transfer_batch_);
+        }
+
+        auto command_buffer = open_upload_batch_.command_buffer_;
+        if(!command_buffer){
+            return;
         }
+        // Frames are submitted to the same queue later, make every upload visible to them.
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+        submit_upload_batch(graphics_queue_, graphics_timeline_, open_upload_batch_);
+    }
 
-        VkMemoryRequirements mem_requirements{};
-        vkGetImageMemoryRequirements(device_, image, &mem_requirements);
+    // Returns the timeline value the batch signals on its queue's timeline.
+    uint64_t submit_upload_batch(VkQueue queue, VkSemaphore timeline, Upload_batch& batch){
+        vkEndCommandBuffer(batch.command_buffer_);
+        batch.timeline_ = timeline;
+        batch.timeline_value_ = next_timeline_value();
 
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = batch.wait_transfer_value_ ? 1 : 0;
+        timeline_info.pWaitSemaphoreValues = &batch.wait_transfer_value_;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &batch.timeline_value_;
 
-        if(vkAllocateMemory(device_, &alloc_info, nullptr, &image_memory) != VK_SUCCESS){
-            throw std::runtime_error{"failed to allocate iamge memory."};
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = &timeline_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &batch.command_buffer_;
+        submit_info.waitSemaphoreCount = batch.wait_transfer_value_ ? 1 : 0;
+        submit_info.pWaitSemaphores = &transfer_timeline_;
+        submit_info.pWaitDstStageMask = &wait_stage;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &timeline;
+        if(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS){
+            throw std::runtime_error{"failed to submit upload commands."};
         }
+        upload_stats_.submits_++;
 
-        vkBindImageMemory(device_, image, image_memory, 0);
+        auto value = batch.timeline_value_;
+        submitted_upload_batches_.push_back(std::move(batch));
+        batch = {};
+        return value;
     }
-    
-    VkCommandBuffer begin_single_time_commands(){
-       VkCommandBufferAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        alloc_info.commandPool = command_pool_;
-        alloc_info.commandBufferCount = 1;
-
-        VkCommandBuffer command_buffer;
-        vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
 
-        VkCommandBufferBeginInfo being_info{};
-        being_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        being_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        
-        vkBeginCommandBuffer(command_buffer, &being_info);
+    // Frees command buffers and staging memory of finished batches, wait blocks until all are done.
+    void collect_finished_uploads(bool wait){
+        std::erase_if(submitted_upload_batches_, [&](Upload_batch& batch){
+            if(wait){
+                wait_timeline(batch.timeline_, batch.timeline_value_);
+                upload_stats_.blocking_waits_++;
+            }else if(!timeline_reached(batch.timeline_, batch.timeline_value_)){
+                return false;
+            }
+            for(auto& [buffer, memory]: batch.staging_buffers_){
+                vkDestroyBuffer(device_, buffer, nullptr);
+                allocator_.free(memory);
+            }
+            vkFreeCommandBuffers(device_, batch.command_pool_, 1, &batch.command_buffer_);
+            return true;
+        });
+    }
 
-        return command_buffer;
+    // One timeline per queue, values come from a single counter so they also order work across queues.
+    void create_timeline_semaphores(){
+        auto create = [&](VkSemaphore& semaphore){
+            VkSemaphoreTypeCreateInfo type_info{};
+            type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            type_info.initialValue = 0;
+
+            VkSemaphoreCreateInfo semaphore_info{};
+            semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            semaphore_info.pNext = &type_info;
+            if(vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS){
+                throw std::runtime_error{"failed to create timeline semaphore."};
+            }
+        };
+        create(graphics_timeline_);
+        if(transfer_queue_){
+            create(transfer_timeline_);
+        }
     }
 
-    void end_single_time_commands(VkCommandBuffer command_buffer){
-        vkEndCommandBuffer(command_buffer);
+    uint64_t next_timeline_value(){
+        return ++timeline_value_;
+    }
 
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffer;
+    void wait_timeline(VkSemaphore timeline, uint64_t value){
+        if(value == 0){
+            return;
+        }
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &timeline;
+        wait_info.pValues = &value;
+        if(vkWaitSemaphores(device_, &wait_info, UINT64_MAX) != VK_SUCCESS){
+            throw std::runtime_error{"failed to wait for timeline semaphore."};
+        }
+    }
 
-        vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphics_queue_);
-        vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+    bool timeline_reached(VkSemaphore timeline, uint64_t value){
+        uint64_t current{};
+        vkGetSemaphoreCounterValue(device_, timeline, &current);
+        return current >= value;
     }
 
     void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels){
@@ -1595,38 +3666,66 @@ class HelloTriangleApp{
         end_single_time_commands(command_buffer);
     }
 
-    void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width,uint32_t height){
+    void copy_buffer_to_image(VkBuffer buffer, VkImage image, std::span<const Mip_level> levels){
         auto command_buffer = begin_single_time_commands();
+        record_copy_buffer_to_image(command_buffer, buffer, image, levels);
+        end_single_time_commands(command_buffer);
+    }
 
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
+    // Layout transition and copy on the transfer queue, then ownership of every mip goes to graphics.
+    void upload_image_on_transfer_queue(VkBuffer buffer, VkImage image, std::span<const Mip_level> levels, uint32_t mip_levels){
+        auto command_buffer = begin_transfer_commands();
 
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent = {
-            width,
-            height,
-            1
-        };
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mip_levels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
 
-        vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-        end_single_time_commands(command_buffer);
+        record_copy_buffer_to_image(command_buffer, buffer, image, levels);
+        transfer_image_ownership(command_buffer, image, mip_levels);
+    }
+
+    // One region per level, all read from the same buffer.
+    void record_copy_buffer_to_image(VkCommandBuffer command_buffer, VkBuffer buffer, VkImage image, std::span<const Mip_level> levels, uint32_t first_mip_level = 0){
+        std::vector<VkBufferImageCopy> regions(levels.size());
+        for(size_t level = 0; level < levels.size(); level++){
+            auto& region = regions[level];
+            region.bufferOffset = levels[level].offset_;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = first_mip_level + static_cast<uint32_t>(level);
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {levels[level].width_, levels[level].height_, 1};
+        }
+
+        vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
     }
 
-    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels){
+    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t base_mip_level = 0){
         VkImageViewCreateInfo view_info{};
         view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         view_info.image = image;
         view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
         view_info.format = format;
         view_info.subresourceRange.aspectMask = aspect_flags;
-        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.baseMipLevel = base_mip_level;
         view_info.subresourceRange.levelCount = mip_levels;
         view_info.subresourceRange.baseArrayLayer =0;
         view_info.subresourceRange.layerCount = 1;
@@ -1638,7 +3737,9 @@ class HelloTriangleApp{
         return image_view;
     } 
     void create_texture_image_view(){
-        texture_image_view_ = create_image_view(texture_image_, VK_FORMAT_R8G8B8A8_SRGB,VK_IMAGE_ASPECT_COLOR_BIT,mip_levels_);
+        // A streamed texture's view starts at the finest level uploaded so far.
+        uint32_t base_level = config_.stream_textures ? texture_stream_.uploaded_level_ : 0;
+        texture_image_view_ = create_image_view(texture_image_, texture_format_,VK_IMAGE_ASPECT_COLOR_BIT,mip_levels_ - base_level, base_level);
     }
 
     void create_texture_sampler(){
@@ -1667,7 +3768,8 @@ class HelloTriangleApp{
         sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
         sampler_info.mipLodBias = 0.0f;
         sampler_info.minLod = 0.0f;
-        sampler_info.maxLod = static_cast<float>(mip_levels_);
+        // Material textures have their own level counts, their views already end at the last one.
+        sampler_info.maxLod = material_draws() ? VK_LOD_CLAMP_NONE : static_cast<float>(mip_levels_);
 
         if(vkCreateSampler(device_, &sampler_info, nullptr, &texture_sampler_) != VK_SUCCESS){
             throw std::runtime_error{"failed to create texture sampler."};
@@ -1709,44 +3811,752 @@ class HelloTriangleApp{
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
 
+    // Maps the cached mesh of the OBJ when there is one, otherwise parses the OBJ and writes the cache.
     void load_model(){
+        // The mesh cache keeps no material ids and obj_parser.h skips usemtl, a model with materials is
+        // parsed with tinyobj every time.
+        if(config_.materials){
+            std::cout << std::format("--materials: parsing {} with tinyobj, the mesh cache and obj_parser.h are skipped.\n", MODEL_PATH);
+            load_obj_model(false);
+            return;
+        }
+        auto source_hash = content_hash(Mapped_file{MODEL_PATH}.bytes());
+        auto cache_path = mesh_cache_path(source_hash);
+        if(!cache_path.empty() && map_mesh_cache(cache_path, source_hash)){
+            return;
+        }
+        parse_model();
+        if(!cache_path.empty()){
+            write_mesh_cache(cache_path, source_hash);
+        }
+    }
+
+    // What the mesh cache holds: the OBJ parsed with the configured parser, optimized if configured.
+    void parse_model(){
+        load_obj_model(config_.parallel_obj_parser);
+        if(config_.optimize_mesh){
+            optimize_model();
+        }
+    }
+
+    // Flags of the model parse_model() built.
+    uint32_t mesh_cache_flags() const{
+        uint32_t flags = config_.optimize_mesh ? Mesh_cache_file_header::FLAG_OPTIMIZED : 0;
+        if(model_from_tinyobj_){
+            flags |= Mesh_cache_file_header::FLAG_TINYOBJ;
+        }
+        if(obj_parser_fell_back_){
+            flags |= Mesh_cache_file_header::FLAG_OBJ_PARSER_REJECTED;
+        }
+        return flags;
+    }
+
+    // Whether a cache with flags holds what parse_model() would build with this config.
+    bool mesh_cache_flags_match(uint32_t flags) const{
+        using Header = Mesh_cache_file_header;
+        if(((flags & Header::FLAG_OPTIMIZED) != 0) != config_.optimize_mesh){
+            return false;
+        }
+        if(flags & Header::FLAG_OBJ_PARSER_REJECTED){
+            return (flags & Header::FLAG_TINYOBJ) != 0;
+        }
+        return ((flags & Header::FLAG_TINYOBJ) != 0) != config_.parallel_obj_parser;
+    }
+
+    // Tipsify order, overdraw sorted clusters, then vertices renumbered in first use order.
+    void optimize_model(){
+        auto start_time = std::chrono::steady_clock::now();
+        auto before = analyze_vertex_cache(indices_, vertices_.size());
+        auto clusters = optimize_vertex_cache(indices_, vertices_.size());
+        optimize_overdraw(indices_, clusters, [&](uint32_t vertex){
+            const auto& position = vertices_[vertex].pos_;
+            return std::array<float, 3>{position.x, position.y, position.z};
+        });
+        apply_vertex_remap(vertices_, indices_, vertex_fetch_remap(indices_, vertices_.size()));
+        auto after = analyze_vertex_cache(indices_, vertices_.size());
+        model_vertices_ = vertices_;
+        model_indices_ = indices_;
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("mesh optimization: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, {} clusters, {:.1f} ms.\n",
+            before.acmr_, after.acmr_, before.atvr_, after.atvr_, clusters.size(), duration);
+    }
+
+    std::filesystem::path mesh_cache_path(uint64_t source_hash) const{
+        if(config_.mesh_cache_directory.empty()){
+            return {};
+        }
+        return std::filesystem::path{config_.mesh_cache_directory} / std::format("{:016x}.mesh", source_hash);
+    }
+
+    // Points model_vertices_/model_indices_ into the mapped file, nothing is parsed or copied.
+    bool map_mesh_cache(const std::filesystem::path& path, uint64_t source_hash){
+        std::error_code error;
+        if(!std::filesystem::is_regular_file(path, error)){
+            return false;
+        }
+        Mapped_file file{path};
+        auto bytes = file.bytes();
+        Mesh_cache_file_header header{};
+        if(bytes.size() < sizeof(header)){
+            return false;
+        }
+        memcpy(&header, bytes.data(), sizeof(header));
+        // Counts are bounded by the file size before they are multiplied, a corrupt count can't wrap around.
+        const auto payload_bytes = bytes.size() - sizeof(header);
+        const bool counts_fit = header.vertex_count_ <= payload_bytes / sizeof(Vertex) &&
+            header.index_count_ <= (payload_bytes - header.vertex_count_ * sizeof(Vertex)) / sizeof(uint32_t);
+        if(header.magic_ != Mesh_cache_file_header::MAGIC || header.version_ != Mesh_cache_file_header::VERSION ||
+            header.vertex_size_ != sizeof(Vertex) || header.index_size_ != sizeof(uint32_t) || !mesh_cache_flags_match(header.flags_) ||
+            header.source_hash_ != source_hash || !counts_fit ||
+            payload_bytes != header.vertex_count_ * sizeof(Vertex) + header.index_count_ * sizeof(uint32_t)){
+            std::cerr << std::format("ignoring stale or corrupt mesh cache {}\n", path.string());
+            return false;
+        }
+        const auto vertex_bytes = header.vertex_count_ * sizeof(Vertex);
+
+        // The header keeps both arrays 4 byte aligned within the page aligned mapping.
+        auto vertices = bytes.data() + sizeof(header);
+        model_vertices_ = {reinterpret_cast<const Vertex*>(vertices), static_cast<size_t>(header.vertex_count_)};
+        model_indices_ = {reinterpret_cast<const uint32_t*>(vertices + vertex_bytes), static_cast<size_t>(header.index_count_)};
+        mesh_cache_file_ = std::move(file);
+        return true;
+    }
+
+    void write_mesh_cache(const std::filesystem::path& path, uint64_t source_hash){
+        Mesh_cache_file_header header{};
+        header.magic_ = Mesh_cache_file_header::MAGIC;
+        header.version_ = Mesh_cache_file_header::VERSION;
+        header.vertex_size_ = sizeof(Vertex);
+        header.index_size_ = sizeof(uint32_t);
+        header.flags_ = mesh_cache_flags();
+        header.source_hash_ = source_hash;
+        header.vertex_count_ = model_vertices_.size();
+        header.index_count_ = model_indices_.size();
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+        write_file_atomically(path, {std::as_bytes(std::span{&header, 1}), std::as_bytes(model_vertices_), std::as_bytes(model_indices_)});
+    }
+
+    // Cold: hash + OBJ parse (tinyobj and obj_parser.h) + deduplication. Warm: hash + mapping the
+    // cache and touching every page.
+    void benchmark_model_loading(){
+        constexpr int ITERATIONS = 5;
+        auto source_hash = content_hash(Mapped_file{MODEL_PATH}.bytes());
+        auto cache_path = mesh_cache_path(source_hash);
+        if(cache_path.empty()){
+            throw std::runtime_error{"the mesh load benchmark needs a mesh cache directory."};
+        }
+
+        auto reset_model = [&]{
+            vertices_.clear();
+            indices_.clear();
+            model_vertices_ = {};
+            model_indices_ = {};
+            mesh_cache_file_.close();
+        };
+        double tinyobj_ms{};
+        double parallel_ms{};
+        for(int i = 0; i < ITERATIONS; i++){
+            reset_model();
+            tinyobj_ms += time_ms([&]{
+                content_hash(Mapped_file{MODEL_PATH}.bytes());
+                load_obj_model(false);
+            });
+            reset_model();
+            parallel_ms += time_ms([&]{
+                content_hash(Mapped_file{MODEL_PATH}.bytes());
+                load_obj_model(true);
+            });
+        }
+        const bool fell_back = obj_parser_fell_back_;
+        reset_model();
+        parse_model();
+        write_mesh_cache(cache_path, source_hash);
+
+        double warm_ms{};
+        uint64_t checksum{};
+        for(int i = 0; i < ITERATIONS; i++){
+            reset_model();
+            warm_ms += time_ms([&]{
+                if(!map_mesh_cache(cache_path, content_hash(Mapped_file{MODEL_PATH}.bytes()))){
+                    throw std::runtime_error{"failed to load the mesh cache just written."};
+                }
+                // Fault the pages in, the upload would do the same.
+                checksum += content_hash(mesh_cache_file_.bytes());
+            });
+        }
+        std::cout << std::format("model load ({} vertices, {} indices): tinyobj {:.2f} ms, parallel obj {:.2f} ms{}, cache {:.2f} ms (checksum {:x}).\n",
+            model_vertices_.size(), model_indices_.size(), tinyobj_ms / ITERATIONS, parallel_ms / ITERATIONS,
+            fell_back ? " (fell back to tinyobj)" : "", warm_ms / ITERATIONS, checksum);
+    }
+
+    // Packs the model, checks every component against its bound of half a quantization step (plus the
+    // float rounding of the decode) and prints the vertex buffer size of both layouts.
+    void benchmark_vertex_format(){
+        load_model();
+        auto dequantization = compute_vertex_dequantization(model_vertices_);
+        std::array<float, 5> scales{dequantization.position_scale_.x, dequantization.position_scale_.y, dequantization.position_scale_.z,
+            dequantization.tex_coord_scale_offset_.x, dequantization.tex_coord_scale_offset_.y};
+        std::array<float, 5> offsets{dequantization.position_offset_.x, dequantization.position_offset_.y, dequantization.position_offset_.z,
+            dequantization.tex_coord_scale_offset_.z, dequantization.tex_coord_scale_offset_.w};
+        std::array<double, 5> bounds{};
+        for(size_t i = 0; i < bounds.size(); i++){
+            auto magnitude = std::max(std::abs(offsets[i]), std::abs(offsets[i] + scales[i]));
+            bounds[i] = 0.5 * scales[i] / 65535.0 + 4.0 * std::numeric_limits<float>::epsilon() * magnitude;
+        }
+
+        std::array<double, 5> max_errors{};
+        size_t violations{};
+        for(const auto& vertex: model_vertices_){
+            auto unpacked = unpack_vertex(pack_vertex(vertex, dequantization), dequantization);
+            std::array<float, 5> original{vertex.pos_.x, vertex.pos_.y, vertex.pos_.z, vertex.tex_coord_.x, vertex.tex_coord_.y};
+            std::array<float, 5> decoded{unpacked.pos_.x, unpacked.pos_.y, unpacked.pos_.z, unpacked.tex_coord_.x, unpacked.tex_coord_.y};
+            for(size_t i = 0; i < bounds.size(); i++){
+                double error = std::abs(static_cast<double>(decoded[i]) - original[i]);
+                max_errors[i] = std::max(max_errors[i], error);
+                violations += error > bounds[i];
+            }
+        }
+
+        auto float_bytes = model_vertices_.size() * sizeof(Vertex);
+        auto packed_bytes = model_vertices_.size() * sizeof(Packed_vertex);
+        std::cout << std::format("vertex format ({} vertices): Vertex {} B = {:.2f} MiB, Packed_vertex {} B = {:.2f} MiB ({:.1f}%), built for {}.\n",
+            model_vertices_.size(), sizeof(Vertex), float_bytes / 1048576.0, sizeof(Packed_vertex), packed_bytes / 1048576.0,
+            float_bytes ? 100.0 * packed_bytes / float_bytes : 0.0, PACKED_VERTICES ? "Packed_vertex" : "Vertex");
+        std::cout << std::format("max error: position {:.3g} {:.3g} {:.3g} (bound {:.3g} {:.3g} {:.3g}), uv {:.3g} {:.3g} (bound {:.3g} {:.3g}).\n",
+            max_errors[0], max_errors[1], max_errors[2], bounds[0], bounds[1], bounds[2], max_errors[3], max_errors[4], bounds[3], bounds[4]);
+        if(violations > 0){
+            throw std::runtime_error{std::format("{} quantized components exceed the error bound.", violations)};
+        }
+    }
+
+    void load_obj_model(bool parallel_parser){
+        Worker_pool pool{load_thread_count()};
+        model_from_tinyobj_ = true;
+        obj_parser_fell_back_ = false;
+        if(parallel_parser){
+            Mapped_file file{MODEL_PATH};
+            if(auto mesh = parse_obj(file.bytes(), pool)){
+                model_from_tinyobj_ = false;
+                auto corner = [&](size_t c){
+                    auto [position, texcoord] = mesh->corners_[c];
+                    return make_obj_vertex(&mesh->positions_[3 * size_t{position}],
+                        texcoord == OBJ_NO_TEXCOORD ? nullptr : &mesh->texcoords_[2 * size_t{texcoord}]);
+                };
+                weld_model(mesh->corners_.size(), corner, pool);
+                return;
+            }
+            obj_parser_fell_back_ = true;
+            std::cout << std::format("{} is malformed or has out of range indices, trying tinyobj.\n", MODEL_PATH);
+        }
+
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
         std::string warn,err;
 
-        if(!tinyobj::LoadObj(&attrib, &shapes,&materials, &warn,&err,MODEL_PATH.c_str())){
+        // Material libraries are looked up next to the OBJ, only when they are used.
+        auto model_directory = std::filesystem::path{MODEL_PATH}.parent_path();
+        auto mtl_directory = model_directory.empty() ? std::string{} : model_directory.string() + "/";
+        if(!tinyobj::LoadObj(&attrib, &shapes,&materials, &warn,&err,MODEL_PATH.c_str(),
+            config_.materials && !mtl_directory.empty() ? mtl_directory.c_str() : nullptr)){
             throw std::runtime_error{warn + err};
         }
 
-        std::unordered_map<Vertex, uint32_t> unique_vertices{};
+        // The corners of all shapes in file order share one vertex array.
+        std::vector<size_t> shape_ends;
+        size_t corner_count{};
+        for(const auto& shape: shapes){
+            corner_count += shape.mesh.indices.size();
+            shape_ends.push_back(corner_count);
+        }
+        auto corner = [&](size_t c){
+            auto shape = static_cast<size_t>(std::upper_bound(shape_ends.begin(), shape_ends.end(), c) - shape_ends.begin());
+            auto first = shape == 0 ? 0 : shape_ends[shape - 1];
+            const auto& index = shapes[shape].mesh.indices[c - first];
+            return make_obj_vertex(&attrib.vertices[3 * static_cast<size_t>(index.vertex_index)],
+                index.texcoord_index < 0 ? nullptr : &attrib.texcoords[2 * static_cast<size_t>(index.texcoord_index)]);
+        };
+        weld_model(corner_count, corner, pool);
+        if(config_.materials){
+            group_triangles_by_material(shapes, materials);
+        }
+    }
+
+    // weld_model() keeps the corner order, so triangle t of indices_ is face t of the shapes in file order.
+    // Materials without a diffuse texture sample the app's texture in slot 0, materials sharing a texture
+    // share a slot. The triangles are reordered so every slot's are contiguous.
+    void group_triangles_by_material(const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials){
+        const auto model_directory = std::filesystem::path{MODEL_PATH}.parent_path();
+        std::unordered_map<std::string, uint32_t> texture_slots;
+        std::vector<uint32_t> material_slots(materials.size());
+        for(size_t m = 0; m < materials.size(); m++){
+            if(materials[m].diffuse_texname.empty()){
+                continue;
+            }
+            auto path = (model_directory / materials[m].diffuse_texname).string();
+            auto [slot, inserted] = texture_slots.try_emplace(path, static_cast<uint32_t>(material_texture_paths_.size() + 1));
+            if(inserted){
+                material_texture_paths_.push_back(path);
+            }
+            material_slots[m] = slot->second;
+        }
 
+        std::vector<uint32_t> triangle_slots;
+        triangle_slots.reserve(indices_.size() / 3);
         for(const auto& shape: shapes){
-            for(const auto& index: shape.mesh.indices){
-                Vertex vertex{};
+            for(int material: shape.mesh.material_ids){
+                triangle_slots.push_back(material >= 0 && static_cast<size_t>(material) < materials.size() ? material_slots[material] : 0);
+            }
+        }
+        if(triangle_slots.size() != indices_.size() / 3){
+            throw std::runtime_error{std::format("{} has {} material ids for {} triangles.", MODEL_PATH, triangle_slots.size(), indices_.size() / 3)};
+        }
 
-                vertex.pos_ = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
+        material_triangle_counts_ = sort_triangles_by_slot(indices_, triangle_slots, material_texture_paths_.size() + 1);
+        model_indices_ = indices_;
+    }
 
-                vertex.tex_coord_ = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                }; 
+    // Bindless alone draws the whole model as material 0 through the texture array.
+    bool material_draws() const{
+        return config_.materials || config_.synthetic_materials > 0 || config_.bindless_materials;
+    }
 
-                vertex.color_ = {1.0f,1.0f,1.0f};
+    // One draw per material slot with triangles, in slot order. Synthetic materials cut the model into even
+    // ranges instead, and without either the whole model is slot 0.
+    std::vector<Draw_command> make_material_draws() const{
+        if(config_.synthetic_materials > 0 || material_triangle_counts_.empty()){
+            auto draws = split_into_draws(full_detail_index_count(), std::max(config_.synthetic_materials, 1u), config_.instance_count);
+            for(uint32_t i = 0; i < draws.size(); i++){
+                draws[i].material_ = i;
+            }
+            return draws;
+        }
+        std::vector<Draw_command> draws;
+        uint32_t first_index{};
+        for(uint32_t slot = 0; slot < material_triangle_counts_.size(); slot++){
+            if(material_triangle_counts_[slot] == 0){
+                continue;
+            }
+            draws.push_back({first_index, material_triangle_counts_[slot] * 3, 0, 0, config_.instance_count, slot});
+            first_index += material_triangle_counts_[slot] * 3;
+        }
+        return draws;
+    }
 
-                if(unique_vertices.count(vertex) == 0){
-                    unique_vertices[vertex] = static_cast<uint32_t>(unique_vertices.size());
-                    vertices_.push_back(vertex);
-                }
-                indices_.push_back(unique_vertices[vertex]);
+    // Slot 0 is the app's texture, then one per diffuse texture of the material library. Synthetic materials
+    // all view the app's texture, each slot is still its own descriptor.
+    void create_material_textures(){
+        auto start_time = std::chrono::steady_clock::now();
+        material_views_.assign(std::max(config_.synthetic_materials, 1u), texture_image_view_);
+        if(!material_texture_paths_.empty()){
+            Worker_pool pool{load_thread_count()};
+            for(const auto& path: material_texture_paths_){
+                material_views_.push_back(load_material_texture(path, pool));
+            }
+        }
+        if(config_.bindless_materials && material_views_.size() > material_capacity_){
+            throw std::runtime_error{std::format("{} material textures exceed the bindless array of {}.", material_views_.size(), material_capacity_)};
+        }
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("materials: {} draws over {} texture slots, {} loaded in {:.1f} ms, {}.\n", draw_commands_.size(), material_views_.size(),
+            material_textures_.size(), duration, config_.bindless_materials ? "bindless" : "a descriptor set per material");
+    }
+
+    // RGBA8 with CPU mips, like create_texture_image_with_cpu_mips() without the cache. A texture that doesn't
+    // load falls back to the app's texture.
+    VkImageView load_material_texture(const std::string& path, Worker_pool& pool){
+        int tex_width{};
+        int tex_height{};
+        int tex_channels{};
+        stbi_uc* pixels = stbi_load(path.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
+        if(!pixels){
+            std::cerr << std::format("failed to load material texture {}, using the default texture.\n", path);
+            return texture_image_view_;
+        }
+        auto chain = generate_mip_chain({pixels, static_cast<size_t>(tex_width) * tex_height * 4}, static_cast<uint32_t>(tex_width),
+            static_cast<uint32_t>(tex_height), &pool);
+        stbi_image_free(pixels);
+
+        VkBuffer staging_buffer;
+        Allocation staging_buffer_memory;
+        create_buffer(chain.pixels_.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+        memcpy(staging_buffer_memory.mapped_, chain.pixels_.data(), chain.pixels_.size());
+
+        Material_texture texture{};
+        create_image_from_levels(VK_FORMAT_R8G8B8A8_SRGB, staging_buffer, staging_buffer_memory, chain.levels_, texture.image_, texture.memory_);
+        texture.view_ = create_image_view(texture.image_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, static_cast<uint32_t>(chain.levels_.size()));
+        material_textures_.push_back(texture);
+        return texture.view_;
+    }
+
+    // indices_[c] is the vertex of corner(c) on both paths, nothing is reordered or dropped: triangle t is
+    // corners 3t .. 3t + 2. group_triangles_by_material() relies on it.
+    template<typename Corner>
+    void weld_model(size_t corner_count, const Corner& corner, Worker_pool& pool){
+        if(corner_count >= PARALLEL_WELD_MIN_CORNERS && pool.size() > 1){
+            weld_vertices_parallel<Vertex, Vertex_hash>(corner_count, corner, pool, vertices_, indices_);
+        }else{
+            weld_vertices<Vertex, Vertex_hash>(corner_count, corner, vertices_, indices_);
+        }
+        model_vertices_ = vertices_;
+        model_indices_ = indices_;
+    }
+
+    // texcoord is null for a corner without one, which then gets uv 0,0.
+    static Vertex make_obj_vertex(const float* position, const float* texcoord){
+        Vertex vertex{};
+
+        vertex.pos_ = {position[0], position[1], position[2]};
+        vertex.tex_coord_ = texcoord ? glm::vec2{texcoord[0], 1.0f - texcoord[1]} : glm::vec2{0.0f, 1.0f};
+        vertex.color_ = {1.0f,1.0f,1.0f};
+        return vertex;
+    }
+
+    size_t load_thread_count() const{
+        return ::load_thread_count(config_);
+    }
+
+    void compute_model_bounding_sphere(){
+        glm::vec3 min_position{std::numeric_limits<float>::max()};
+        glm::vec3 max_position{std::numeric_limits<float>::lowest()};
+        for(const auto& vertex: model_vertices_){
+            min_position = glm::min(min_position, vertex.pos_);
+            max_position = glm::max(max_position, vertex.pos_);
+        }
+        auto center = (min_position + max_position) * 0.5f;
+        float radius{};
+        for(const auto& vertex: model_vertices_){
+            radius = std::max(radius, glm::length(vertex.pos_ - center));
+        }
+        model_bounding_sphere_ = glm::vec4(center, radius);
+    }
+
+    // Per frame slot: compacted draw list, its count (host visible for statistics) and a descriptor set.
+    // Culls instances, or with meshlets the meshlets of the single instance.
+    void create_culling_resources(){
+        VkDeviceSize draws_size = sizeof(VkDrawIndexedIndirectCommand) * cull_object_count();
+        indirect_buffers_.resize(frames_in_flight_);
+        indirect_buffers_memory_.resize(frames_in_flight_);
+        draw_count_buffers_.resize(frames_in_flight_);
+        draw_count_buffers_memory_.resize(frames_in_flight_);
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            create_buffer(draws_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirect_buffers_[i], indirect_buffers_memory_[i]);
+            create_buffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, draw_count_buffers_[i], draw_count_buffers_memory_[i]);
+        }
+        if(config_.meshlets){
+            create_meshlet_buffer();
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for(uint32_t i = 0; i < bindings.size(); i++){
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+        if(vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &cull_descriptor_set_layout_) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create cull descriptor set layout."};
+        }
+
+        std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        pool_sizes[0].descriptorCount = static_cast<uint32_t>(frames_in_flight_);
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[1].descriptorCount = static_cast<uint32_t>(frames_in_flight_ * 3);
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes = pool_sizes.data();
+        pool_info.maxSets = static_cast<uint32_t>(frames_in_flight_);
+        if(vkCreateDescriptorPool(device_, &pool_info, nullptr, &cull_descriptor_pool_) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create cull descriptor pool."};
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(frames_in_flight_, cull_descriptor_set_layout_);
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = cull_descriptor_pool_;
+        alloc_info.descriptorSetCount = static_cast<uint32_t>(frames_in_flight_);
+        alloc_info.pSetLayouts = layouts.data();
+        cull_descriptor_sets_.resize(frames_in_flight_);
+        if(vkAllocateDescriptorSets(device_, &alloc_info, cull_descriptor_sets_.data()) != VK_SUCCESS){
+            throw std::runtime_error{"failed to allocate cull descriptor sets."};
+        }
+
+        for(size_t i = 0; i < frames_in_flight_; i++){
+            std::array<VkDescriptorBufferInfo, 4> buffer_infos{{
+                {uniform_buffers_[i], 0, sizeof(Uniform_buffer_object)},
+                {config_.meshlets ? meshlet_buffer_ : instance_buffers_[i], 0, VK_WHOLE_SIZE},
+                {indirect_buffers_[i], 0, VK_WHOLE_SIZE},
+                {draw_count_buffers_[i], 0, VK_WHOLE_SIZE},
+            }};
+            std::array<VkWriteDescriptorSet, 4> descriptor_writes{};
+            for(uint32_t binding = 0; binding < descriptor_writes.size(); binding++){
+                descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptor_writes[binding].dstSet = cull_descriptor_sets_[i];
+                descriptor_writes[binding].dstBinding = binding;
+                descriptor_writes[binding].descriptorType = bindings[binding].descriptorType;
+                descriptor_writes[binding].descriptorCount = 1;
+                descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+            }
+            vkUpdateDescriptorSets(device_, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+        }
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(Cull_push_constants);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &cull_descriptor_set_layout_;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+        if(vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &cull_pipeline_layout_) != VK_SUCCESS){
+            throw std::runtime_error{"failed to create cull pipeline layout."};
+        }
+
+        auto shader_module = create_shader_module(read_file(config_.meshlets ? "shaders/meshlet_cull.spv" : "shaders/cull.spv"));
+        VkComputePipelineCreateInfo pipeline_info{};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_info.stage.module = shader_module;
+        pipeline_info.stage.pName = "main";
+        pipeline_info.layout = cull_pipeline_layout_;
+        auto result = vkCreateComputePipelines(device_, pipeline_cache_, 1, &pipeline_info, nullptr, &cull_pipeline_);
+        vkDestroyShaderModule(device_, shader_module, nullptr);
+        if(result != VK_SUCCESS){
+            throw std::runtime_error{"failed to create cull pipeline."};
+        }
+
+        std::cout << std::format("gpu culling: {} {}, draws issued with {}.\n", cull_object_count(), config_.meshlets ? "meshlets" : "objects",
+            cmd_draw_indexed_indirect_count_ ? "vkCmdDrawIndexedIndirectCountKHR" : "vkCmdDrawIndexedIndirect");
+    }
+
+    void destroy_culling_resources(){
+        vkDestroyPipeline(device_, cull_pipeline_, nullptr);
+        vkDestroyPipelineLayout(device_, cull_pipeline_layout_, nullptr);
+        vkDestroyDescriptorPool(device_, cull_descriptor_pool_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, cull_descriptor_set_layout_, nullptr);
+        for(size_t i = 0; i < indirect_buffers_.size(); i++){
+            vkDestroyBuffer(device_, indirect_buffers_[i], nullptr);
+            allocator_.free(indirect_buffers_memory_[i]);
+            vkDestroyBuffer(device_, draw_count_buffers_[i], nullptr);
+            allocator_.free(draw_count_buffers_memory_[i]);
+        }
+        if(meshlet_buffer_){
+            vkDestroyBuffer(device_, meshlet_buffer_, nullptr);
+            allocator_.free(meshlet_buffer_memory_);
+        }
+    }
+
+    uint32_t cull_object_count() const{
+        return config_.meshlets ? static_cast<uint32_t>(meshlets_.size()) : config_.instance_count;
+    }
+
+    // Read by meshlet_cull.comp, static after load.
+    void create_meshlet_buffer(){
+        VkDeviceSize size = meshlets_.size() * sizeof(Meshlet);
+
+        VkBuffer staging_buffer;
+        Allocation staging_buffer_memory;
+        create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            staging_buffer, staging_buffer_memory);
+        memcpy(staging_buffer_memory.mapped_, meshlets_.data(), static_cast<size_t>(size));
+
+        create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            meshlet_buffer_, meshlet_buffer_memory_);
+        copy_buffer(staging_buffer, meshlet_buffer_, size);
+        release_staging_buffer(staging_buffer, staging_buffer_memory);
+    }
+
+    // Reorders the model's triangles into meshlets. A mapped mesh cache is copied first, the mapping is read-only.
+    void build_model_meshlets(){
+        auto start_time = std::chrono::steady_clock::now();
+        if(indices_.empty()){
+            indices_.assign(model_indices_.begin(), model_indices_.end());
+        }
+        meshlets_ = build_meshlets(indices_, model_vertices_.size(), [&](uint32_t vertex){
+            const auto& position = model_vertices_[vertex].pos_;
+            return std::array<float, 3>{position.x, position.y, position.z};
+        });
+        model_indices_ = indices_;
+
+        double vertex_sum{};
+        for(const auto& meshlet: meshlets_){
+            vertex_sum += meshlet.vertex_count_;
+        }
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::format("meshlets: {}, {:.1f} triangles and {:.1f} vertices each on average, built in {:.1f} ms.\n", meshlets_.size(),
+            meshlets_.empty() ? 0.0 : model_indices_.size() / 3.0 / meshlets_.size(), meshlets_.empty() ? 0.0 : vertex_sum / meshlets_.size(), duration);
+    }
+
+    // Index count of the model at full detail, model_indices_ also holds the coarser LODs after it.
+    size_t full_detail_index_count() const{
+        return model_lods_.empty() ? model_indices_.size() : model_lods_[0].index_count_;
+    }
+
+    // Appends the coarser LODs to the model's indices, so they share its vertex and index buffers.
+    // A mapped mesh cache is copied first, the mapping is read-only and only holds LOD 0.
+    void build_model_lods(){
+        auto start_time = std::chrono::steady_clock::now();
+        if(indices_.empty()){
+            indices_.assign(model_indices_.begin(), model_indices_.end());
+        }
+        auto position = [&](uint32_t vertex){
+            const auto& p = model_vertices_[vertex].pos_;
+            return std::array<float, 3>{p.x, p.y, p.z};
+        };
+        model_lods_ = build_lod_chain(indices_, model_vertices_.size(), position);
+        if(config_.optimize_mesh){
+            for(size_t lod = 1; lod < model_lods_.size(); lod++){
+                optimize_vertex_cache(std::span<uint32_t>{indices_}.subspan(model_lods_[lod].first_index_, model_lods_[lod].index_count_), model_vertices_.size());
+            }
+        }
+        model_indices_ = indices_;
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::string chain;
+        for(const auto& lod: model_lods_){
+            chain += std::format(" {}:{:.4g}", lod.index_count_ / 3, lod.error_);
+        }
+        std::cout << std::format("lods: {} built in {:.1f} ms, triangles:error{}.\n", model_lods_.size(), duration, chain);
+    }
+
+    // Gives every instance the coarsest LOD whose error projects to at most config_.lod_error_pixels, copies
+    // the instances into the frame's buffer grouped by LOD and makes one instanced draw per LOD in use.
+    void select_lods(uint32_t frame, const Uniform_buffer_object& ubo){
+        const uint32_t count = config_.instance_count;
+        auto model_view = ubo.view_ * ubo.model_;
+        // Pixels covered by one model unit at distance 1: proj_[1][1] is cot(fov / 2) over half the viewport height.
+        const float pixels_per_unit = std::abs(ubo.proj_[1][1]) * static_cast<float>(swap_chain_extent_.height) * 0.5f;
+        const glm::vec4 center{model_bounding_sphere_.x, model_bounding_sphere_.y, model_bounding_sphere_.z, 1.0f};
+
+        instance_lods_.resize(count);
+        lod_instance_offsets_.assign(model_lods_.size() + 1, 0);
+        for(uint32_t i = 0; i < count; i++){
+            const auto& model = unsorted_instances_[i].model_;
+            auto view_center = model_view * model * center;
+            auto scale = glm::length(glm::vec3{model[0].x, model[0].y, model[0].z});
+            // Distance to the closest point of the bounding sphere, errors there look the largest.
+            auto distance = std::max(glm::length(glm::vec3{view_center.x, view_center.y, view_center.z}) - model_bounding_sphere_.w * scale, NEAR_PLANE);
+            auto pixels_per_model_unit = scale * pixels_per_unit / distance;
+            uint32_t lod = 0;
+            while(lod + 1 < model_lods_.size() && model_lods_[lod + 1].error_ * pixels_per_model_unit <= config_.lod_error_pixels){
+                lod++;
+            }
+            instance_lods_[i] = lod;
+            lod_instance_offsets_[lod + 1]++;
+        }
+
+        draw_commands_.clear();
+        uint64_t triangles{};
+        for(size_t lod = 0; lod < model_lods_.size(); lod++){
+            auto lod_count = lod_instance_offsets_[lod + 1];
+            lod_instance_offsets_[lod + 1] += lod_instance_offsets_[lod];
+            if(lod_count > 0){
+                draw_commands_.push_back({model_lods_[lod].first_index_, model_lods_[lod].index_count_, 0, lod_instance_offsets_[lod], lod_count});
+                triangles += static_cast<uint64_t>(model_lods_[lod].index_count_ / 3) * lod_count;
+            }
+        }
+        auto* instances = static_cast<Instance_data*>(instance_buffers_memory_[frame].mapped_);
+        for(uint32_t i = 0; i < count; i++){
+            instances[lod_instance_offsets_[instance_lods_[i]]++] = unsorted_instances_[i];
+        }
+        lod_stats_.triangles_ += triangles;
+        lod_stats_.frames_++;
+    }
+
+    // CPU path: keeps the meshlets that intersect the frustum and have a triangle facing the camera,
+    // neighbours in the index list are merged into one draw.
+    void cull_meshlets(const Uniform_buffer_object& ubo){
+        // Culling happens in model space, the single instance has an identity transform.
+        auto model_view = ubo.view_ * ubo.model_;
+        auto planes = frustum_planes(ubo.proj_ * model_view);
+        auto camera_position = glm::inverse(model_view)[3];
+        std::array<float, 3> camera{camera_position.x, camera_position.y, camera_position.z};
+
+        draw_commands_.clear();
+        uint32_t visible{};
+        for(const auto& meshlet: meshlets_){
+            if(is_sphere_outside_frustum(meshlet.bounding_sphere_, planes) || is_meshlet_backfacing(meshlet, camera)){
+                continue;
+            }
+            visible++;
+            if(!draw_commands_.empty() && draw_commands_.back().first_index_ + draw_commands_.back().index_count_ == meshlet.first_index_){
+                draw_commands_.back().index_count_ += meshlet.index_count_;
+            }else{
+                draw_commands_.push_back({meshlet.first_index_, meshlet.index_count_, 0, 0, 1});
+            }
+        }
+        cull_stats_.visible_ += visible;
+        cull_stats_.frames_++;
+    }
+
+    void record_culling(VkCommandBuffer command_buffer, uint32_t frame){
+        vkCmdFillBuffer(command_buffer, draw_count_buffers_[frame], 0, sizeof(uint32_t), 0);
+        if(!cmd_draw_indexed_indirect_count_){
+            // Without a GPU side count the tail past the survivors must be empty draws.
+            vkCmdFillBuffer(command_buffer, indirect_buffers_[frame], 0, VK_WHOLE_SIZE, 0);
+        }
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        Cull_push_constants push_constants{};
+        push_constants.bounding_sphere_ = model_bounding_sphere_;
+        push_constants.object_count_ = cull_object_count();
+        push_constants.index_count_ = static_cast<uint32_t>(full_detail_index_count());
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_, 0, 1, &cull_descriptor_sets_[frame], 0, nullptr);
+        vkCmdPushConstants(command_buffer, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, (cull_object_count() + 63) / 64, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void record_indirect_draws(VkCommandBuffer command_buffer, uint32_t frame){
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        const uint32_t max_draws = cull_object_count();
+        if(cmd_draw_indexed_indirect_count_){
+            cmd_draw_indexed_indirect_count_(command_buffer, indirect_buffers_[frame], 0, draw_count_buffers_[frame], 0, max_draws, stride);
+        }else if(multi_draw_indirect_){
+            vkCmdDrawIndexedIndirect(command_buffer, indirect_buffers_[frame], 0, max_draws, stride);
+        }else{
+            for(uint32_t i = 0; i < max_draws; i++){
+                vkCmdDrawIndexedIndirect(command_buffer, indirect_buffers_[frame], VkDeviceSize{i} * stride, 1, stride);
             }
         }
     }
 
+    void collect_cull_stats(uint32_t frame){
+        if(!cull_result_pending_[frame]){
+            return;
+        }
+        cull_result_pending_[frame] = false;
+        cull_stats_.visible_ += *static_cast<const uint32_t*>(draw_count_buffers_memory_[frame].mapped_);
+        cull_stats_.frames_++;
+    }
+
     void generate_mipmaps(VkImage image, VkFormat image_format, uint32_t tex_width, uint32_t tex_height, uint32_t mip_levels){
         // Check if image suport linear blitting.
         VkFormatProperties format_properties{};
@@ -1879,26 +4689,20 @@ class HelloTriangleApp{
 
         return buffer;
     }
-    static void showFPS(GLFWwindow *pWindow)
-    {
-        // Measure speed
-        double currentTime = glfwGetTime();
-        static double lastTime{};
-        static uint64_t nbFrames{};
-        double delta = currentTime - lastTime;
-        nbFrames++;
-        if ( delta >= 1.0 ){ // If last cout was more than 1 sec ago
-          
+    // Window title summary, percentiles are reported by frame_profiler_ at exit.
+    void show_frame_stats(){
+        double current_time = glfwGetTime();
+        double delta = current_time - title_stats_.last_update_;
+        title_stats_.frames_++;
+        title_stats_.worst_ms_ = std::max(title_stats_.worst_ms_, frame_profiler_.last_frame_ms());
+        if(delta >= 1.0){ // If last update was more than 1 sec ago
+            double fps = double(title_stats_.frames_) / delta;
 
-            double fps = double(nbFrames) / delta;
+            auto str = std::format(" [{:.1f} FPS, worst {:.2f} ms]", fps, title_stats_.worst_ms_);
 
-          
-            auto str = std::format(" [{} FPS]",fps);
+            glfwSetWindowTitle(window_, str.c_str());
 
-            glfwSetWindowTitle(pWindow, str.c_str());
-
-            nbFrames = 0;
-            lastTime = currentTime;
+            title_stats_ = {current_time};
         }
     }
     static void framebuffer_resize_callback(GLFWwindow* window,int width,int height){
@@ -1927,17 +4731,38 @@ class HelloTriangleApp{
 
     VkPhysicalDevice physical_device_ {VK_NULL_HANDLE};
     VkDevice device_{};
+    Device_memory_allocator allocator_;
+    Upload_batch open_upload_batch_{};
+    Upload_batch open_transfer_batch_{};
+    std::vector<Upload_batch> submitted_upload_batches_;
+    Upload_stats upload_stats_{};
     VkQueue graphics_queue_{};
     VkQueue present_queue_{};
-
-    const std::vector<const char*> device_extensions_ = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    VkQueue transfer_queue_{};
+    Queue_family_indices queue_family_indices_{};
+
+    std::vector<const char*> device_extensions_;
+    VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+    // VK_KHR_present_id + VK_KHR_present_wait are enabled.
+    bool present_wait_ = false;
+    PFN_vkWaitForPresentKHR wait_for_present_{};
+    struct Pending_present{
+        uint64_t present_id_;
+        std::chrono::steady_clock::time_point acquire_time_;
+    };
+    std::deque<Pending_present> pending_presents_;
+    std::chrono::steady_clock::time_point acquire_time_{};
+    std::vector<double> present_latencies_ms_;
+    App_config config_;
 
     uint32_t width_{};
     uint32_t height_{};
     uint32_t current_frame_{};
     const float queue_priority_ = 1.0f;
-    VkSwapchainKHR swap_chain_;
+    VkSwapchainKHR swap_chain_{};
     std::vector<VkImage> swap_chain_images_;
+    // Backing memory of swap_chain_images_ in headless mode.
+    std::vector<Allocation> offscreen_images_memory_;
     std::vector<VkImageView> swap_chain_image_views_;
     VkFormat swap_chain_image_format_;
     VkExtent2D swap_chain_extent_;
@@ -1945,45 +4770,142 @@ class HelloTriangleApp{
     VkDescriptorSetLayout descriptor_set_layout_;
     VkPipelineLayout pipeline_layout_;
     VkPipeline graphics_pipeline_;
+    // Position-only pipeline of the depth prepass, null without one.
+    VkPipeline depth_prepass_pipeline_{};
+    VkPipelineCache pipeline_cache_{};
+    bool pipeline_cache_loaded_ = false;
 
     std::vector<VkFramebuffer> swap_chain_frame_buffers_;
     VkCommandPool command_pool_;
+    VkCommandPool transfer_command_pool_{};
     std::vector<VkCommandBuffer> command_buffers_;
+    std::vector<VkCommandBuffer> static_command_buffers_;
+    std::unique_ptr<Worker_pool> worker_pool_;
+    std::vector<std::vector<VkCommandPool>> record_pools_;
+    std::vector<std::vector<VkCommandBuffer>> secondary_command_buffers_;
+    std::vector<Draw_command> draw_commands_;
+    bool static_command_buffers_dirty_ = true;
 
     // synchronization
     std::vector<VkSemaphore> image_available_semaphores_;
     std::vector<VkSemaphore> render_finish_semaphores_;
-    std::vector<VkFence> in_flight_fences_;
-
+    uint32_t frames_in_flight_ = DEFAULT_FRAMES_IN_FLIGHT;
+    VkSemaphore graphics_timeline_{};
+    VkSemaphore transfer_timeline_{};
+    // Last value handed out, shared by every queue.
+    uint64_t timeline_value_{};
+    // Value signaled by the last submission of each frame slot.
+    std::vector<uint64_t> frame_timeline_values_;
+
+    // Filled by the OBJ path only.
     std::vector<Vertex> vertices_;
     std::vector<uint32_t> indices_;
+    // The model's final vertex and index arrays, in vertices_/indices_ or in mesh_cache_file_.
+    std::span<const Vertex> model_vertices_;
+    std::span<const uint32_t> model_indices_;
+    Mapped_file mesh_cache_file_;
+    // The last OBJ load asked for obj_parser.h but had to use tinyobj.
+    bool obj_parser_fell_back_ = false;
+    // The last OBJ load used tinyobj, asked for or as the fallback.
+    bool model_from_tinyobj_ = false;
     VkBuffer vertex_buffer_;
-    VkDeviceMemory vertex_buffer_memory_;
+    Allocation vertex_buffer_memory_;
+    // Start of the attribute stream in vertex_buffer_ when the streams are split.
+    VkDeviceSize vertex_attribute_offset_{};
     VkBuffer index_buffer_;
-    VkDeviceMemory index_buffer_memory_;
+    Allocation index_buffer_memory_;
 
     std::vector<VkBuffer> uniform_buffers_;
-    std::vector<VkDeviceMemory> uniform_buffers_memory_;
+    std::vector<Allocation> uniform_buffers_memory_;
     std::vector<void*> uniform_buffers_mapped_{};
+    std::vector<VkBuffer> instance_buffers_;
+    std::vector<Allocation> instance_buffers_memory_;
+
+    glm::vec4 model_bounding_sphere_{};
+    // Clusters of model_indices_ when config_.meshlets is set.
+    std::vector<Meshlet> meshlets_;
+    VkBuffer meshlet_buffer_{};
+    Allocation meshlet_buffer_memory_{};
+    // Push constant of the packed vertex shader, unused with the float layout.
+    Vertex_dequantization vertex_dequantization_{};
+    VkDescriptorSetLayout cull_descriptor_set_layout_{};
+    VkDescriptorPool cull_descriptor_pool_{};
+    std::vector<VkDescriptorSet> cull_descriptor_sets_;
+    VkPipelineLayout cull_pipeline_layout_{};
+    VkPipeline cull_pipeline_{};
+    std::vector<VkBuffer> indirect_buffers_;
+    std::vector<Allocation> indirect_buffers_memory_;
+    std::vector<VkBuffer> draw_count_buffers_;
+    std::vector<Allocation> draw_count_buffers_memory_;
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count_{};
+    bool multi_draw_indirect_ = false;
+    bool texture_compression_bc_ = false;
+    std::vector<bool> cull_result_pending_;
+    struct{
+        uint64_t frames_{};
+        uint64_t visible_{};
+    } cull_stats_;
+    // Ranges of model_indices_ from full detail to coarsest when config_.lods is set, LOD 0 is the model itself.
+    std::vector<Mesh_lod> model_lods_;
+    // This frame's instances before select_lods() groups them by LOD.
+    std::vector<Instance_data> unsorted_instances_;
+    std::vector<uint32_t> instance_lods_;
+    std::vector<uint32_t> lod_instance_offsets_;
+    struct{
+        uint64_t frames_{};
+        uint64_t triangles_{};
+    } lod_stats_;
 
     VkDescriptorPool descriptor_pool_;
     std::vector<VkDescriptorSet> descriptor_sets_;
+    // Without bindless, frame slot f's set for material m is material_descriptor_sets_[f * material_views_.size() + m].
+    std::vector<VkDescriptorSet> material_descriptor_sets_;
+    // Size of the bindless texture array, set with the device features.
+    uint32_t material_capacity_{};
+    // Diffuse textures of the material library in slot order from slot 1, and the triangles of each slot.
+    std::vector<std::string> material_texture_paths_;
+    std::vector<uint32_t> material_triangle_counts_;
+    std::vector<Material_texture> material_textures_;
+    // View of every texture slot, the app's texture where a material has none of its own.
+    std::vector<VkImageView> material_views_;
 
     uint32_t mip_levels_;
+    VkFormat texture_format_ = VK_FORMAT_R8G8B8A8_SRGB;
+    Texture_stream texture_stream_;
     VkImage texture_image_;
-    VkDeviceMemory texture_image_memory_;
+    Allocation texture_image_memory_;
     VkImageView texture_image_view_;
     VkSampler texture_sampler_;
 
     VkImage depth_image_;
-    VkDeviceMemory depth_image_memory_;
+    Allocation depth_image_memory_;
     VkImageView depth_image_view_;
 
     VkSampleCountFlagBits msaa_samples_ = VK_SAMPLE_COUNT_1_BIT;
     VkImage color_image_;
-    VkDeviceMemory color_image_memory_;
+    Allocation color_image_memory_;
     VkImageView color_image_view_;
 
+    // Headless frame dumps, one readback buffer per frame in flight.
+    std::vector<VkBuffer> readback_buffers_;
+    std::vector<Allocation> readback_buffers_memory_;
+    std::vector<void*> readback_buffers_mapped_;
+    std::vector<std::optional<uint64_t>> pending_frame_dumps_;
+    uint64_t frame_number_{};
+    std::chrono::steady_clock::time_point start_time_{};
+    double first_frame_ms_ = -1.0;
+
+    Frame_profiler frame_profiler_;
+    VkQueryPool timestamp_query_pool_{};
+    uint32_t timestamp_valid_bits_{};
+    float timestamp_period_{};
+    // Frame number whose timestamps are pending in each query slot.
+    std::vector<std::optional<uint64_t>> gpu_timestamp_frames_;
+    struct{
+        double last_update_{};
+        uint64_t frames_{};
+        float worst_ms_{};
+    } title_stats_;
 
     bool framebuffer_resized_ = false;
 };
\ No newline at end of file
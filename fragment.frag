@@ -1,11 +1,24 @@
 #version 450
+#ifdef BINDLESS_MATERIALS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) out vec4 out_color;
 layout(location = 0) in vec3 frag_color;
 layout(location = 1) in vec2 frag_tex_coord;
 
+#ifdef BINDLESS_MATERIALS
+// Every material's texture, the draw picks one. Offset 64 is MATERIAL_PUSH_CONSTANT_OFFSET, after the vertex stage's constants.
+layout(binding = 3) uniform sampler2D material_textures[];
+layout(push_constant) uniform Material_constants{
+    layout(offset = 64) uint material_index_;
+} material;
+#define TEXTURE material_textures[material.material_index_]
+#else
 layout(binding = 1) uniform sampler2D tex_sampler;
+#define TEXTURE tex_sampler
+#endif
 
 void main(){
-    out_color = vec4(frag_color * texture(tex_sampler, frag_tex_coord).rgb, 1.0);
+    out_color = vec4(frag_color * texture(TEXTURE, frag_tex_coord).rgb, 1.0);
 }
\ No newline at end of file
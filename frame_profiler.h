@@ -0,0 +1,267 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "sformat.h"
+
+// CPU phases of draw_frame(), in execution order.
+enum class Frame_phase : uint32_t{
+    fence_wait,
+    acquire,
+    update_uniforms,
+    record,
+    submit,
+    present,
+    count,
+};
+constexpr size_t FRAME_PHASE_COUNT = static_cast<size_t>(Frame_phase::count);
+constexpr std::array<std::string_view, FRAME_PHASE_COUNT> FRAME_PHASE_NAMES{
+    "fence_wait", "acquire", "update_uniforms", "record", "submit", "present",
+};
+
+struct Frame_sample{
+    uint64_t frame_;
+    std::array<float, FRAME_PHASE_COUNT> phase_ms_;
+    float total_ms_;
+};
+
+// GPU time of a frame, arrives a few frames after its Frame_sample.
+struct Gpu_sample{
+    uint64_t frame_;
+    float gpu_ms_;
+};
+
+// Single producer ring buffer that keeps the newest Capacity entries.
+// push() never blocks or allocates, snapshot() may run on another thread and drops
+// entries the producer overwrote while they were being copied.
+template<typename T, size_t Capacity>
+class Ring_buffer{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two.");
+    public:
+    Ring_buffer():slots_(Capacity){}
+
+    void push(const T& value){
+        auto head = head_.load(std::memory_order_relaxed);
+        slots_[head & (Capacity - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    std::vector<T> snapshot() const{
+        auto head = head_.load(std::memory_order_acquire);
+        auto first = head > Capacity ? head - Capacity : 0;
+
+        std::vector<T> values;
+        values.reserve(head - first);
+        for(auto i = first; i < head; i++){
+            values.push_back(slots_[i & (Capacity - 1)]);
+        }
+
+        // Anything the producer lapped during the copy is unreliable.
+        auto new_head = head_.load(std::memory_order_acquire);
+        auto valid_first = new_head > Capacity ? new_head - Capacity : 0;
+        if(valid_first > first){
+            values.erase(values.begin(), values.begin() + static_cast<ptrdiff_t>(std::min(valid_first - first, values.size())));
+        }
+        return values;
+    }
+
+    uint64_t total_pushed() const{
+        return head_.load(std::memory_order_acquire);
+    }
+
+    private:
+    std::vector<T> slots_;
+    std::atomic<uint64_t> head_{};
+};
+
+struct Percentiles{
+    double p50_{};
+    double p95_{};
+    double p99_{};
+    double max_{};
+    double mean_{};
+};
+
+inline Percentiles compute_percentiles(std::vector<double> values){
+    Percentiles result{};
+    if(values.empty()){
+        return result;
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&](double q){
+        auto index = static_cast<size_t>(q * static_cast<double>(values.size() - 1) + 0.5);
+        return values[index];
+    };
+    result.p50_ = at(0.50);
+    result.p95_ = at(0.95);
+    result.p99_ = at(0.99);
+    result.max_ = values.back();
+    double sum{};
+    for(auto value: values){
+        sum += value;
+    }
+    result.mean_ = sum / static_cast<double>(values.size());
+    return result;
+}
+
+class Frame_profiler{
+    public:
+    using clock = std::chrono::steady_clock;
+    // ~18 minutes of history at 60 FPS.
+    static constexpr size_t HISTORY = 1 << 16;
+
+    void begin_frame(){
+        frame_start_ = clock::now();
+        last_mark_ = frame_start_;
+        current_.phase_ms_.fill(0.0f);
+    }
+
+    // Closes the phase that started at the previous mark.
+    void end_phase(Frame_phase phase){
+        auto now = clock::now();
+        current_.phase_ms_[static_cast<size_t>(phase)] += to_ms(now - last_mark_);
+        last_mark_ = now;
+    }
+
+    void end_frame(uint64_t frame){
+        current_.frame_ = frame;
+        current_.total_ms_ = to_ms(clock::now() - frame_start_);
+        samples_.push(current_);
+    }
+
+    void record_gpu_time(uint64_t frame, float gpu_ms){
+        gpu_samples_.push({frame, gpu_ms});
+    }
+
+    float last_frame_ms() const{
+        return current_.total_ms_;
+    }
+
+    std::vector<Frame_sample> samples() const{
+        return samples_.snapshot();
+    }
+
+    std::vector<Gpu_sample> gpu_samples() const{
+        return gpu_samples_.snapshot();
+    }
+
+    // Percentiles of every phase, the whole CPU frame and the GPU time.
+    std::array<Percentiles, FRAME_PHASE_COUNT + 2> summarize() const{
+        auto history = samples();
+        std::array<Percentiles, FRAME_PHASE_COUNT + 2> result{};
+        std::vector<double> values(history.size());
+        for(size_t phase = 0; phase <= FRAME_PHASE_COUNT; phase++){
+            for(size_t i = 0; i < history.size(); i++){
+                values[i] = phase < FRAME_PHASE_COUNT ? history[i].phase_ms_[phase] : history[i].total_ms_;
+            }
+            result[phase] = compute_percentiles(values);
+        }
+
+        auto gpu_history = gpu_samples();
+        values.resize(gpu_history.size());
+        for(size_t i = 0; i < gpu_history.size(); i++){
+            values[i] = gpu_history[i].gpu_ms_;
+        }
+        result[FRAME_PHASE_COUNT + 1] = compute_percentiles(values);
+        return result;
+    }
+
+    void print_summary(std::ostream& out) const{
+        auto stats = summarize();
+        out << std::format("{:<16} {:>9} {:>9} {:>9} {:>9} {:>9}\n", "phase (ms)", "mean", "p50", "p95", "p99", "max");
+        for(size_t phase = 0; phase < stats.size(); phase++){
+            const auto& s = stats[phase];
+            out << std::format("{:<16} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n", row_name(phase), s.mean_, s.p50_, s.p95_, s.p99_, s.max_);
+        }
+    }
+
+    void export_csv(const std::filesystem::path& path) const{
+        auto file = open_output(path);
+        file << "frame";
+        for(auto name: FRAME_PHASE_NAMES){
+            file << ',' << name;
+        }
+        file << ",total,gpu\n";
+        auto gpu_times = gpu_times_by_frame();
+        for(const auto& sample: samples()){
+            file << sample.frame_;
+            for(auto ms: sample.phase_ms_){
+                file << std::format(",{:.4f}", ms);
+            }
+            file << std::format(",{:.4f},", sample.total_ms_);
+            if(auto gpu = gpu_times.find(sample.frame_); gpu != gpu_times.end()){
+                file << std::format("{:.4f}", gpu->second);
+            }
+            file << '\n';
+        }
+    }
+
+    void export_json(const std::filesystem::path& path) const{
+        auto file = open_output(path);
+        auto stats = summarize();
+        file << "{\n  \"summary_ms\": {\n";
+        for(size_t phase = 0; phase < stats.size(); phase++){
+            const auto& s = stats[phase];
+            file << std::format("    \"{}\": {{\"mean\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f}}}{}\n",
+                row_name(phase), s.mean_, s.p50_, s.p95_, s.p99_, s.max_, phase + 1 < stats.size() ? "," : "");
+        }
+        file << "  },\n  \"frames\": [\n";
+        auto history = samples();
+        auto gpu_times = gpu_times_by_frame();
+        for(size_t i = 0; i < history.size(); i++){
+            const auto& sample = history[i];
+            file << std::format("    {{\"frame\": {}", sample.frame_);
+            for(size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++){
+                file << std::format(", \"{}\": {:.4f}", FRAME_PHASE_NAMES[phase], sample.phase_ms_[phase]);
+            }
+            file << std::format(", \"total\": {:.4f}", sample.total_ms_);
+            if(auto gpu = gpu_times.find(sample.frame_); gpu != gpu_times.end()){
+                file << std::format(", \"gpu\": {:.4f}", gpu->second);
+            }
+            file << std::format("}}{}\n", i + 1 < history.size() ? "," : "");
+        }
+        file << "  ]\n}\n";
+    }
+
+    private:
+    static std::string_view row_name(size_t row){
+        if(row < FRAME_PHASE_COUNT){
+            return FRAME_PHASE_NAMES[row];
+        }
+        return row == FRAME_PHASE_COUNT ? "frame" : "gpu";
+    }
+    std::unordered_map<uint64_t, float> gpu_times_by_frame() const{
+        std::unordered_map<uint64_t, float> result;
+        for(const auto& sample: gpu_samples()){
+            result[sample.frame_] = sample.gpu_ms_;
+        }
+        return result;
+    }
+    static float to_ms(clock::duration duration){
+        return std::chrono::duration<float, std::milli>(duration).count();
+    }
+    static std::ofstream open_output(const std::filesystem::path& path){
+        std::ofstream file(path);
+        if(!file.is_open()){
+            throw std::runtime_error{std::format("can't open file {}", path.string())};
+        }
+        return file;
+    }
+
+    clock::time_point frame_start_{};
+    clock::time_point last_mark_{};
+    Frame_sample current_{};
+    Ring_buffer<Frame_sample, HISTORY> samples_;
+    Ring_buffer<Gpu_sample, HISTORY> gpu_samples_;
+};
@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "mip_generator.h"
+
+// Minimal KTX2 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html) for the two formats the
+// texture cache stores: a 2D image, no supercompression, a basic data format descriptor and a mip
+// chain stored smallest level first as the spec requires. Only what the reader needs is validated.
+
+struct Ktx2_format{
+    VkFormat format_;
+    uint32_t block_width_;
+    uint32_t block_height_;
+    uint32_t block_bytes_;
+
+    size_t level_size(uint32_t width, uint32_t height) const{
+        return size_t{(width + block_width_ - 1) / block_width_} * ((height + block_height_ - 1) / block_height_) * block_bytes_;
+    }
+};
+
+constexpr Ktx2_format KTX2_RGBA8_SRGB{VK_FORMAT_R8G8B8A8_SRGB, 1, 1, 4};
+constexpr Ktx2_format KTX2_BC1_RGB_SRGB{VK_FORMAT_BC1_RGB_SRGB_BLOCK, 4, 4, 8};
+
+// A parsed file; level offsets_ are from the start of the file, level 0 is the full size image.
+struct Ktx2_image{
+    Ktx2_format format_;
+    std::vector<Mip_level> levels_;
+    std::vector<std::pair<std::string, std::string>> key_values_;
+
+    std::string_view value(std::string_view key) const{
+        for(const auto& [name, value] : key_values_){
+            if(name == key){
+                return value;
+            }
+        }
+        return {};
+    }
+};
+
+namespace ktx2_detail{
+
+constexpr std::array<uint8_t, 12> IDENTIFIER{0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+constexpr size_t HEADER_SIZE = 80;
+constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+inline const Ktx2_format* find_format(uint32_t format){
+    for(const auto* candidate : {&KTX2_RGBA8_SRGB, &KTX2_BC1_RGB_SRGB}){
+        if(static_cast<uint32_t>(candidate->format_) == format){
+            return candidate;
+        }
+    }
+    return nullptr;
+}
+
+inline size_t align(size_t value, size_t alignment){
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct Writer{
+    std::vector<uint8_t> bytes_;
+
+    void u32(uint32_t value){
+        for(int shift = 0; shift < 32; shift += 8){
+            bytes_.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+    void pad_to(size_t alignment){
+        bytes_.resize(align(bytes_.size(), alignment));
+    }
+    void patch_u32(size_t offset, uint32_t value){
+        for(int shift = 0; shift < 32; shift += 8){
+            bytes_[offset++] = static_cast<uint8_t>(value >> shift);
+        }
+    }
+    void patch_u64(size_t offset, uint64_t value){
+        patch_u32(offset, static_cast<uint32_t>(value));
+        patch_u32(offset + 4, static_cast<uint32_t>(value >> 32));
+    }
+};
+
+inline uint32_t read_u32(std::span<const std::byte> bytes, size_t offset){
+    uint32_t value{};
+    for(int byte = 3; byte >= 0; byte--){
+        value = value << 8 | std::to_integer<uint32_t>(bytes[offset + byte]);
+    }
+    return value;
+}
+
+inline uint64_t read_u64(std::span<const std::byte> bytes, size_t offset){
+    return read_u32(bytes, offset) | uint64_t{read_u32(bytes, offset + 4)} << 32;
+}
+
+// KHR_DF basic descriptor block: sRGB transfer, BT.709 primaries, one sample per channel for RGBA8
+// and a single 64 bit sample for BC1.
+inline void write_dfd(Writer& writer, const Ktx2_format& format){
+    const bool bc1 = format.format_ == VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    const uint32_t sample_count = bc1 ? 1 : 4;
+    const uint32_t block_size = 24 + 16 * sample_count;
+    writer.u32(4 + block_size);
+    writer.u32(0);
+    writer.u32(2 | block_size << 16);
+    constexpr uint32_t RGBSDA = 1, BC1A = 128, BT709 = 1, SRGB = 2;
+    writer.u32((bc1 ? BC1A : RGBSDA) | BT709 << 8 | SRGB << 16);
+    writer.u32((format.block_width_ - 1) | (format.block_height_ - 1) << 8);
+    writer.u32(format.block_bytes_);
+    writer.u32(0);
+    if(bc1){
+        writer.u32(63 << 16);
+        writer.u32(0);
+        writer.u32(0);
+        writer.u32(UINT32_MAX);
+        return;
+    }
+    constexpr uint32_t ALPHA_CHANNEL = 15, LINEAR = 0x10;
+    for(uint32_t channel = 0; channel < 4; channel++){
+        uint32_t channel_type = channel == 3 ? ALPHA_CHANNEL | LINEAR : channel;
+        writer.u32(channel * 8 | 7 << 16 | channel_type << 24);
+        writer.u32(0);
+        writer.u32(0);
+        writer.u32(255);
+    }
+}
+
+} // namespace ktx2_detail
+
+// Serializes a packed chain (offsets as produced by mip_chain_layout or encode_bc1_chain). Keys are
+// written in the sorted order the spec asks for.
+inline std::vector<uint8_t> encode_ktx2(const Ktx2_format& format, std::span<const Mip_level> levels, std::span<const uint8_t> data,
+    std::vector<std::pair<std::string, std::string>> key_values){
+    using namespace ktx2_detail;
+    Writer writer;
+    writer.bytes_.assign(IDENTIFIER.begin(), IDENTIFIER.end());
+    writer.u32(static_cast<uint32_t>(format.format_));
+    writer.u32(1);
+    writer.u32(levels.front().width_);
+    writer.u32(levels.front().height_);
+    writer.u32(0);
+    writer.u32(0);
+    writer.u32(1);
+    writer.u32(static_cast<uint32_t>(levels.size()));
+    writer.u32(0);
+    const size_t index_offset = writer.bytes_.size();
+    writer.bytes_.resize(HEADER_SIZE + levels.size() * LEVEL_INDEX_ENTRY_SIZE);
+
+    const size_t dfd_offset = writer.bytes_.size();
+    write_dfd(writer, format);
+    const size_t dfd_size = writer.bytes_.size() - dfd_offset;
+
+    std::sort(key_values.begin(), key_values.end());
+    const size_t kvd_offset = writer.bytes_.size();
+    for(const auto& [key, value] : key_values){
+        writer.u32(static_cast<uint32_t>(key.size() + 1 + value.size() + 1));
+        writer.bytes_.insert(writer.bytes_.end(), key.begin(), key.end());
+        writer.bytes_.push_back(0);
+        writer.bytes_.insert(writer.bytes_.end(), value.begin(), value.end());
+        writer.bytes_.push_back(0);
+        writer.pad_to(4);
+    }
+    const size_t kvd_size = writer.bytes_.size() - kvd_offset;
+
+    writer.patch_u32(index_offset, static_cast<uint32_t>(dfd_offset));
+    writer.patch_u32(index_offset + 4, static_cast<uint32_t>(dfd_size));
+    writer.patch_u32(index_offset + 8, kvd_size ? static_cast<uint32_t>(kvd_offset) : 0);
+    writer.patch_u32(index_offset + 12, static_cast<uint32_t>(kvd_size));
+
+    // lcm(texel block size, 4), which is the block size for both formats.
+    const size_t level_alignment = std::max<size_t>(format.block_bytes_, 4);
+    for(size_t level = levels.size(); level-- > 0;){
+        writer.pad_to(level_alignment);
+        const size_t size = format.level_size(levels[level].width_, levels[level].height_);
+        const size_t entry = HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+        writer.patch_u64(entry, writer.bytes_.size());
+        writer.patch_u64(entry + 8, size);
+        writer.patch_u64(entry + 16, size);
+        writer.bytes_.insert(writer.bytes_.end(), data.begin() + levels[level].offset_, data.begin() + levels[level].offset_ + size);
+    }
+    return std::move(writer.bytes_);
+}
+
+// Parses a file produced by encode_ktx2, nullopt if it is truncated, uses another format or anything
+// the cache never writes (arrays, cube maps, 3D, supercompression, levels out of order or overlapping).
+inline std::optional<Ktx2_image> decode_ktx2(std::span<const std::byte> bytes){
+    using namespace ktx2_detail;
+    if(bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), IDENTIFIER.data(), IDENTIFIER.size()) != 0){
+        return std::nullopt;
+    }
+    const auto* format = find_format(read_u32(bytes, 12));
+    const uint32_t width = read_u32(bytes, 20);
+    const uint32_t height = read_u32(bytes, 24);
+    const uint32_t level_count = read_u32(bytes, 40);
+    if(!format || width == 0 || height == 0 || read_u32(bytes, 28) != 0 || read_u32(bytes, 32) > 1 || read_u32(bytes, 36) != 1
+        || level_count == 0 || level_count > 32 || read_u32(bytes, 44) != 0
+        || bytes.size() < HEADER_SIZE + size_t{level_count} * LEVEL_INDEX_ENTRY_SIZE){
+        return std::nullopt;
+    }
+    Ktx2_image image{*format, {}, {}};
+    for(uint32_t level = 0; level < level_count; level++){
+        const size_t entry = HEADER_SIZE + size_t{level} * LEVEL_INDEX_ENTRY_SIZE;
+        const uint64_t offset = read_u64(bytes, entry);
+        const uint64_t size = read_u64(bytes, entry + 8);
+        const uint32_t level_width = std::max(width >> level, 1u);
+        const uint32_t level_height = std::max(height >> level, 1u);
+        if(size != format->level_size(level_width, level_height) || offset % format->block_bytes_ != 0
+            || offset > bytes.size() || size > bytes.size() - offset){
+            return std::nullopt;
+        }
+        // Smallest level first, as encode_ktx2 writes them: each level ends before the larger one starts,
+        // so the levels span front().offset_ + its size down to back().offset_ without overlapping.
+        if(level > 0 && offset + size > image.levels_.back().offset_){
+            return std::nullopt;
+        }
+        image.levels_.push_back({static_cast<size_t>(offset), level_width, level_height});
+    }
+
+    const uint32_t kvd_offset = read_u32(bytes, 56);
+    const uint32_t kvd_size = read_u32(bytes, 60);
+    if(size_t{kvd_offset} + kvd_size > bytes.size()){
+        return std::nullopt;
+    }
+    for(size_t offset = kvd_offset; offset + 4 <= size_t{kvd_offset} + kvd_size;){
+        const uint32_t length = read_u32(bytes, offset);
+        if(length > size_t{kvd_offset} + kvd_size - offset - 4){
+            return std::nullopt;
+        }
+        std::string_view entry{reinterpret_cast<const char*>(bytes.data()) + offset + 4, length};
+        const size_t separator = entry.find('\0');
+        if(separator == std::string_view::npos){
+            return std::nullopt;
+        }
+        auto value = entry.substr(separator + 1);
+        if(!value.empty() && value.back() == '\0'){
+            value.remove_suffix(1);
+        }
+        image.key_values_.emplace_back(std::string{entry.substr(0, separator)}, std::string{value});
+        offset += ktx2_detail::align(4 + length, 4);
+    }
+    return image;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sformat.h"
+
+// Read-only view of a whole file, pages are loaded on first touch instead of copied up front.
+class Mapped_file{
+    public:
+    Mapped_file() = default;
+    explicit Mapped_file(const std::filesystem::path& path){
+#if defined(_WIN32)
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file_ == INVALID_HANDLE_VALUE){
+            throw std::runtime_error{std::format("can't open file {}", path.string())};
+        }
+        LARGE_INTEGER size{};
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<size_t>(size.QuadPart);
+        if(size_ > 0){
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        }
+#else
+        file_ = open(path.c_str(), O_RDONLY);
+        if(file_ < 0){
+            throw std::runtime_error{std::format("can't open file {}", path.string())};
+        }
+        struct stat status{};
+        fstat(file_, &status);
+        size_ = static_cast<size_t>(status.st_size);
+        if(size_ > 0){
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+            if(data_ == MAP_FAILED){
+                data_ = nullptr;
+            }
+        }
+#endif
+        if(size_ > 0 && !data_){
+            close();
+            throw std::runtime_error{std::format("can't map file {}", path.string())};
+        }
+    }
+    ~Mapped_file(){
+        close();
+    }
+    Mapped_file(const Mapped_file&) = delete;
+    Mapped_file& operator=(const Mapped_file&) = delete;
+    Mapped_file(Mapped_file&& other) noexcept{
+        *this = std::move(other);
+    }
+    Mapped_file& operator=(Mapped_file&& other) noexcept{
+        if(this != &other){
+            close();
+            std::swap(file_, other.file_);
+#if defined(_WIN32)
+            std::swap(mapping_, other.mapping_);
+#endif
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+        }
+        return *this;
+    }
+
+    std::span<const std::byte> bytes() const{
+        return {static_cast<const std::byte*>(data_), size_};
+    }
+
+    void close(){
+#if defined(_WIN32)
+        if(data_){
+            UnmapViewOfFile(data_);
+        }
+        if(mapping_){
+            CloseHandle(mapping_);
+        }
+        if(file_ != INVALID_HANDLE_VALUE){
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if(data_){
+            munmap(data_, size_);
+        }
+        if(file_ >= 0){
+            ::close(file_);
+        }
+        file_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    private:
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_{};
+#else
+    int file_ = -1;
+#endif
+    void* data_{};
+    size_t size_{};
+};
+
+// 64-bit content hash, consumes 8 bytes per step so hashing a large OBJ stays far below parsing it.
+// Not cryptographic, only meant to tell files apart.
+inline uint64_t content_hash(std::span<const std::byte> bytes){
+    constexpr uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ull;
+    auto mix = [](uint64_t value){
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ull;
+        value ^= value >> 33;
+        return value;
+    };
+
+    uint64_t hash = bytes.size() * MULTIPLIER;
+    size_t offset = 0;
+    for(; offset + 8 <= bytes.size(); offset += 8){
+        uint64_t word{};
+        std::memcpy(&word, bytes.data() + offset, 8);
+        hash = (hash ^ mix(word)) * MULTIPLIER;
+    }
+    uint64_t tail{};
+    if(offset < bytes.size()){
+        std::memcpy(&tail, bytes.data() + offset, bytes.size() - offset);
+    }
+    return mix(hash ^ mix(tail));
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Reorders whole triangles so every slot's are contiguous, slots in increasing order. The sort is a
+// stable counting sort, each slot keeps its triangles in their original order. triangle_slots has one
+// entry per triangle of indices, every one below slot_count. Returns the triangle count of every slot.
+inline std::vector<uint32_t> sort_triangles_by_slot(std::vector<uint32_t>& indices, std::span<const uint32_t> triangle_slots, size_t slot_count){
+    std::vector<uint32_t> counts(slot_count);
+    for(auto slot: triangle_slots){
+        counts[slot]++;
+    }
+    std::vector<size_t> offsets(slot_count);
+    for(size_t slot = 1; slot < slot_count; slot++){
+        offsets[slot] = offsets[slot - 1] + counts[slot - 1];
+    }
+    std::vector<uint32_t> sorted(indices.size());
+    for(size_t triangle = 0; triangle < triangle_slots.size(); triangle++){
+        auto target = 3 * offsets[triangle_slots[triangle]]++;
+        sorted[target] = indices[3 * triangle];
+        sorted[target + 1] = indices[3 * triangle + 1];
+        sorted[target + 2] = indices[3 * triangle + 2];
+    }
+    indices = std::move(sorted);
+    return counts;
+}
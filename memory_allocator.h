@@ -0,0 +1,309 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "sformat.h"
+
+// Offset bookkeeping of one memory block. Pure CPU, so the policy can be exercised without a device.
+// Best fit over a coalescing free list. Linear (buffers, linear images) and non-linear (optimal images)
+// resources never share a bufferImageGranularity page.
+class Block_suballocator{
+    public:
+    explicit Block_suballocator(VkDeviceSize size, VkDeviceSize granularity = 1)
+    :size_(size), granularity_(std::max<VkDeviceSize>(granularity, 1)){
+        free_ranges_[0] = size;
+    }
+
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment, bool linear){
+        alignment = std::max<VkDeviceSize>(alignment, 1);
+        auto best = free_ranges_.end();
+        VkDeviceSize best_offset{};
+        for(auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it){
+            auto [range_offset, range_size] = *it;
+            if(range_size < size || (best != free_ranges_.end() && range_size >= best->second)){
+                continue;
+            }
+            auto offset = align_up(range_offset, alignment);
+
+            // Free ranges are always bounded by used ranges or the block edges.
+            if(auto prev = used_before(range_offset); prev && prev->second.linear_ != linear &&
+                same_page(prev->first + prev->second.size_ - 1, offset)){
+                offset = align_up(offset, granularity_);
+            }
+            auto end = offset + size;
+            if(end > range_offset + range_size){
+                continue;
+            }
+            if(auto next = used_.find(range_offset + range_size); next != used_.end() && next->second.linear_ != linear &&
+                same_page(end - 1, next->first)){
+                continue;
+            }
+            best = it;
+            best_offset = offset;
+        }
+        if(best == free_ranges_.end()){
+            return std::nullopt;
+        }
+
+        auto [range_offset, range_size] = *best;
+        free_ranges_.erase(best);
+        if(best_offset > range_offset){
+            free_ranges_[range_offset] = best_offset - range_offset;
+        }
+        auto end = best_offset + size;
+        if(end < range_offset + range_size){
+            free_ranges_[end] = range_offset + range_size - end;
+        }
+        used_[best_offset] = {size, linear};
+        used_bytes_ += size;
+        return best_offset;
+    }
+
+    void free(VkDeviceSize offset){
+        auto it = used_.find(offset);
+        if(it == used_.end()){
+            throw std::runtime_error{std::format("freeing unknown sub-allocation at offset {}", offset)};
+        }
+        auto size = it->second.size_;
+        used_.erase(it);
+        used_bytes_ -= size;
+
+        auto next = free_ranges_.find(offset + size);
+        if(next != free_ranges_.end()){
+            size += next->second;
+            free_ranges_.erase(next);
+        }
+        auto prev = free_ranges_.lower_bound(offset);
+        if(prev != free_ranges_.begin() && (--prev)->first + prev->second == offset){
+            prev->second += size;
+            return;
+        }
+        free_ranges_[offset] = size;
+    }
+
+    bool empty() const{
+        return used_.empty();
+    }
+    VkDeviceSize size() const{
+        return size_;
+    }
+    VkDeviceSize used_bytes() const{
+        return used_bytes_;
+    }
+    size_t allocation_count() const{
+        return used_.size();
+    }
+    size_t free_range_count() const{
+        return free_ranges_.size();
+    }
+    VkDeviceSize largest_free_range() const{
+        VkDeviceSize largest{};
+        for(auto [offset, size]: free_ranges_){
+            largest = std::max(largest, size);
+        }
+        return largest;
+    }
+
+    private:
+    struct Used_range{
+        VkDeviceSize size_;
+        bool linear_;
+    };
+
+    static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment){
+        return (value + alignment - 1) / alignment * alignment;
+    }
+    bool same_page(VkDeviceSize a, VkDeviceSize b) const{
+        return a / granularity_ == b / granularity_;
+    }
+    const std::pair<const VkDeviceSize, Used_range>* used_before(VkDeviceSize offset) const{
+        auto it = used_.lower_bound(offset);
+        if(it == used_.begin()){
+            return nullptr;
+        }
+        return &*--it;
+    }
+
+    VkDeviceSize size_;
+    VkDeviceSize granularity_;
+    VkDeviceSize used_bytes_{};
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges_;
+    std::map<VkDeviceSize, Used_range> used_;
+};
+
+struct Memory_block;
+
+struct Allocation{
+    VkDeviceMemory memory_{};
+    VkDeviceSize offset_{};
+    VkDeviceSize size_{};
+    // Points at offset_ inside a persistently mapped block, null for device local memory.
+    void* mapped_{};
+    Memory_block* block_{};
+};
+
+struct Memory_block{
+    VkDeviceMemory memory_{};
+    void* mapped_{};
+    uint32_t memory_type_{};
+    Block_suballocator suballocator_;
+};
+
+struct Allocator_stats{
+    uint64_t device_allocations_{};
+    uint64_t live_blocks_{};
+    uint64_t live_allocations_{};
+    uint64_t total_allocations_{};
+    VkDeviceSize reserved_bytes_{};
+    VkDeviceSize used_bytes_{};
+};
+
+// Carves buffers and images out of large per memory type blocks instead of one vkAllocateMemory each.
+class Device_memory_allocator{
+    public:
+    static constexpr VkDeviceSize BLOCK_SIZE = VkDeviceSize{64} << 20;
+
+    void init(VkPhysicalDevice physical_device, VkDevice device){
+        device_ = device;
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        limits_ = properties.limits;
+        blocks_.resize(memory_properties_.memoryTypeCount);
+    }
+
+    // memory_type comes from the caller's memory type search, it must be one of requirements.memoryTypeBits.
+    Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memory_type, bool linear){
+        auto flags = memory_properties_.memoryTypes[memory_type].propertyFlags;
+        auto alignment = requirements.alignment;
+        if((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)){
+            // Keeps flush/invalidate ranges of neighbours apart.
+            alignment = std::max(alignment, limits_.nonCoherentAtomSize);
+        }
+
+        std::lock_guard lock{mutex_};
+        total_allocations_++;
+        auto block_size = preferred_block_size(memory_type);
+        if(requirements.size <= block_size / 2){
+            for(auto& block: blocks_[memory_type]){
+                if(auto offset = block->suballocator_.allocate(requirements.size, alignment, linear)){
+                    return make_allocation(*block, *offset, requirements.size);
+                }
+            }
+        }else{
+            // Big resources get a block of their own, it is released as soon as they are.
+            block_size = requirements.size;
+        }
+
+        auto& block = create_block(memory_type, block_size);
+        auto offset = block.suballocator_.allocate(requirements.size, alignment, linear);
+        return make_allocation(block, offset.value(), requirements.size);
+    }
+
+    void free(Allocation& allocation){
+        if(!allocation.block_){
+            return;
+        }
+        std::lock_guard lock{mutex_};
+        auto* block = allocation.block_;
+        block->suballocator_.free(allocation.offset_);
+        allocation = {};
+        if(!block->suballocator_.empty()){
+            return;
+        }
+
+        // Keep one empty block per type around so staging buffers don't allocate a block every time.
+        auto& blocks = blocks_[block->memory_type_];
+        auto oversized = block->suballocator_.size() > preferred_block_size(block->memory_type_);
+        auto empty_blocks = std::count_if(blocks.begin(), blocks.end(), [](const auto& b){ return b->suballocator_.empty(); });
+        if(oversized || empty_blocks > 1){
+            destroy_block(block);
+        }
+    }
+
+    void destroy(){
+        std::lock_guard lock{mutex_};
+        for(auto& blocks: blocks_){
+            for(auto& block: blocks){
+                vkFreeMemory(device_, block->memory_, nullptr);
+            }
+            blocks.clear();
+        }
+    }
+
+    Allocator_stats stats() const{
+        std::lock_guard lock{mutex_};
+        Allocator_stats result{};
+        result.device_allocations_ = device_allocations_;
+        result.total_allocations_ = total_allocations_;
+        for(const auto& blocks: blocks_){
+            for(const auto& block: blocks){
+                result.live_blocks_++;
+                result.live_allocations_ += block->suballocator_.allocation_count();
+                result.reserved_bytes_ += block->suballocator_.size();
+                result.used_bytes_ += block->suballocator_.used_bytes();
+            }
+        }
+        return result;
+    }
+
+    private:
+    VkDeviceSize preferred_block_size(uint32_t memory_type) const{
+        // Small heaps (e.g. 256MiB BAR) would be eaten by a few default sized blocks.
+        auto heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type].heapIndex].size;
+        return std::min(BLOCK_SIZE, heap_size / 8);
+    }
+
+    Memory_block& create_block(uint32_t memory_type, VkDeviceSize size){
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        VkDeviceMemory memory{};
+        if(vkAllocateMemory(device_, &alloc_info, nullptr, &memory) != VK_SUCCESS){
+            throw std::runtime_error{std::format("failed to allocate {} bytes of device memory.", size)};
+        }
+        device_allocations_++;
+
+        void* mapped{};
+        if(memory_properties_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+            vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        }
+        auto block = std::make_unique<Memory_block>(Memory_block{memory, mapped, memory_type, Block_suballocator{size, limits_.bufferImageGranularity}});
+        return *blocks_[memory_type].emplace_back(std::move(block));
+    }
+
+    void destroy_block(Memory_block* block){
+        auto& blocks = blocks_[block->memory_type_];
+        auto it = std::find_if(blocks.begin(), blocks.end(), [&](const auto& b){ return b.get() == block; });
+        vkFreeMemory(device_, block->memory_, nullptr);
+        blocks.erase(it);
+    }
+
+    static Allocation make_allocation(Memory_block& block, VkDeviceSize offset, VkDeviceSize size){
+        Allocation allocation{};
+        allocation.memory_ = block.memory_;
+        allocation.offset_ = offset;
+        allocation.size_ = size;
+        allocation.mapped_ = block.mapped_ ? static_cast<char*>(block.mapped_) + offset : nullptr;
+        allocation.block_ = &block;
+        return allocation;
+    }
+
+    VkDevice device_{};
+    VkPhysicalDeviceMemoryProperties memory_properties_{};
+    VkPhysicalDeviceLimits limits_{};
+    std::vector<std::vector<std::unique_ptr<Memory_block>>> blocks_;
+    uint64_t device_allocations_{};
+    uint64_t total_allocations_{};
+    mutable std::mutex mutex_;
+};
@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// Index and vertex reordering for GPU friendly triangle lists. Pure CPU, works on any vertex type.
+//  - optimize_vertex_cache(): Tipsify (Sander, Nehab, Barczak 2007), keeps the post-transform cache warm.
+//  - optimize_overdraw(): sorts the Tipsify clusters so outward facing ones are drawn first.
+//  - vertex_fetch_remap(): renumbers vertices in first use order for linear vertex fetch.
+
+// Entries of the simulated post-transform cache, a typical FIFO size of current GPUs.
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct Vertex_cache_stats{
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for large grids, 3 the worst.
+    double acmr_{};
+    // Average transformed vertex ratio: transformed vertices per referenced vertex, 1 is ideal.
+    double atvr_{};
+};
+
+inline Vertex_cache_stats analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count, uint32_t cache_size = VERTEX_CACHE_SIZE){
+    // FIFO cache: a vertex is a hit while fewer than cache_size misses happened since it was loaded.
+    std::vector<uint64_t> loaded_at(vertex_count, 0);
+    std::vector<uint8_t> referenced(vertex_count, 0);
+    uint64_t misses{};
+    for(auto index: indices){
+        if(loaded_at[index] == 0 || misses - loaded_at[index] >= cache_size){
+            misses++;
+            loaded_at[index] = misses;
+        }
+        referenced[index] = 1;
+    }
+    auto referenced_count = std::count(referenced.begin(), referenced.end(), uint8_t{1});
+
+    Vertex_cache_stats stats{};
+    auto triangles = indices.size() / 3;
+    stats.acmr_ = triangles ? static_cast<double>(misses) / static_cast<double>(triangles) : 0.0;
+    stats.atvr_ = referenced_count ? static_cast<double>(misses) / static_cast<double>(referenced_count) : 0.0;
+    return stats;
+}
+
+// Reorders the triangles of indices in place. Returns the first triangle of every cluster, a cluster
+// ends where Tipsify had to restart from a dead end, so clusters can be reordered without hurting the cache much.
+inline std::vector<uint32_t> optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count, uint32_t cache_size = VERTEX_CACHE_SIZE){
+    const size_t triangle_count = indices.size() / 3;
+    std::vector<uint32_t> clusters;
+    if(triangle_count == 0){
+        return clusters;
+    }
+
+    // Vertex -> triangles adjacency in CSR form, live_triangles counts the ones not emitted yet.
+    std::vector<uint32_t> live_triangles(vertex_count, 0);
+    for(auto index: indices){
+        live_triangles[index]++;
+    }
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    std::partial_sum(live_triangles.begin(), live_triangles.end(), adjacency_offsets.begin() + 1);
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        auto next = adjacency_offsets;
+        for(size_t i = 0; i < indices.size(); i++){
+            adjacency[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<uint8_t> emitted(triangle_count, 0);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t time = cache_size + 1;
+    size_t cursor = 0;
+
+    auto skip_dead_end = [&]() -> int64_t {
+        while(!dead_end.empty()){
+            auto vertex = dead_end.back();
+            dead_end.pop_back();
+            if(live_triangles[vertex] > 0){
+                return vertex;
+            }
+        }
+        for(; cursor < vertex_count; cursor++){
+            if(live_triangles[cursor] > 0){
+                return static_cast<int64_t>(cursor);
+            }
+        }
+        return -1;
+    };
+
+    int64_t fanning = skip_dead_end();
+    clusters.push_back(0);
+    while(fanning >= 0){
+        candidates.clear();
+        for(auto a = adjacency_offsets[fanning]; a < adjacency_offsets[fanning + 1]; a++){
+            auto triangle = adjacency[a];
+            if(emitted[triangle]){
+                continue;
+            }
+            emitted[triangle] = 1;
+            for(size_t corner = 0; corner < 3; corner++){
+                auto vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                dead_end.push_back(vertex);
+                candidates.push_back(vertex);
+                live_triangles[vertex]--;
+                if(time - cache_time[vertex] > cache_size){
+                    cache_time[vertex] = time++;
+                }
+            }
+        }
+
+        // Next fanning vertex: the candidate that stays in the cache longest while its remaining triangles are emitted.
+        int64_t best = -1;
+        int64_t best_priority = -1;
+        for(auto vertex: candidates){
+            if(live_triangles[vertex] == 0){
+                continue;
+            }
+            int64_t priority = 0;
+            if(time - cache_time[vertex] + 2 * live_triangles[vertex] <= cache_size){
+                priority = time - cache_time[vertex];
+            }
+            if(priority > best_priority){
+                best_priority = priority;
+                best = vertex;
+            }
+        }
+        if(best < 0){
+            best = skip_dead_end();
+            if(best >= 0 && output.size() < indices.size()){
+                clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+        }
+        fanning = best;
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+    return clusters;
+}
+
+// Sorts the clusters of optimize_vertex_cache() by how far they face away from the mesh center, so
+// the outer surface is drawn first and hides what is behind it for any view direction.
+// position(vertex) returns an std::array<float, 3>.
+template<typename Position>
+void optimize_overdraw(std::span<uint32_t> indices, std::span<const uint32_t> clusters, const Position& position){
+    const size_t triangle_count = indices.size() / 3;
+    if(clusters.size() < 2){
+        return;
+    }
+    auto cluster_end = [&](size_t cluster){ return cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangle_count; };
+
+    // Area weighted centroid and normal of every cluster and of the whole mesh.
+    std::vector<std::array<double, 3>> centroids(clusters.size());
+    std::vector<std::array<double, 3>> normals(clusters.size());
+    std::array<double, 3> mesh_centroid{};
+    double mesh_area{};
+    for(size_t cluster = 0; cluster < clusters.size(); cluster++){
+        double area_sum{};
+        for(auto triangle = clusters[cluster]; triangle < cluster_end(cluster); triangle++){
+            auto a = position(indices[triangle * 3 + 0]);
+            auto b = position(indices[triangle * 3 + 1]);
+            auto c = position(indices[triangle * 3 + 2]);
+            std::array<double, 3> ab{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            std::array<double, 3> ac{c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            std::array<double, 3> cross{ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]};
+            auto area = 0.5 * std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+            for(size_t axis = 0; axis < 3; axis++){
+                centroids[cluster][axis] += area * (a[axis] + b[axis] + c[axis]) / 3.0;
+                normals[cluster][axis] += cross[axis];
+            }
+            area_sum += area;
+        }
+        for(size_t axis = 0; axis < 3; axis++){
+            mesh_centroid[axis] += centroids[cluster][axis];
+            centroids[cluster][axis] = area_sum > 0.0 ? centroids[cluster][axis] / area_sum : 0.0;
+        }
+        mesh_area += area_sum;
+    }
+    for(auto& value: mesh_centroid){
+        value = mesh_area > 0.0 ? value / mesh_area : 0.0;
+    }
+
+    std::vector<double> sort_keys(clusters.size());
+    for(size_t cluster = 0; cluster < clusters.size(); cluster++){
+        const auto& normal = normals[cluster];
+        auto length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        double key{};
+        for(size_t axis = 0; axis < 3; axis++){
+            key += (centroids[cluster][axis] - mesh_centroid[axis]) * (length > 0.0 ? normal[axis] / length : 0.0);
+        }
+        sort_keys[cluster] = key;
+    }
+    std::vector<uint32_t> order(clusters.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for(auto cluster: order){
+        sorted.insert(sorted.end(), indices.begin() + clusters[cluster] * 3, indices.begin() + cluster_end(cluster) * 3);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices.begin());
+}
+
+// New index of every vertex: referenced ones in first use order, unreferenced ones after them.
+inline std::vector<uint32_t> vertex_fetch_remap(std::span<const uint32_t> indices, size_t vertex_count){
+    constexpr uint32_t UNASSIGNED = ~0u;
+    std::vector<uint32_t> remap(vertex_count, UNASSIGNED);
+    uint32_t next{};
+    for(auto index: indices){
+        if(remap[index] == UNASSIGNED){
+            remap[index] = next++;
+        }
+    }
+    for(auto& index: remap){
+        if(index == UNASSIGNED){
+            index = next++;
+        }
+    }
+    return remap;
+}
+
+template<typename T>
+void apply_vertex_remap(std::vector<T>& vertices, std::span<uint32_t> indices, std::span<const uint32_t> remap){
+    std::vector<T> remapped(vertices.size());
+    for(size_t i = 0; i < vertices.size(); i++){
+        remapped[remap[i]] = vertices[i];
+    }
+    vertices = std::move(remapped);
+    for(auto& index: indices){
+        index = remap[index];
+    }
+}
+
+// Triangles rotated to start at their smallest index (winding kept) and sorted, two index lists
+// with equal results draw the same triangles.
+inline std::vector<std::array<uint32_t, 3>> canonical_triangles(std::span<const uint32_t> indices){
+    std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+    for(size_t i = 0; i < triangles.size(); i++){
+        std::array<uint32_t, 3> triangle{indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2]};
+        auto first = std::min_element(triangle.begin(), triangle.end()) - triangle.begin();
+        triangles[i] = {triangle[first], triangle[(first + 1) % 3], triangle[(first + 2) % 3]};
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
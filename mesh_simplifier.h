@@ -0,0 +1,585 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error mesh simplification (Garland, Heckbert 1997) by half edge collapses: a vertex moves
+// onto a neighbor, so every LOD indexes the original vertex array. Pure CPU, works on any vertex type.
+// Vertices sharing a position with another vertex (texture seams) and vertices on open borders never
+// move, which keeps seams and holes closed at the cost of less reduction around them.
+
+// A LOD is a range of the packed index list. error_ bounds the distance between the full resolution
+// surface and the LOD's both ways: from any point of either to the nearest point of the other, in model units.
+struct Mesh_lod{
+    uint32_t first_index_;
+    uint32_t index_count_;
+    float error_;
+};
+
+// Every LOD coarser than this many triangles isn't worth a draw of its own.
+constexpr size_t MIN_LOD_TRIANGLES = 64;
+
+namespace simplifier_detail{
+
+using Vec3 = std::array<double, 3>;
+
+inline Vec3 sub(const Vec3& a, const Vec3& b){
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+inline double dot(const Vec3& a, const Vec3& b){
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline Vec3 cross(const Vec3& a, const Vec3& b){
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+// Symmetric 4x4 matrix of summed squared plane distances, upper triangle stored.
+struct Quadric{
+    std::array<double, 10> m_{};
+
+    void add_plane(const Vec3& normal, double distance, double weight){
+        const std::array<double, 4> p{normal[0], normal[1], normal[2], distance};
+        size_t k = 0;
+        for(size_t i = 0; i < 4; i++){
+            for(size_t j = i; j < 4; j++){
+                m_[k++] += weight * p[i] * p[j];
+            }
+        }
+    }
+    void add(const Quadric& other){
+        for(size_t i = 0; i < m_.size(); i++){
+            m_[i] += other.m_[i];
+        }
+    }
+    double evaluate(const Vec3& v) const{
+        const std::array<double, 4> p{v[0], v[1], v[2], 1.0};
+        double sum{};
+        size_t k = 0;
+        for(size_t i = 0; i < 4; i++){
+            for(size_t j = i; j < 4; j++){
+                sum += (i == j ? 1.0 : 2.0) * m_[k++] * p[i] * p[j];
+            }
+        }
+        return std::max(sum, 0.0);
+    }
+};
+
+inline Vec3 closest_point_on_segment(const Vec3& p, const Vec3& a, const Vec3& b){
+    auto ab = sub(b, a);
+    auto length_squared = dot(ab, ab);
+    auto t = length_squared > 0.0 ? std::clamp(dot(sub(p, a), ab) / length_squared, 0.0, 1.0) : 0.0;
+    return {a[0] + t * ab[0], a[1] + t * ab[1], a[2] + t * ab[2]};
+}
+
+// Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5), returns the distance.
+inline double point_triangle_distance(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c){
+    auto closest = [&]() -> Vec3 {
+        auto ab = sub(b, a), ac = sub(c, a), ap = sub(p, a);
+        auto d1 = dot(ab, ap), d2 = dot(ac, ap);
+        if(d1 <= 0.0 && d2 <= 0.0){
+            return a;
+        }
+        auto bp = sub(p, b);
+        auto d3 = dot(ab, bp), d4 = dot(ac, bp);
+        if(d3 >= 0.0 && d4 <= d3){
+            return b;
+        }
+        auto vc = d1 * d4 - d3 * d2;
+        if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0){
+            auto v = d1 / (d1 - d3);
+            return {a[0] + v * ab[0], a[1] + v * ab[1], a[2] + v * ab[2]};
+        }
+        auto cp = sub(p, c);
+        auto d5 = dot(ab, cp), d6 = dot(ac, cp);
+        if(d6 >= 0.0 && d5 <= d6){
+            return c;
+        }
+        auto vb = d5 * d2 - d1 * d6;
+        if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0){
+            auto w = d2 / (d2 - d6);
+            return {a[0] + w * ac[0], a[1] + w * ac[1], a[2] + w * ac[2]};
+        }
+        auto va = d3 * d6 - d5 * d4;
+        if(va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0){
+            auto w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return {b[0] + w * (c[0] - b[0]), b[1] + w * (c[1] - b[1]), b[2] + w * (c[2] - b[2])};
+        }
+        if(!(va + vb + vc > 0.0)){
+            // Zero area, every point is on an edge.
+            std::array<Vec3, 3> candidates{closest_point_on_segment(p, a, b), closest_point_on_segment(p, b, c), closest_point_on_segment(p, c, a)};
+            return *std::min_element(candidates.begin(), candidates.end(), [&](const Vec3& x, const Vec3& y){
+                return dot(sub(p, x), sub(p, x)) < dot(sub(p, y), sub(p, y));
+            });
+        }
+        auto denominator = 1.0 / (va + vb + vc);
+        auto v = vb * denominator, w = vc * denominator;
+        return {a[0] + ab[0] * v + ac[0] * w, a[1] + ab[1] * v + ac[1] * w, a[2] + ab[2] * v + ac[2] * w};
+    }();
+    auto offset = sub(p, closest);
+    return std::sqrt(dot(offset, offset));
+}
+
+using Triangle = std::array<Vec3, 3>;
+
+inline Vec3 unit_normal(const Triangle& t){
+    auto normal = cross(sub(t[1], t[0]), sub(t[2], t[0]));
+    auto length = std::sqrt(dot(normal, normal));
+    return length > 0.0 ? Vec3{normal[0] / length, normal[1] / length, normal[2] / length} : Vec3{};
+}
+
+// Convex polygon of a triangle cut by planes through one point.
+struct Clip_polygon{
+    std::array<Vec3, 16> points_;
+    size_t count_{};
+
+    // Keeps the part where dot(normal, p - origin) has the sign of side. Every cut adds at most one
+    // point; one that wouldn't fit is skipped, the polygon then only stays larger than it should be.
+    void clip(const Vec3& normal, const Vec3& origin, double side){
+        std::array<Vec3, 16> kept{};
+        size_t kept_count{};
+        for(size_t i = 0; i < count_; i++){
+            const auto& a = points_[i];
+            const auto& b = points_[(i + 1) % count_];
+            auto da = side * dot(normal, sub(a, origin));
+            auto db = side * dot(normal, sub(b, origin));
+            if(da >= 0.0){
+                if(kept_count == kept.size()){
+                    return;
+                }
+                kept[kept_count++] = a;
+            }
+            if((da < 0.0) != (db < 0.0)){
+                if(kept_count == kept.size()){
+                    return;
+                }
+                auto t = da / (da - db);
+                kept[kept_count++] = {a[0] + t * (b[0] - a[0]), a[1] + t * (b[1] - a[1]), a[2] + t * (b[2] - a[2])};
+            }
+        }
+        points_ = kept;
+        count_ = kept_count;
+    }
+
+    // Smallest of the targets' largest distance to a point, bounds the distance from every point of
+    // the polygon to the targets since the distance to one triangle is convex.
+    double farthest_from(std::span<const Triangle> targets) const{
+        double best = std::numeric_limits<double>::max();
+        for(const auto& target: targets){
+            double farthest{};
+            for(size_t i = 0; i < count_ && farthest < best; i++){
+                farthest = std::max(farthest, point_triangle_distance(points_[i], target[0], target[1], target[2]));
+            }
+            best = std::min(best, farthest);
+        }
+        return count_ ? best : 0.0;
+    }
+};
+
+// Bounds the distance from any point of the sources to the nearest target. The targets are a fan around
+// apex, every one has it as a corner. Planes through the edges consecutive targets share cut every source
+// into one convex piece per target, whose distance to it peaks at a corner of the piece. A point in no
+// piece is past every plane in turn: in an open fan that puts it in the last piece, so the pieces cover
+// the source whatever the planes' angles; in a closed fan it is on the same side of all of them, and
+// those two leftovers are bounded with the best single target. Fans that don't chain, and sources that
+// a single target bounds better, use the single target.
+inline double fan_distance_bound(std::span<const Triangle> sources, std::span<const Triangle> targets, const Vec3& apex){
+    // Targets rotated to start at apex, then chained: target i + 1 starts with the last corner of target i.
+    std::vector<Triangle> chain;
+    for(const auto& target: targets){
+        auto corner = static_cast<size_t>(std::find(target.begin(), target.end(), apex) - target.begin());
+        if(corner == 3){
+            chain.clear();
+            break;
+        }
+        chain.push_back({target[corner], target[(corner + 1) % 3], target[(corner + 2) % 3]});
+    }
+    // An open fan starts at the target whose first edge no other target ends with, a closed one anywhere.
+    auto start = std::find_if(chain.begin(), chain.end(), [&](const Triangle& t){
+        return std::none_of(chain.begin(), chain.end(), [&](const Triangle& other){ return other[2] == t[1]; });
+    });
+    if(start != chain.end()){
+        std::iter_swap(chain.begin(), start);
+    }
+    for(size_t i = 1; i < chain.size(); i++){
+        auto next = std::find_if(chain.begin() + static_cast<std::ptrdiff_t>(i), chain.end(), [&](const Triangle& t){ return t[1] == chain[i - 1][2]; });
+        if(next == chain.end()){
+            chain.clear();
+            break;
+        }
+        std::iter_swap(chain.begin() + static_cast<std::ptrdiff_t>(i), next);
+    }
+    const size_t count = chain.size();
+    const bool closed = count >= 3 && chain[count - 1][2] == chain[0][1];
+    // Plane i contains the edge target i shares with the next and the mean of their normals, the next
+    // target lies on its positive side.
+    std::vector<Vec3> planes;
+    for(size_t i = 0; i < (closed ? count : count - std::min<size_t>(count, 1)); i++){
+        const auto& next = chain[(i + 1) % count];
+        auto n0 = unit_normal(chain[i]), n1 = unit_normal(next);
+        auto plane = cross(sub(chain[i][2], apex), {n0[0] + n1[0], n0[1] + n1[1], n0[2] + n1[2]});
+        if(dot(plane, sub(next[2], apex)) < 0.0){
+            plane = {-plane[0], -plane[1], -plane[2]};
+        }
+        planes.push_back(plane);
+    }
+
+    double bound{};
+    for(const auto& source: sources){
+        const Clip_polygon whole{{source[0], source[1], source[2]}, 3};
+        const auto single = whole.farthest_from(targets);
+        double pieces = count == 0 ? single : 0.0;
+        for(size_t i = 0; i < count && pieces < single; i++){
+            auto piece = whole;
+            if(i > 0 || closed){
+                piece.clip(planes[(i + count - 1) % count], apex, 1.0);
+            }
+            if(i + 1 < count || closed){
+                piece.clip(planes[i], apex, -1.0);
+            }
+            pieces = std::max(pieces, piece.farthest_from(std::span{&chain[i], 1}));
+        }
+        for(double side: {1.0, -1.0}){
+            if(!closed || pieces >= single){
+                break;
+            }
+            auto leftover = whole;
+            for(const auto& plane: planes){
+                leftover.clip(plane, apex, side);
+            }
+            pieces = std::max(pieces, leftover.farthest_from(targets));
+        }
+        bound = std::max(bound, std::min(single, pieces));
+    }
+    return bound;
+}
+
+} // namespace simplifier_detail
+
+// Simplifies successive LODs of one mesh. The error bound carries over from one simplify() call to the
+// next, so a chain built by feeding every LOD back in reports errors against the full resolution mesh.
+class Mesh_simplifier{
+    public:
+    // position(vertex) returns an std::array<float, 3>.
+    template<typename Position>
+    Mesh_simplifier(size_t vertex_count, const Position& position):positions_(vertex_count), weld_(vertex_count), error_bounds_(vertex_count, 0.0){
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        std::vector<uint32_t> copies(vertex_count, 0);
+        for(uint32_t vertex = 0; vertex < vertex_count; vertex++){
+            auto p = position(vertex);
+            positions_[vertex] = {p[0], p[1], p[2]};
+            // Exact position match, -0.0 folded into 0.0.
+            uint64_t hash = 0x9E3779B97F4A7C15ull;
+            for(float value: p){
+                uint32_t bits = value == 0.0f ? 0 : std::bit_cast<uint32_t>(value);
+                hash = (hash ^ bits) * 0xFF51AFD7ED558CCDull;
+                hash ^= hash >> 32;
+            }
+            auto& bucket = buckets[hash];
+            weld_[vertex] = vertex;
+            for(auto other: bucket){
+                if(positions_[other] == positions_[vertex]){
+                    weld_[vertex] = other;
+                    break;
+                }
+            }
+            bucket.push_back(vertex);
+            copies[weld_[vertex]]++;
+        }
+        seam_.resize(vertex_count);
+        for(uint32_t vertex = 0; vertex < vertex_count; vertex++){
+            seam_[vertex] = copies[weld_[vertex]] > 1;
+        }
+    }
+
+    // Largest error bound of any vertex so far, in model units.
+    double error() const{
+        return max_error_;
+    }
+
+    // Collapses edges of indices, cheapest quadric error first, until at most target_index_count
+    // indices are left or no collapse is possible. Returns the simplified list.
+    std::vector<uint32_t> simplify(std::span<const uint32_t> indices, size_t target_index_count){
+        using namespace simplifier_detail;
+        std::vector<uint32_t> triangles(indices.begin(), indices.end());
+        const size_t vertex_count = positions_.size();
+        auto triangle_normal = [&](uint32_t a, uint32_t b, uint32_t c){
+            return cross(sub(positions_[b], positions_[a]), sub(positions_[c], positions_[a]));
+        };
+
+        // Quadrics of the input triangles, weighted by area.
+        std::vector<Quadric> quadrics(vertex_count);
+        for(size_t i = 0; i + 2 < triangles.size(); i += 3){
+            auto normal = triangle_normal(triangles[i], triangles[i + 1], triangles[i + 2]);
+            auto length = std::sqrt(dot(normal, normal));
+            if(length == 0.0){
+                continue;
+            }
+            Vec3 unit{normal[0] / length, normal[1] / length, normal[2] / length};
+            auto distance = -dot(unit, positions_[triangles[i]]);
+            for(size_t corner = 0; corner < 3; corner++){
+                quadrics[weld_[triangles[i + corner]]].add_plane(unit, distance, length * 0.5);
+            }
+        }
+
+        auto locked = find_locked_vertices(triangles);
+        std::vector<uint32_t> adjacency_offsets;
+        std::vector<uint32_t> adjacency;
+        std::vector<uint8_t> touched(vertex_count);
+        std::vector<uint32_t> neighbors;
+        std::vector<uint32_t> v_neighbors;
+        struct Collapse{
+            double cost_;
+            uint32_t from_;
+            uint32_t to_;
+        };
+        std::vector<Collapse> collapses;
+        std::vector<Triangle> old_fan;
+        std::vector<Triangle> new_fan;
+
+        while(triangles.size() > target_index_count){
+            build_adjacency(triangles, adjacency_offsets, adjacency);
+            // Cheapest edge of every free vertex.
+            collapses.clear();
+            for(uint32_t from = 0; from < vertex_count; from++){
+                if(locked[from] || adjacency_offsets[from] == adjacency_offsets[from + 1]){
+                    continue;
+                }
+                Collapse best{std::numeric_limits<double>::max(), from, from};
+                for(auto a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; a++){
+                    for(size_t corner = 0; corner < 3; corner++){
+                        auto to = triangles[adjacency[a] * 3 + corner];
+                        if(to == from){
+                            continue;
+                        }
+                        Quadric quadric = quadrics[from];
+                        quadric.add(quadrics[weld_[to]]);
+                        auto cost = quadric.evaluate(positions_[to]);
+                        if(cost < best.cost_){
+                            best = {cost, from, to};
+                        }
+                    }
+                }
+                collapses.push_back(best);
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b){ return a.cost_ < b.cost_; });
+
+            // Independent collapses only: a collapse changes the triangles around from_, so nothing
+            // next to it may change again in this pass.
+            std::fill(touched.begin(), touched.end(), uint8_t{0});
+            size_t removed{};
+            const size_t budget = (triangles.size() - target_index_count) / 3;
+            for(const auto& collapse: collapses){
+                if(removed >= budget){
+                    break;
+                }
+                auto from = collapse.from_;
+                auto to = weld_[collapse.to_];
+                if(touched[from] || touched[to]){
+                    continue;
+                }
+                collect_neighbors(from, triangles, adjacency_offsets, adjacency, neighbors);
+                if(std::any_of(neighbors.begin(), neighbors.end(), [&](uint32_t n){ return touched[n]; }) ||
+                    !satisfies_link_condition(to, triangles, adjacency_offsets, adjacency, neighbors, v_neighbors) ||
+                    flips_triangle(from, collapse.to_, triangles, adjacency_offsets, adjacency)){
+                    continue;
+                }
+
+                old_fan.clear();
+                new_fan.clear();
+                for(auto a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; a++){
+                    auto* triangle = &triangles[adjacency[a] * 3];
+                    old_fan.push_back({positions_[triangle[0]], positions_[triangle[1]], positions_[triangle[2]]});
+                    for(size_t corner = 0; corner < 3; corner++){
+                        if(triangle[corner] == from){
+                            triangle[corner] = collapse.to_;
+                        }
+                    }
+                    if(weld_[triangle[0]] == weld_[triangle[1]] || weld_[triangle[1]] == weld_[triangle[2]] || weld_[triangle[2]] == weld_[triangle[0]]){
+                        removed++;
+                    }else{
+                        new_fan.push_back({positions_[triangle[0]], positions_[triangle[1]], positions_[triangle[2]]});
+                    }
+                }
+                quadrics[to].add(quadrics[from]);
+
+                // Every old fan triangle has from as a corner, so the old fan and the original surface
+                // are within error_bounds_[from] of each other. The new fan is within fan_distance_bound()
+                // of the old fan, both ways, so its corners get the sum.
+                auto bound = error_bounds_[from] + fan_distance_bound(old_fan, new_fan, positions_[from], positions_[to]);
+                for(auto n: neighbors){
+                    error_bounds_[n] = std::max(error_bounds_[n], bound);
+                }
+                max_error_ = std::max(max_error_, bound);
+
+                touched[from] = 1;
+                for(auto n: neighbors){
+                    touched[n] = 1;
+                }
+            }
+            if(removed == 0){
+                break;
+            }
+
+            size_t kept = 0;
+            for(size_t i = 0; i < triangles.size(); i += 3){
+                if(weld_[triangles[i]] != weld_[triangles[i + 1]] && weld_[triangles[i + 1]] != weld_[triangles[i + 2]] &&
+                    weld_[triangles[i + 2]] != weld_[triangles[i]]){
+                    std::copy_n(triangles.begin() + i, 3, triangles.begin() + kept);
+                    kept += 3;
+                }
+            }
+            triangles.resize(kept);
+        }
+        return triangles;
+    }
+
+    private:
+    // Two-sided bound of the distance between the fans around a collapse. Moving from to to linearly
+    // maps the old fan onto the new one and moves no point farther than from moves, which caps it.
+    static double fan_distance_bound(std::span<const simplifier_detail::Triangle> old_fan, std::span<const simplifier_detail::Triangle> new_fan,
+        const simplifier_detail::Vec3& from, const simplifier_detail::Vec3& to){
+        using namespace simplifier_detail;
+        auto move = sub(to, from);
+        auto bound = std::max(simplifier_detail::fan_distance_bound(old_fan, new_fan, to), simplifier_detail::fan_distance_bound(new_fan, old_fan, from));
+        return std::min(bound, std::sqrt(dot(move, move)));
+    }
+
+    // Seam vertices and vertices on an edge that doesn't have exactly two triangles.
+    std::vector<uint8_t> find_locked_vertices(std::span<const uint32_t> triangles) const{
+        std::vector<uint8_t> locked(seam_.begin(), seam_.end());
+        std::unordered_map<uint64_t, uint32_t> edge_triangles;
+        edge_triangles.reserve(triangles.size());
+        auto edge_key = [&](uint32_t a, uint32_t b){
+            a = weld_[a];
+            b = weld_[b];
+            return a < b ? uint64_t{a} << 32 | b : uint64_t{b} << 32 | a;
+        };
+        for(size_t i = 0; i < triangles.size(); i += 3){
+            for(size_t corner = 0; corner < 3; corner++){
+                edge_triangles[edge_key(triangles[i + corner], triangles[i + (corner + 1) % 3])]++;
+            }
+        }
+        for(const auto& [key, count]: edge_triangles){
+            if(count != 2){
+                locked[key >> 32] = 1;
+                locked[key & 0xFFFFFFFFu] = 1;
+            }
+        }
+        // Copies of a locked position are locked too.
+        for(size_t vertex = 0; vertex < locked.size(); vertex++){
+            locked[vertex] = locked[vertex] || locked[weld_[vertex]];
+        }
+        return locked;
+    }
+
+    // Welded vertex -> triangles touching any of its copies, CSR.
+    void build_adjacency(std::span<const uint32_t> triangles, std::vector<uint32_t>& offsets, std::vector<uint32_t>& adjacency) const{
+        offsets.assign(positions_.size() + 1, 0);
+        for(auto index: triangles){
+            offsets[weld_[index] + 1]++;
+        }
+        for(size_t i = 1; i < offsets.size(); i++){
+            offsets[i] += offsets[i - 1];
+        }
+        adjacency.resize(triangles.size());
+        auto next = offsets;
+        for(size_t i = 0; i < triangles.size(); i++){
+            adjacency[next[weld_[triangles[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    // Welded neighbors of a welded vertex, sorted.
+    void collect_neighbors(uint32_t vertex, std::span<const uint32_t> triangles, const std::vector<uint32_t>& offsets,
+        const std::vector<uint32_t>& adjacency, std::vector<uint32_t>& neighbors) const{
+        neighbors.clear();
+        for(auto a = offsets[vertex]; a < offsets[vertex + 1]; a++){
+            for(size_t corner = 0; corner < 3; corner++){
+                auto other = weld_[triangles[adjacency[a] * 3 + corner]];
+                if(other != vertex){
+                    neighbors.push_back(other);
+                }
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    }
+
+    // The collapse keeps the surface manifold if from and to share exactly the two vertices opposite their edge.
+    bool satisfies_link_condition(uint32_t to, std::span<const uint32_t> triangles, const std::vector<uint32_t>& offsets,
+        const std::vector<uint32_t>& adjacency, const std::vector<uint32_t>& from_neighbors, std::vector<uint32_t>& to_neighbors) const{
+        collect_neighbors(to, triangles, offsets, adjacency, to_neighbors);
+        size_t shared{};
+        for(auto n: from_neighbors){
+            shared += std::binary_search(to_neighbors.begin(), to_neighbors.end(), n);
+        }
+        return shared == 2;
+    }
+
+    // True if moving from onto to turns a surviving triangle around from over.
+    bool flips_triangle(uint32_t from, uint32_t to, std::span<const uint32_t> triangles, const std::vector<uint32_t>& offsets,
+        const std::vector<uint32_t>& adjacency) const{
+        using namespace simplifier_detail;
+        for(auto a = offsets[from]; a < offsets[from + 1]; a++){
+            const auto* triangle = &triangles[adjacency[a] * 3];
+            if(weld_[triangle[0]] == weld_[to] || weld_[triangle[1]] == weld_[to] || weld_[triangle[2]] == weld_[to]){
+                continue; // Degenerates and disappears.
+            }
+            std::array<Vec3, 3> corners{positions_[triangle[0]], positions_[triangle[1]], positions_[triangle[2]]};
+            auto before = cross(sub(corners[1], corners[0]), sub(corners[2], corners[0]));
+            for(size_t corner = 0; corner < 3; corner++){
+                if(triangle[corner] == from){
+                    corners[corner] = positions_[to];
+                }
+            }
+            auto after = cross(sub(corners[1], corners[0]), sub(corners[2], corners[0]));
+            // Rejects flips and slivers whose normal turns by more than ~80 degrees.
+            if(dot(before, after) <= 0.2 * std::sqrt(dot(before, before) * dot(after, after))){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<simplifier_detail::Vec3> positions_;
+    // First vertex with the same position.
+    std::vector<uint32_t> weld_;
+    std::vector<uint8_t> seam_;
+    // Per welded vertex: bound of the distance from every point of its current triangles to the original
+    // surface and from the original points those triangles replaced to them.
+    std::vector<double> error_bounds_;
+    double max_error_{};
+};
+
+// Appends coarser LODs to indices, which holds LOD 0, each about half the triangles of the one before.
+// Stops at max_lods, at MIN_LOD_TRIANGLES or when a step removes less than a tenth of the triangles.
+template<typename Position>
+std::vector<Mesh_lod> build_lod_chain(std::vector<uint32_t>& indices, size_t vertex_count, const Position& position, size_t max_lods = 8){
+    std::vector<Mesh_lod> lods{{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+    Mesh_simplifier simplifier{vertex_count, position};
+    while(lods.size() < max_lods && lods.back().index_count_ / 3 > MIN_LOD_TRIANGLES * 2){
+        const auto& previous = lods.back();
+        std::vector<uint32_t> source(indices.begin() + previous.first_index_, indices.begin() + previous.first_index_ + previous.index_count_);
+        auto target = std::max<size_t>(source.size() / 6 * 3, MIN_LOD_TRIANGLES * 3);
+        auto simplified = simplifier.simplify(source, target);
+        if(simplified.size() * 10 > source.size() * 9){
+            break;
+        }
+        // Rounded up, the bound must survive the conversion.
+        auto error = static_cast<float>(simplifier.error());
+        if(error < simplifier.error()){
+            error = std::nextafter(error, std::numeric_limits<float>::max());
+        }
+        lods.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error});
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+    }
+    return lods;
+}
@@ -0,0 +1,373 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+// Splits a triangle list into small clusters (meshlets) that are culled as a whole. Pure CPU, works
+// on any vertex type. A meshlet is a contiguous range of the reordered index list, so it is drawn
+// with one vkCmdDrawIndexed or one indirect command.
+
+// Limits of one meshlet, the sizes mesh shader pipelines are usually tuned for.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// std430 compatible, meshlet_cull.comp reads an array of these.
+struct Meshlet{
+    // Model space center xyz and radius w.
+    std::array<float, 4> bounding_sphere_;
+    // Normal cone axis xyz and cutoff w, see is_meshlet_backfacing(). A cutoff of 1 disables cone culling.
+    std::array<float, 4> cone_;
+    uint32_t first_index_;
+    uint32_t index_count_;
+    uint32_t vertex_count_;
+    uint32_t reserved_;
+};
+
+namespace meshlet_detail{
+
+using Vec3 = std::array<double, 3>;
+
+inline double dot(const Vec3& a, const Vec3& b){
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline Vec3 cross(const Vec3& a, const Vec3& b){
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+// Sphere around the bounding box and normal cone of triangles [first, last) of indices.
+template<typename Position>
+void compute_bounds(std::span<const uint32_t> indices, size_t first, size_t last, const Position& position, Meshlet& meshlet){
+    auto load = [&](uint32_t vertex){
+        auto p = position(vertex);
+        return Vec3{p[0], p[1], p[2]};
+    };
+
+    Vec3 min_position{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    Vec3 max_position{std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+    for(auto i = first * 3; i < last * 3; i++){
+        auto p = load(indices[i]);
+        for(size_t axis = 0; axis < 3; axis++){
+            min_position[axis] = std::min(min_position[axis], p[axis]);
+            max_position[axis] = std::max(max_position[axis], p[axis]);
+        }
+    }
+    Vec3 center{};
+    for(size_t axis = 0; axis < 3; axis++){
+        center[axis] = (min_position[axis] + max_position[axis]) * 0.5;
+    }
+    double radius{};
+    for(auto i = first * 3; i < last * 3; i++){
+        auto p = load(indices[i]);
+        Vec3 offset{p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+        radius = std::max(radius, std::sqrt(dot(offset, offset)));
+    }
+
+    // Axis: mean of the unit normals, cutoff: sine of the widest normal's angle to it.
+    std::vector<Vec3> normals;
+    normals.reserve(last - first);
+    Vec3 axis{};
+    for(auto triangle = first; triangle < last; triangle++){
+        auto a = load(indices[triangle * 3]);
+        auto b = load(indices[triangle * 3 + 1]);
+        auto c = load(indices[triangle * 3 + 2]);
+        auto normal = cross({b[0] - a[0], b[1] - a[1], b[2] - a[2]}, {c[0] - a[0], c[1] - a[1], c[2] - a[2]});
+        auto length = std::sqrt(dot(normal, normal));
+        if(length == 0.0){
+            continue; // Degenerate triangles are never rasterized.
+        }
+        normal = {normal[0] / length, normal[1] / length, normal[2] / length};
+        normals.push_back(normal);
+        for(size_t i = 0; i < 3; i++){
+            axis[i] += normal[i];
+        }
+    }
+    auto axis_length = std::sqrt(dot(axis, axis));
+    double cutoff = 1.0;
+    if(axis_length > 0.0){
+        axis = {axis[0] / axis_length, axis[1] / axis_length, axis[2] / axis_length};
+        double min_dot = 1.0;
+        for(const auto& normal: normals){
+            min_dot = std::min(min_dot, dot(normal, axis));
+        }
+        // Cones of 90 degrees or wider face the camera from every side.
+        if(min_dot > 0.0){
+            cutoff = std::sqrt(std::max(0.0, 1.0 - min_dot * min_dot));
+        }
+    }
+
+    meshlet.bounding_sphere_ = {static_cast<float>(center[0]), static_cast<float>(center[1]), static_cast<float>(center[2]),
+        // Rounded up so the float sphere still contains every vertex.
+        std::nextafter(static_cast<float>(radius), std::numeric_limits<float>::max())};
+    meshlet.cone_ = {static_cast<float>(axis[0]), static_cast<float>(axis[1]), static_cast<float>(axis[2]),
+        cutoff >= 1.0 ? 1.0f : std::nextafter(static_cast<float>(cutoff), 2.0f)};
+}
+
+} // namespace meshlet_detail
+
+// Reorders the triangles of indices in place so every meshlet is a contiguous range and returns the
+// meshlets. Greedy: a meshlet grows by the adjacent triangle adding the fewest new vertices. When either
+// limit is hit the next one starts at a triangle bordering the last, when nothing borders it at the first
+// triangle not emitted yet. Follows the incoming order where it has a choice, so running the mesh optimizer
+// first keeps meshlets compact. position(vertex) returns an std::array<float, 3>.
+template<typename Position>
+std::vector<Meshlet> build_meshlets(std::span<uint32_t> indices, size_t vertex_count, const Position& position,
+    uint32_t max_vertices = MESHLET_MAX_VERTICES, uint32_t max_triangles = MESHLET_MAX_TRIANGLES){
+    const size_t triangle_count = indices.size() / 3;
+    std::vector<Meshlet> meshlets;
+    if(triangle_count == 0){
+        return meshlets;
+    }
+
+    // Vertex -> triangles adjacency in CSR form.
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for(auto index: indices){
+        adjacency_offsets[index + 1]++;
+    }
+    std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        auto next = adjacency_offsets;
+        for(size_t i = 0; i < indices.size(); i++){
+            adjacency[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    // Triangles of every vertex not emitted yet.
+    std::vector<uint32_t> live_triangles(vertex_count);
+    for(size_t vertex = 0; vertex < vertex_count; vertex++){
+        live_triangles[vertex] = adjacency_offsets[vertex + 1] - adjacency_offsets[vertex];
+    }
+
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    // Meshlet a vertex was last added to, so membership is one compare.
+    std::vector<uint32_t> vertex_meshlet(vertex_count, NONE);
+    std::vector<uint8_t> emitted(triangle_count, 0);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    size_t cursor = 0;
+
+    Meshlet meshlet{};
+    // Sum of the meshlet's vertex positions.
+    meshlet_detail::Vec3 center_sum{};
+    std::vector<std::array<float, 3>> triangle_centers(triangle_count);
+    for(size_t triangle = 0; triangle < triangle_count; triangle++){
+        for(size_t corner = 0; corner < 3; corner++){
+            auto p = position(indices[triangle * 3 + corner]);
+            for(size_t axis = 0; axis < 3; axis++){
+                triangle_centers[triangle][axis] += p[axis] / 3.0f;
+            }
+        }
+    }
+    // Meshlet a triangle was last made a candidate of, keeps duplicates out of candidates.
+    std::vector<uint32_t> candidate_meshlet(triangle_count, NONE);
+    auto meshlet_id = [&]{ return static_cast<uint32_t>(meshlets.size()); };
+    auto new_vertices = [&](uint32_t triangle){
+        uint32_t count{};
+        for(size_t corner = 0; corner < 3; corner++){
+            count += vertex_meshlet[indices[triangle * 3 + corner]] != meshlet_id();
+        }
+        return count;
+    };
+    auto add_triangle = [&](uint32_t triangle){
+        for(size_t corner = 0; corner < 3; corner++){
+            auto vertex = indices[triangle * 3 + corner];
+            if(vertex_meshlet[vertex] != meshlet_id()){
+                vertex_meshlet[vertex] = meshlet_id();
+                meshlet.vertex_count_++;
+                auto p = position(vertex);
+                for(size_t axis = 0; axis < 3; axis++){
+                    center_sum[axis] += p[axis];
+                }
+                for(auto a = adjacency_offsets[vertex]; a < adjacency_offsets[vertex + 1]; a++){
+                    auto neighbor = adjacency[a];
+                    if(!emitted[neighbor] && candidate_meshlet[neighbor] != meshlet_id()){
+                        candidate_meshlet[neighbor] = meshlet_id();
+                        candidates.push_back(neighbor);
+                    }
+                }
+            }
+            output.push_back(vertex);
+            live_triangles[vertex]--;
+        }
+        emitted[triangle] = 1;
+        meshlet.index_count_ += 3;
+    };
+    // Closes the full meshlet and returns the next one's seed: the bordering triangle with the fewest live
+    // neighbors, filling corners first instead of leaving small islands behind. NONE without a border.
+    auto finish_meshlet = [&]{
+        meshlets.push_back(meshlet);
+        meshlet = {};
+        center_sum = {};
+        meshlet.first_index_ = static_cast<uint32_t>(output.size());
+
+        uint32_t seed = NONE;
+        uint32_t seed_neighbors = NONE;
+        for(auto triangle: candidates){
+            if(emitted[triangle]){
+                continue;
+            }
+            uint32_t neighbors{};
+            for(size_t corner = 0; corner < 3; corner++){
+                neighbors += live_triangles[indices[triangle * 3 + corner]];
+            }
+            if(neighbors < seed_neighbors){
+                seed = triangle;
+                seed_neighbors = neighbors;
+            }
+        }
+        candidates.clear();
+        return seed;
+    };
+
+    while(output.size() < indices.size()){
+        // Adjacent triangle adding the fewest vertices, the one closest to the meshlet's center among
+        // those, so meshlets stay round. Emitted triangles are dropped from the list on the way.
+        uint32_t best = NONE;
+        uint32_t best_new = 4;
+        double best_distance = std::numeric_limits<double>::max();
+        for(size_t i = 0; i < candidates.size();){
+            auto triangle = candidates[i];
+            if(emitted[triangle]){
+                candidates[i] = candidates.back();
+                candidates.pop_back();
+                continue;
+            }
+            i++;
+            auto count = new_vertices(triangle);
+            if(count > best_new || meshlet.vertex_count_ + count > max_vertices){
+                continue;
+            }
+            double distance{};
+            for(size_t axis = 0; axis < 3; axis++){
+                double offset = triangle_centers[triangle][axis] - center_sum[axis] / meshlet.vertex_count_;
+                distance += offset * offset;
+            }
+            if(count < best_new || distance < best_distance){
+                best = triangle;
+                best_new = count;
+                best_distance = distance;
+            }
+        }
+
+        if(best == NONE && meshlet.index_count_ > 0){
+            best = finish_meshlet(); // Out of vertices, or the island is used up.
+        }
+        if(best == NONE){
+            while(emitted[cursor]){
+                cursor++;
+            }
+            best = static_cast<uint32_t>(cursor);
+        }
+        add_triangle(best);
+        while(meshlet.index_count_ / 3 == max_triangles){
+            auto seed = finish_meshlet();
+            if(seed == NONE){
+                break;
+            }
+            add_triangle(seed);
+        }
+    }
+    if(meshlet.index_count_ > 0){
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+    for(auto& m: meshlets){
+        meshlet_detail::compute_bounds(indices, m.first_index_ / 3, (m.first_index_ + m.index_count_) / 3, position, m);
+    }
+    return meshlets;
+}
+
+// camera is in the meshlet's model space. True if every triangle of the meshlet faces away from it,
+// for counter-clockwise front faces: the view direction to any point of the bounding sphere makes an
+// angle of less than 90 degrees minus the cone's half angle with the cone axis.
+inline bool is_meshlet_backfacing(const Meshlet& meshlet, const std::array<float, 3>& camera){
+    const auto& sphere = meshlet.bounding_sphere_;
+    const auto& cone = meshlet.cone_;
+    if(cone[3] >= 1.0f){
+        return false;
+    }
+    std::array<float, 3> offset{sphere[0] - camera[0], sphere[1] - camera[1], sphere[2] - camera[2]};
+    auto distance = std::sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+    return offset[0] * cone[0] + offset[1] * cone[1] + offset[2] * cone[2] >= cone[3] * distance + sphere[3];
+}
+
+// planes are the six inward facing frustum planes in the sphere's space, unnormalized (xyz normal, w distance).
+inline bool is_sphere_outside_frustum(const std::array<float, 4>& sphere, std::span<const std::array<float, 4>, 6> planes){
+    for(const auto& plane: planes){
+        auto length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if(plane[0] * sphere[0] + plane[1] * sphere[1] + plane[2] * sphere[2] + plane[3] < -sphere[3] * length){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Empty when the meshlets are a valid split of the original triangles, otherwise the first problem.
+// original holds the index list before build_meshlets(), reordered the one after it.
+template<typename Position>
+std::string_view validate_meshlets(std::span<const Meshlet> meshlets, std::span<const uint32_t> original, std::span<const uint32_t> reordered,
+    const Position& position, uint32_t max_vertices = MESHLET_MAX_VERTICES, uint32_t max_triangles = MESHLET_MAX_TRIANGLES){
+    // Meshlets tile the index list in order.
+    uint32_t next_index{};
+    for(const auto& meshlet: meshlets){
+        if(meshlet.first_index_ != next_index || meshlet.index_count_ == 0 || meshlet.index_count_ % 3 != 0){
+            return "meshlets don't tile the index list";
+        }
+        next_index += meshlet.index_count_;
+
+        if(meshlet.index_count_ / 3 > max_triangles){
+            return "too many triangles in a meshlet";
+        }
+        std::vector<uint32_t> vertices(reordered.begin() + meshlet.first_index_, reordered.begin() + meshlet.first_index_ + meshlet.index_count_);
+        std::sort(vertices.begin(), vertices.end());
+        auto distinct = static_cast<size_t>(std::unique(vertices.begin(), vertices.end()) - vertices.begin());
+        if(distinct != meshlet.vertex_count_ || distinct > max_vertices){
+            return "wrong or too many vertices in a meshlet";
+        }
+
+        const auto& sphere = meshlet.bounding_sphere_;
+        for(size_t i = 0; i < distinct; i++){
+            auto p = position(vertices[i]);
+            meshlet_detail::Vec3 offset{p[0] - sphere[0], p[1] - sphere[1], p[2] - sphere[2]};
+            if(std::sqrt(meshlet_detail::dot(offset, offset)) > sphere[3] * (1.0 + 1e-5) + 1e-6){
+                return "vertex outside the bounding sphere";
+            }
+        }
+
+        // Every normal lies within the cone: its angle to the axis is at most acos(sqrt(1 - cutoff^2)).
+        const auto& cone = meshlet.cone_;
+        if(cone[3] < 1.0f){
+            auto min_dot = std::sqrt(std::max(0.0, 1.0 - static_cast<double>(cone[3]) * cone[3]));
+            for(auto i = meshlet.first_index_; i < meshlet.first_index_ + meshlet.index_count_; i += 3){
+                auto a = position(reordered[i]);
+                auto b = position(reordered[i + 1]);
+                auto c = position(reordered[i + 2]);
+                auto normal = meshlet_detail::cross({static_cast<double>(b[0]) - a[0], static_cast<double>(b[1]) - a[1], static_cast<double>(b[2]) - a[2]},
+                    {static_cast<double>(c[0]) - a[0], static_cast<double>(c[1]) - a[1], static_cast<double>(c[2]) - a[2]});
+                auto length = std::sqrt(meshlet_detail::dot(normal, normal));
+                if(length > 0.0 && meshlet_detail::dot(normal, {cone[0], cone[1], cone[2]}) < (min_dot - 1e-4) * length){
+                    return "triangle normal outside the normal cone";
+                }
+            }
+        }
+    }
+    if(next_index != reordered.size() || original.size() != reordered.size()){
+        return "meshlets don't cover the index list";
+    }
+    if(canonical_triangles(original) != canonical_triangles(reordered)){
+        return "triangles changed";
+    }
+    return {};
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// The AVX2 path is compiled with a target attribute and picked at run time, so it doesn't need -mavx2.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MIP_AVX2_DISPATCH 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "worker_pool.h"
+
+// CPU mip chains for RGBA8 sRGB textures. Every level is a 2x2 box filter of the one before it in
+// linear light, like vkCmdBlitImage with VK_FILTER_LINEAR on an sRGB image; alpha is linear. Odd
+// sizes drop the last row or column the way the blit does. The per pixel math uses AVX2 when the CPU
+// has it, otherwise SSE2 or NEON when the compiler targets them; rows are split across a Worker_pool.
+
+// A level of a packed chain, offset_ in bytes from the start of level 0.
+struct Mip_level{
+    size_t offset_;
+    uint32_t width_;
+    uint32_t height_;
+};
+
+// Every level tightly packed one after the other, the layout a single buffer to image copy reads.
+struct Mip_chain{
+    std::vector<Mip_level> levels_;
+    std::vector<uint8_t> pixels_;
+};
+
+inline std::vector<Mip_level> mip_chain_layout(uint32_t width, uint32_t height){
+    std::vector<Mip_level> levels;
+    size_t offset{};
+    while(true){
+        levels.push_back({offset, width, height});
+        offset += size_t{width} * height * 4;
+        if(width == 1 && height == 1){
+            return levels;
+        }
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+}
+
+inline size_t mip_chain_size(std::span<const Mip_level> levels){
+    return levels.back().offset_ + size_t{levels.back().width_} * levels.back().height_ * 4;
+}
+
+namespace mip_detail{
+
+inline float srgb_to_linear(float value){
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linear_to_srgb(float value){
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Linear values are quantized to 16 bits before encoding, fine enough that the table only differs
+// from the exact encode where the exact value is within 0.05 of a rounding boundary.
+constexpr uint32_t ENCODE_STEPS = 65535;
+constexpr uint32_t ALPHA_TABLE = ENCODE_STEPS + 1;
+
+struct Tables{
+    // 256 sRGB decodes followed by 256 linear alpha values.
+    std::array<float, 512> decode_;
+    // sRGB encodes of every step followed by linear alpha encodes, padded for 4 byte gathers.
+    std::array<uint8_t, 2 * ALPHA_TABLE + 4> encode_;
+};
+
+inline const Tables& tables(){
+    static const Tables tables = []{
+        Tables result{};
+        for(uint32_t value = 0; value < 256; value++){
+            result.decode_[value] = srgb_to_linear(static_cast<float>(value) / 255.0f);
+            result.decode_[256 + value] = static_cast<float>(value) / 255.0f;
+        }
+        for(uint32_t step = 0; step <= ENCODE_STEPS; step++){
+            auto encoded = linear_to_srgb(static_cast<float>(step) / static_cast<float>(ENCODE_STEPS));
+            result.encode_[step] = static_cast<uint8_t>(std::lround(std::clamp(encoded, 0.0f, 1.0f) * 255.0f));
+            result.encode_[ALPHA_TABLE + step] = static_cast<uint8_t>((step * 255 + ENCODE_STEPS / 2) / ENCODE_STEPS);
+        }
+        return result;
+    }();
+    return tables;
+}
+
+// Quantized linear RGBA to sRGB8, alpha stays linear.
+inline void encode_pixel(const int32_t* steps, uint8_t* out, const Tables& tables){
+    out[0] = tables.encode_[steps[0]];
+    out[1] = tables.encode_[steps[1]];
+    out[2] = tables.encode_[steps[2]];
+    out[3] = tables.encode_[ALPHA_TABLE + steps[3]];
+}
+
+#if defined(MIP_AVX2_DISPATCH)
+// Whether downsample_span() takes the AVX2 path, set from the CPU on first use. Tests turn it off to
+// check the fallback.
+inline bool& use_avx2(){
+    static bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+// Decodes source pixels 2x .. 2x + 3 of one row and sums them pairwise into two outputs, one per 128 bit lane.
+__attribute__((target("avx2"))) inline __m256 sum_row_avx2(const uint8_t* row, const float* decode){
+    const __m256i decode_offsets = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+    __m256 first = _mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(bytes), decode_offsets), 4);
+    __m256 second = _mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)), decode_offsets), 4);
+    return _mm256_add_ps(_mm256_permute2f128_ps(first, second, 0x20), _mm256_permute2f128_ps(first, second, 0x31));
+}
+
+// Output pixels from x on, two per iteration, decoded and encoded with gathers. Returns the first pixel left.
+__attribute__((target("avx2"))) inline uint32_t downsample_pairs_avx2(const uint8_t* row0, const uint8_t* row1, uint8_t* out, uint32_t x, uint32_t last,
+    const Tables& t){
+    const __m256i encode_offsets = _mm256_setr_epi32(0, 0, 0, ALPHA_TABLE, 0, 0, 0, ALPHA_TABLE);
+    const __m256 scale = _mm256_set1_ps(0.25f * ENCODE_STEPS);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i low_bytes = _mm256_set1_epi32(0xFF);
+    const __m256i gather_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    for(; x + 2 <= last; x += 2){
+        __m256 sum = _mm256_add_ps(sum_row_avx2(row0 + x * 8, t.decode_.data()), sum_row_avx2(row1 + x * 8, t.decode_.data()));
+        __m256i steps = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(sum, scale), half)), encode_offsets);
+        __m256i encoded = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(t.encode_.data()), steps, 1), low_bytes);
+        encoded = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(encoded, gather_bytes), _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm256_castsi256_si128(encoded));
+    }
+    return x;
+}
+#endif
+
+// Output pixels [first, last) of a row from source rows row0 and row1, the source is at least 2 wide.
+inline void downsample_span(const uint8_t* row0, const uint8_t* row1, uint8_t* out, uint32_t first, uint32_t last){
+    const auto& t = tables();
+    const float* d = t.decode_.data();
+    uint32_t x = first;
+#if defined(MIP_AVX2_DISPATCH)
+    if(use_avx2()){
+        x = downsample_pairs_avx2(row0, row1, out, x, last, t);
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 scale4 = _mm_set1_ps(0.25f * ENCODE_STEPS);
+    const __m128 half4 = _mm_set1_ps(0.5f);
+    alignas(16) int32_t steps4[4];
+    auto load = [&](const uint8_t* p){
+        return _mm_set_ps(d[256 + p[3]], d[p[2]], d[p[1]], d[p[0]]);
+    };
+    for(; x < last; x++){
+        auto* a = row0 + x * 8;
+        auto* b = row1 + x * 8;
+        __m128 sum = _mm_add_ps(_mm_add_ps(load(a), load(a + 4)), _mm_add_ps(load(b), load(b + 4)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(steps4), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(sum, scale4), half4)));
+        encode_pixel(steps4, out + x * 4, t);
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t scale4 = vdupq_n_f32(0.25f * ENCODE_STEPS);
+    const float32x4_t half4 = vdupq_n_f32(0.5f);
+    int32_t steps4[4];
+    auto load = [&](const uint8_t* p){
+        const float values[4]{d[p[0]], d[p[1]], d[p[2]], d[256 + p[3]]};
+        return vld1q_f32(values);
+    };
+    for(; x < last; x++){
+        auto* a = row0 + x * 8;
+        auto* b = row1 + x * 8;
+        float32x4_t sum = vaddq_f32(vaddq_f32(load(a), load(a + 4)), vaddq_f32(load(b), load(b + 4)));
+        vst1q_s32(steps4, vcvtq_s32_f32(vmlaq_f32(half4, sum, scale4)));
+        encode_pixel(steps4, out + x * 4, t);
+    }
+#else
+    int32_t steps[4];
+    for(; x < last; x++){
+        auto* a = row0 + x * 8;
+        auto* b = row1 + x * 8;
+        for(size_t channel = 0; channel < 4; channel++){
+            auto offset = channel == 3 ? 256 : 0;
+            auto sum = d[offset + a[channel]] + d[offset + a[channel + 4]] + d[offset + b[channel]] + d[offset + b[channel + 4]];
+            steps[channel] = static_cast<int32_t>(sum * (0.25f * ENCODE_STEPS) + 0.5f);
+        }
+        encode_pixel(steps, out + x * 4, t);
+    }
+#endif
+}
+
+// Rows [first_row, last_row) of level dst from level src.
+inline void downsample_rows(const uint8_t* src, const Mip_level& src_level, uint8_t* dst, const Mip_level& dst_level, uint32_t first_row, uint32_t last_row){
+    const size_t src_stride = size_t{src_level.width_} * 4;
+    for(uint32_t y = first_row; y < last_row; y++){
+        auto* row0 = src + std::min(2 * y, src_level.height_ - 1) * src_stride;
+        auto* row1 = src + std::min(2 * y + 1, src_level.height_ - 1) * src_stride;
+        auto* out = dst + size_t{y} * dst_level.width_ * 4;
+        if(src_level.width_ >= 2){
+            downsample_span(row0, row1, out, 0, dst_level.width_);
+            continue;
+        }
+        // 1 wide source: both columns are the same pixel.
+        const uint8_t corners[16]{row0[0], row0[1], row0[2], row0[3], row0[0], row0[1], row0[2], row0[3],
+            row1[0], row1[1], row1[2], row1[3], row1[0], row1[1], row1[2], row1[3]};
+        downsample_span(corners, corners + 8, out, 0, 1);
+    }
+}
+
+} // namespace mip_detail
+
+// The path downsample_span() takes on this CPU.
+inline const char* mip_simd_name(){
+#if defined(MIP_AVX2_DISPATCH)
+    if(mip_detail::use_avx2()){
+        return "AVX2";
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    return "SSE2";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// Copies pixels (width * height RGBA8 sRGB) into level 0 and filters every level below it. Without a
+// pool, or for small levels, everything runs on the calling thread.
+inline Mip_chain generate_mip_chain(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, Worker_pool* pool = nullptr){
+    // Rows per task, small enough to balance, large enough that the fork/join stays cheap.
+    constexpr uint32_t ROWS_PER_TASK = 16;
+    Mip_chain chain{mip_chain_layout(width, height), {}};
+    chain.pixels_.resize(mip_chain_size(chain.levels_));
+    std::memcpy(chain.pixels_.data(), pixels.data(), size_t{width} * height * 4);
+    for(size_t level = 1; level < chain.levels_.size(); level++){
+        const auto& src_level = chain.levels_[level - 1];
+        const auto& dst_level = chain.levels_[level];
+        auto* src = chain.pixels_.data() + src_level.offset_;
+        auto* dst = chain.pixels_.data() + dst_level.offset_;
+        const uint32_t task_count = (dst_level.height_ + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+        if(!pool || task_count < 2){
+            mip_detail::downsample_rows(src, src_level, dst, dst_level, 0, dst_level.height_);
+            continue;
+        }
+        pool->parallel_for(task_count, [&](size_t task){
+            auto first_row = static_cast<uint32_t>(task) * ROWS_PER_TASK;
+            mip_detail::downsample_rows(src, src_level, dst, dst_level, first_row, std::min(first_row + ROWS_PER_TASK, dst_level.height_));
+        });
+    }
+    return chain;
+}
+
+// Scalar reference for one level: exact sRGB curves in double precision, no tables.
+inline void downsample_level_reference(const uint8_t* src, const Mip_level& src_level, uint8_t* dst, const Mip_level& dst_level){
+    auto decode = [](uint8_t value, size_t channel){
+        double normalized = value / 255.0;
+        if(channel == 3){
+            return normalized;
+        }
+        return normalized <= 0.04045 ? normalized / 12.92 : std::pow((normalized + 0.055) / 1.055, 2.4);
+    };
+    auto encode = [](double value, size_t channel){
+        if(channel != 3){
+            value = value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+        }
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0, 1.0) * 255.0));
+    };
+    for(uint32_t y = 0; y < dst_level.height_; y++){
+        for(uint32_t x = 0; x < dst_level.width_; x++){
+            for(size_t channel = 0; channel < 4; channel++){
+                double sum{};
+                for(uint32_t sy: {2 * y, 2 * y + 1}){
+                    for(uint32_t sx: {2 * x, 2 * x + 1}){
+                        auto index = (size_t{std::min(sy, src_level.height_ - 1)} * src_level.width_ + std::min(sx, src_level.width_ - 1)) * 4;
+                        sum += decode(src[index + channel], channel);
+                    }
+                }
+                dst[(size_t{y} * dst_level.width_ + x) * 4 + channel] = encode(sum * 0.25, channel);
+            }
+        }
+    }
+}
+
+// generate_mip_chain() with downsample_level_reference(). For tests and benchmarks.
+inline Mip_chain generate_mip_chain_reference(std::span<const uint8_t> pixels, uint32_t width, uint32_t height){
+    Mip_chain chain{mip_chain_layout(width, height), {}};
+    chain.pixels_.resize(mip_chain_size(chain.levels_));
+    std::memcpy(chain.pixels_.data(), pixels.data(), size_t{width} * height * 4);
+    for(size_t level = 1; level < chain.levels_.size(); level++){
+        downsample_level_reference(chain.pixels_.data() + chain.levels_[level - 1].offset_, chain.levels_[level - 1],
+            chain.pixels_.data() + chain.levels_[level].offset_, chain.levels_[level]);
+    }
+    return chain;
+}
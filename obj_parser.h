@@ -0,0 +1,293 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "worker_pool.h"
+
+// Obj_corner::texcoord_ of a corner written without one ("f v" or "f v//vn").
+constexpr uint32_t OBJ_NO_TEXCOORD = std::numeric_limits<uint32_t>::max();
+
+// Triangle corner of an OBJ face, 0-based indices into Obj_mesh.
+struct Obj_corner{
+    uint32_t position_;
+    uint32_t texcoord_;
+};
+
+// The parts of an OBJ the app draws, laid out like tinyobj::attrib_t.
+struct Obj_mesh{
+    // xyz per "v" line.
+    std::vector<float> positions_;
+    // uv per "vt" line.
+    std::vector<float> texcoords_;
+    // Faces fanned into triangles, three per triangle in file order.
+    std::vector<Obj_corner> corners_;
+};
+
+namespace obj_detail{
+
+inline bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_spaces(const char* p, const char* end){
+    while(p < end && is_space(*p)){
+        p++;
+    }
+    return p;
+}
+
+inline bool parse_float(const char*& p, const char* end, float& value){
+    p = skip_spaces(p, end);
+    if(p < end && *p == '+'){
+        p++;
+    }
+    auto [next, error] = std::from_chars(p, end, value);
+    if(error != std::errc{}){
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+inline bool parse_index(const char*& p, const char* end, int64_t& value){
+    auto [next, error] = std::from_chars(p, end, value);
+    if(error != std::errc{}){
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+constexpr uint8_t RELATIVE_POSITION = 1;
+constexpr uint8_t RELATIVE_TEXCOORD = 2;
+
+struct Chunk{
+    Obj_mesh mesh_;
+    // Largest 1-based indices referenced by the chunk's faces.
+    int64_t max_position_{};
+    int64_t max_texcoord_{};
+    // RELATIVE_* flags per corner, empty until the chunk's first negative index.
+    std::vector<uint8_t> relative_;
+    bool supported_ = true;
+};
+
+// A positive index is global. A negative one counts back from the last line of its kind so far, but only
+// the lines of this chunk are known here: it is stored relative to the chunk's first line, as an int32,
+// and parse_obj() adds the chunk's offset once every chunk is parsed.
+inline bool resolve_index(int64_t index, size_t chunk_count, int64_t& max_index, uint32_t& value, bool& relative){
+    if(index > 0 && index < static_cast<int64_t>(OBJ_NO_TEXCOORD)){
+        max_index = std::max(max_index, index);
+        value = static_cast<uint32_t>(index - 1);
+        relative = false;
+        return true;
+    }
+    const int64_t local = static_cast<int64_t>(chunk_count) + index;
+    if(index == 0 || local < std::numeric_limits<int32_t>::min() || local > std::numeric_limits<int32_t>::max()){
+        return false;
+    }
+    value = static_cast<uint32_t>(static_cast<int32_t>(local));
+    relative = true;
+    return true;
+}
+
+// "f v[/vt][/vn] ..." with three or more corners, fanned from the first corner like tinyobj does for
+// convex polygons. Relative indices are resolved against the v/vt lines before the face.
+inline bool parse_face(const char* p, const char* end, Chunk& chunk){
+    auto& corners = chunk.mesh_.corners_;
+    const size_t chunk_positions = chunk.mesh_.positions_.size() / 3;
+    const size_t chunk_texcoords = chunk.mesh_.texcoords_.size() / 2;
+    auto emit = [&](Obj_corner corner, uint8_t relative){
+        if(relative || !chunk.relative_.empty()){
+            chunk.relative_.resize(corners.size());
+            chunk.relative_.push_back(relative);
+        }
+        corners.push_back(corner);
+    };
+
+    std::array<Obj_corner, 2> fan{};
+    std::array<uint8_t, 2> fan_relative{};
+    size_t count{};
+    while(true){
+        p = skip_spaces(p, end);
+        if(p == end){
+            break;
+        }
+        int64_t position{};
+        int64_t texcoord{};
+        bool has_texcoord = false;
+        if(!parse_index(p, end, position)){
+            return false;
+        }
+        if(p < end && *p == '/'){
+            p++;
+            if(p < end && *p != '/'){
+                if(!parse_index(p, end, texcoord)){
+                    return false;
+                }
+                has_texcoord = true;
+            }
+            if(p < end && *p == '/'){
+                int64_t normal{};
+                parse_index(++p, end, normal);
+            }
+        }
+        if(p < end && !is_space(*p)){
+            return false;
+        }
+
+        Obj_corner corner{0, OBJ_NO_TEXCOORD};
+        bool position_relative = false;
+        bool texcoord_relative = false;
+        if(!resolve_index(position, chunk_positions, chunk.max_position_, corner.position_, position_relative) ||
+            (has_texcoord && !resolve_index(texcoord, chunk_texcoords, chunk.max_texcoord_, corner.texcoord_, texcoord_relative))){
+            return false;
+        }
+        auto relative = static_cast<uint8_t>((position_relative ? RELATIVE_POSITION : 0) | (texcoord_relative ? RELATIVE_TEXCOORD : 0));
+        if(count >= 2){
+            emit(fan[0], fan_relative[0]);
+            emit(fan[1], fan_relative[1]);
+            emit(corner, relative);
+        }
+        const size_t slot = count == 0 ? 0 : 1;
+        fan[slot] = corner;
+        fan_relative[slot] = relative;
+        count++;
+    }
+    return count >= 3;
+}
+
+// Stops early once any chunk failed, the whole parse is thrown away then.
+inline void parse_chunk(const char* begin, const char* end, Chunk& chunk, const std::atomic<bool>& failed){
+    for(auto line = begin; line < end && !failed.load(std::memory_order_relaxed);){
+        auto line_end = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+        line_end = line_end ? line_end : end;
+        auto p = skip_spaces(line, line_end);
+        line = line_end + 1;
+        if(line_end - p < 2 || !(p[0] == 'v' || p[0] == 'f')){
+            continue; // Blank, comment, group, material, smoothing, line and point elements.
+        }
+
+        if(p[0] == 'f' && is_space(p[1])){
+            chunk.supported_ = parse_face(p + 2, line_end, chunk);
+        }else if(p[0] == 'v' && is_space(p[1])){
+            // A trailing w or vertex color is ignored like the app ignores tinyobj's.
+            float x{}, y{}, z{};
+            p += 2;
+            chunk.supported_ = parse_float(p, line_end, x) && parse_float(p, line_end, y) && parse_float(p, line_end, z);
+            chunk.mesh_.positions_.insert(chunk.mesh_.positions_.end(), {x, y, z});
+        }else if(p[0] == 'v' && p[1] == 't' && (p + 2 == line_end || is_space(p[2]))){
+            // tinyobj defaults a missing v to 0.
+            float u{}, v{};
+            p += 2;
+            chunk.supported_ = parse_float(p, line_end, u);
+            if(skip_spaces(p, line_end) != line_end){
+                chunk.supported_ = chunk.supported_ && parse_float(p, line_end, v);
+            }
+            chunk.mesh_.texcoords_.insert(chunk.mesh_.texcoords_.end(), {u, v});
+        }
+        if(!chunk.supported_){
+            return;
+        }
+    }
+}
+
+} // namespace obj_detail
+
+// Parses line aligned chunks of the file concurrently and concatenates them, so the result matches
+// a sequential read. Polygons are fanned and relative indices resolved, faces without texture coordinates
+// get OBJ_NO_TEXCOORD. Returns nothing only for malformed files: unparsable v/vt/f lines, faces with fewer
+// than three corners, indices out of range. The first such line stops every chunk, so a fallback to
+// tinyobj costs little more than reading up to that line.
+// Floats are correctly rounded, tinyobj's own parser may differ in the last bit.
+inline std::optional<Obj_mesh> parse_obj(std::span<const std::byte> file, Worker_pool& pool){
+    auto text = reinterpret_cast<const char*>(file.data());
+    auto size = file.size();
+
+    const size_t chunk_count = std::max<size_t>(1, std::min(pool.size() * 4, size / (1 << 20)));
+    std::vector<const char*> bounds(chunk_count + 1, text + size);
+    bounds[0] = text;
+    for(size_t i = 1; i < chunk_count; i++){
+        auto start = std::max(bounds[i - 1], text + size * i / chunk_count);
+        auto newline = static_cast<const char*>(std::memchr(start, '\n', static_cast<size_t>(text + size - start)));
+        bounds[i] = newline ? newline + 1 : text + size;
+    }
+
+    std::vector<obj_detail::Chunk> chunks(chunk_count);
+    std::atomic<bool> failed{false};
+    pool.parallel_for(chunk_count, [&](size_t i){
+        obj_detail::parse_chunk(bounds[i], bounds[i + 1], chunks[i], failed);
+        if(!chunks[i].supported_){
+            failed.store(true, std::memory_order_relaxed);
+        }
+    });
+    if(failed){
+        return std::nullopt;
+    }
+
+    // Offsets of every chunk in the concatenated arrays.
+    std::vector<size_t> position_offsets(chunk_count + 1), texcoord_offsets(chunk_count + 1), corner_offsets(chunk_count + 1);
+    int64_t max_position{}, max_texcoord{};
+    for(size_t i = 0; i < chunk_count; i++){
+        const auto& chunk = chunks[i];
+        position_offsets[i + 1] = position_offsets[i] + chunk.mesh_.positions_.size();
+        texcoord_offsets[i + 1] = texcoord_offsets[i] + chunk.mesh_.texcoords_.size();
+        corner_offsets[i + 1] = corner_offsets[i] + chunk.mesh_.corners_.size();
+        max_position = std::max(max_position, chunk.max_position_);
+        max_texcoord = std::max(max_texcoord, chunk.max_texcoord_);
+    }
+    if(static_cast<size_t>(max_position) * 3 > position_offsets[chunk_count] ||
+        static_cast<size_t>(max_texcoord) * 2 > texcoord_offsets[chunk_count] ||
+        position_offsets[chunk_count] / 3 >= OBJ_NO_TEXCOORD ||
+        texcoord_offsets[chunk_count] / 2 >= OBJ_NO_TEXCOORD){
+        return std::nullopt;
+    }
+
+    // Chunks are released as soon as they are copied, so peak memory stays below twice the result;
+    // the file itself is only mapped. Relative indices get their chunk's offset on the way.
+    Obj_mesh mesh;
+    mesh.positions_.resize(position_offsets[chunk_count]);
+    mesh.texcoords_.resize(texcoord_offsets[chunk_count]);
+    mesh.corners_.resize(corner_offsets[chunk_count]);
+    pool.parallel_for(chunk_count, [&](size_t i){
+        auto& chunk = chunks[i].mesh_;
+        std::copy(chunk.positions_.begin(), chunk.positions_.end(), mesh.positions_.begin() + position_offsets[i]);
+        std::copy(chunk.texcoords_.begin(), chunk.texcoords_.end(), mesh.texcoords_.begin() + texcoord_offsets[i]);
+        auto corners = mesh.corners_.begin() + corner_offsets[i];
+        std::copy(chunk.corners_.begin(), chunk.corners_.end(), corners);
+        const auto& relative = chunks[i].relative_;
+        const auto position_base = static_cast<int64_t>(position_offsets[i] / 3);
+        const auto texcoord_base = static_cast<int64_t>(texcoord_offsets[i] / 2);
+        for(size_t c = 0; c < relative.size(); c++){
+            auto& corner = corners[static_cast<std::ptrdiff_t>(c)];
+            if(relative[c] & obj_detail::RELATIVE_POSITION){
+                auto position = position_base + static_cast<int32_t>(corner.position_);
+                chunks[i].supported_ = chunks[i].supported_ && position >= 0;
+                corner.position_ = static_cast<uint32_t>(position);
+            }
+            if(relative[c] & obj_detail::RELATIVE_TEXCOORD){
+                auto texcoord = texcoord_base + static_cast<int32_t>(corner.texcoord_);
+                chunks[i].supported_ = chunks[i].supported_ && texcoord >= 0;
+                corner.texcoord_ = static_cast<uint32_t>(texcoord);
+            }
+        }
+        chunk = {};
+        chunks[i].relative_ = {};
+    });
+    // A relative index reaching back before the first line.
+    for(const auto& chunk: chunks){
+        if(!chunk.supported_){
+            return std::nullopt;
+        }
+    }
+    return mesh;
+}
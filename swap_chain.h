@@ -1,5 +1,9 @@
 #pragma once
 #include "tiny-vulkan.h"
+#include <array>
+#include <optional>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
@@ -12,3 +16,29 @@ struct Swap_chain_support_details{
     std::vector<VkSurfaceFormatKHR>formats_;
     std::vector<VkPresentModeKHR> present_modes_;
 };
+
+// Command line spelling of the present modes.
+constexpr std::array<std::pair<std::string_view, VkPresentModeKHR>, 4> PRESENT_MODE_NAMES{{
+    {"fifo", VK_PRESENT_MODE_FIFO_KHR},
+    {"fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+    {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+    {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR},
+}};
+
+inline std::optional<VkPresentModeKHR> present_mode_from_name(std::string_view name){
+    for(auto [mode_name, mode]: PRESENT_MODE_NAMES){
+        if(mode_name == name){
+            return mode;
+        }
+    }
+    return std::nullopt;
+}
+
+inline std::string_view present_mode_name(VkPresentModeKHR mode){
+    for(auto [mode_name, named_mode]: PRESENT_MODE_NAMES){
+        if(named_mode == mode){
+            return mode_name;
+        }
+    }
+    return "unknown";
+}
@@ -0,0 +1,235 @@
+// Block_suballocator's placement policy and Device_memory_allocator's block management, against fake
+// memory entry points instead of a device.
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "memory_allocator.h"
+#include "test_check.h"
+
+namespace{
+
+// One device local and one host visible type on a 64 MiB heap, so blocks are 8 MiB.
+constexpr VkDeviceSize HEAP_SIZE = VkDeviceSize{64} << 20;
+constexpr VkDeviceSize GRANULARITY = 1024;
+
+struct Fake_device{
+    uint64_t next_handle_ = 1;
+    std::map<VkDeviceMemory, std::unique_ptr<char[]>> mapped_;
+    uint64_t allocations_{};
+    uint64_t frees_{};
+} fake_device;
+
+} // namespace
+
+extern "C"{
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* properties){
+    *properties = {};
+    properties->memoryTypeCount = 2;
+    properties->memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+    properties->memoryTypes[1] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0};
+    properties->memoryHeapCount = 1;
+    properties->memoryHeaps[0] = {HEAP_SIZE, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* properties){
+    *properties = {};
+    properties->limits.bufferImageGranularity = GRANULARITY;
+    properties->limits.nonCoherentAtomSize = 64;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* info, const VkAllocationCallbacks*, VkDeviceMemory* memory){
+    *memory = reinterpret_cast<VkDeviceMemory>(fake_device.next_handle_++);
+    if(info->memoryTypeIndex == 1){
+        fake_device.mapped_[*memory] = std::make_unique<char[]>(info->allocationSize);
+    }
+    fake_device.allocations_++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*){
+    fake_device.mapped_.erase(memory);
+    fake_device.frees_++;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize, VkDeviceSize, VkMemoryMapFlags, void** data){
+    *data = fake_device.mapped_.at(memory).get();
+    return VK_SUCCESS;
+}
+
+} // extern "C"
+
+namespace{
+
+struct Placed{
+    VkDeviceSize offset_;
+    VkDeviceSize size_;
+    bool linear_;
+};
+
+// No overlaps, and linear and non-linear resources never touch the same granularity page.
+bool valid_placement(const std::vector<Placed>& placed, VkDeviceSize block_size){
+    for(size_t i = 0; i < placed.size(); i++){
+        const auto& a = placed[i];
+        if(a.offset_ + a.size_ > block_size){
+            return false;
+        }
+        for(size_t j = i + 1; j < placed.size(); j++){
+            const auto& b = placed[j];
+            if(a.offset_ < b.offset_ + b.size_ && b.offset_ < a.offset_ + a.size_){
+                return false;
+            }
+            if(a.linear_ != b.linear_){
+                auto a_pages = std::pair{a.offset_ / GRANULARITY, (a.offset_ + a.size_ - 1) / GRANULARITY};
+                auto b_pages = std::pair{b.offset_ / GRANULARITY, (b.offset_ + b.size_ - 1) / GRANULARITY};
+                if(a_pages.first <= b_pages.second && b_pages.first <= a_pages.second){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void test_alignment(){
+    Block_suballocator block{1 << 16};
+    check(block.allocate(100, 1, true) == 0, "first allocation at the block start");
+    auto aligned = block.allocate(64, 256, true);
+    check(aligned && *aligned == 256, "offset rounded up to the alignment");
+    auto odd = block.allocate(8, 48, true);
+    check(odd && *odd % 48 == 0, "non power of two alignment");
+}
+
+void test_granularity(){
+    Block_suballocator block{8 * GRANULARITY, GRANULARITY};
+    std::vector<Placed> placed;
+    auto linear = block.allocate(100, 16, true);
+    placed.push_back({*linear, 100, true});
+    auto optimal = block.allocate(100, 16, false);
+    check(optimal && *optimal >= GRANULARITY, "optimal image moved off the buffer's page");
+    placed.push_back({*optimal, 100, false});
+    // The hole before the image stays usable for another buffer, but not for another image's neighbour.
+    auto second_linear = block.allocate(100, 16, true);
+    check(second_linear && *second_linear < GRANULARITY, "buffer reuses the buffer page");
+    placed.push_back({*second_linear, 100, true});
+    auto third_linear = block.allocate(200, 16, true);
+    placed.push_back({*third_linear, 200, true});
+    check(valid_placement(placed, block.size()), "linear and optimal resources share no page");
+
+    // Same kind of resource packs tightly.
+    Block_suballocator images{8 * GRANULARITY, GRANULARITY};
+    images.allocate(100, 16, false);
+    check(images.allocate(100, 16, false) == 112, "images pack within a page");
+}
+
+void test_reuse_and_coalescing(){
+    Block_suballocator block{4096};
+    auto a = block.allocate(256, 1, true);
+    auto b = block.allocate(256, 1, true);
+    auto c = block.allocate(256, 1, true);
+    auto d = block.allocate(128, 1, true);
+    check(a == 0 && b == 256 && c == 512 && d == 768, "sequential placement");
+
+    block.free(*b);
+    check(block.allocate(256, 1, true) == b, "freed range is reused");
+    block.free(*b);
+    block.free(*d);
+    // Best fit: the 256 byte hole at b rather than the large tail after c.
+    check(block.allocate(200, 1, true) == b, "smallest fitting hole is chosen");
+    block.free(*b);
+
+    block.free(*a);
+    check(block.free_range_count() == 2, "a and b merged, the tail stays apart from them");
+    block.free(*c);
+    check(block.free_range_count() == 1 && block.largest_free_range() == block.size() && block.empty(), "all free ranges coalesce");
+    check(block.used_bytes() == 0, "no bytes left in use");
+
+    Block_suballocator full{1024};
+    full.allocate(1024, 1, true);
+    check(!full.allocate(1, 1, true), "a full block refuses");
+    bool threw = false;
+    try{
+        full.free(512);
+    }catch(const std::runtime_error&){
+        threw = true;
+    }
+    check(threw, "freeing an unknown offset throws");
+}
+
+// Random allocations and frees keep the placement valid and the free list fully coalesced at the end.
+void test_random_sequence(){
+    Block_suballocator block{64 * GRANULARITY, GRANULARITY};
+    std::mt19937 random{5};
+    std::vector<Placed> placed;
+    for(int step = 0; step < 4000; step++){
+        if(!placed.empty() && random() % 3 == 0){
+            auto index = random() % placed.size();
+            block.free(placed[index].offset_);
+            placed.erase(placed.begin() + static_cast<std::ptrdiff_t>(index));
+            continue;
+        }
+        VkDeviceSize size = 1 + random() % 3000;
+        VkDeviceSize alignment = VkDeviceSize{1} << (random() % 9);
+        bool linear = random() % 2 == 0;
+        if(auto offset = block.allocate(size, alignment, linear)){
+            check(*offset % alignment == 0, "random allocation is aligned");
+            placed.push_back({*offset, size, linear});
+        }
+        if(step % 100 == 0 && !check(valid_placement(placed, block.size()), "random sequence placement")){
+            return;
+        }
+    }
+    for(const auto& allocation: placed){
+        block.free(allocation.offset_);
+    }
+    check(block.free_range_count() == 1 && block.largest_free_range() == block.size(), "random sequence coalesces back to one range");
+}
+
+void test_device_allocator(){
+    Device_memory_allocator allocator;
+    allocator.init(VkPhysicalDevice{}, VkDevice{});
+    const VkDeviceSize block_size = HEAP_SIZE / 8;
+
+    auto requirements = [](VkDeviceSize size){
+        return VkMemoryRequirements{size, 256, 0b11};
+    };
+    auto a = allocator.allocate(requirements(block_size / 2), 0, true);
+    auto b = allocator.allocate(requirements(block_size / 2), 0, true);
+    check(fake_device.allocations_ == 1 && a.memory_ == b.memory_, "two halves share one block");
+    auto c = allocator.allocate(requirements(4096), 0, true);
+    check(fake_device.allocations_ == 2 && c.memory_ != a.memory_ && c.offset_ == 0, "a full block makes a new one");
+
+    auto big = allocator.allocate(requirements(block_size / 2 + 1), 0, true);
+    check(fake_device.allocations_ == 3 && big.offset_ == 0, "large resources get a dedicated block");
+    allocator.free(big);
+    check(fake_device.frees_ == 0, "one empty block is kept around");
+
+    auto staging = allocator.allocate(requirements(1000), 1, true);
+    auto staging_next = allocator.allocate(requirements(1000), 1, true);
+    check(staging.mapped_ && staging_next.mapped_ == static_cast<char*>(staging.mapped_) + staging_next.offset_ - staging.offset_,
+        "host visible allocations point into the mapped block");
+
+    auto stats = allocator.stats();
+    check(stats.live_allocations_ == 5 && stats.total_allocations_ == 6, "stats count live and total allocations");
+
+    for(auto* allocation: {&a, &b, &c, &staging, &staging_next}){
+        allocator.free(*allocation);
+    }
+    check(a.block_ == nullptr && allocator.stats().live_allocations_ == 0, "freed allocations are reset");
+    check(allocator.stats().live_blocks_ <= 2, "at most one empty block per memory type stays");
+    allocator.destroy();
+    check(fake_device.allocations_ == fake_device.frees_, "destroy releases every block");
+}
+
+} // namespace
+
+int main(){
+    test_alignment();
+    test_granularity();
+    test_reuse_and_coalescing();
+    test_random_sequence();
+    test_device_allocator();
+    return test_result();
+}
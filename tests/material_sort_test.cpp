@@ -0,0 +1,95 @@
+// The material path's two steps: welding keeps every corner in place, so triangle t stays face t on the
+// serial and the parallel path, and sort_triangles_by_slot() groups triangles stably.
+#include <random>
+#include <string>
+
+#include "material_sort.h"
+#include "vertex_format.h"
+#include "vertex_welder.h"
+#include "test_check.h"
+
+namespace{
+
+// Corners of random triangles over a small pool of vertices, so most of them weld.
+std::vector<Vertex> random_corners(size_t triangle_count, uint32_t seed){
+    std::mt19937 random{seed};
+    std::vector<Vertex> pool(triangle_count / 2 + 3);
+    for(size_t i = 0; i < pool.size(); i++){
+        pool[i].pos_ = {static_cast<float>(i), static_cast<float>(random() % 7), 0.0f};
+        pool[i].color_ = {1.0f, 1.0f, 1.0f};
+        pool[i].tex_coord_ = {static_cast<float>(random() % 3), 0.5f};
+    }
+    std::vector<Vertex> corners(triangle_count * 3);
+    for(auto& corner: corners){
+        corner = pool[random() % pool.size()];
+    }
+    return corners;
+}
+
+void test_weld_order(){
+    Worker_pool pool{4};
+    for(size_t triangle_count: {1u, 100u, 50000u}){
+        auto corners = random_corners(triangle_count, static_cast<uint32_t>(triangle_count));
+        auto corner = [&](size_t c){ return corners[c]; };
+        std::vector<Vertex> vertices, parallel_vertices;
+        std::vector<uint32_t> indices, parallel_indices;
+        weld_vertices<Vertex, Vertex_hash>(corners.size(), corner, vertices, indices);
+        weld_vertices_parallel<Vertex, Vertex_hash>(corners.size(), corner, pool, parallel_vertices, parallel_indices);
+
+        bool in_place = indices.size() == corners.size();
+        for(size_t c = 0; in_place && c < corners.size(); c++){
+            in_place = vertices[indices[c]] == corners[c];
+        }
+        check(in_place, std::format("{} triangles: welded corner c is corner c", triangle_count));
+        check(vertices.size() < corners.size() || triangle_count == 1, std::format("{} triangles: equal corners weld", triangle_count));
+        check(parallel_indices == indices && parallel_vertices == vertices, std::format("{} triangles: the parallel weld matches", triangle_count));
+    }
+}
+
+void test_sort(){
+    std::mt19937 random{25};
+    for(size_t slot_count: {1u, 2u, 5u, 300u}){
+        const size_t triangle_count = 2000;
+        // Triangle t is t*3 .. t*3 + 2, so its position in the output identifies it.
+        std::vector<uint32_t> indices(triangle_count * 3);
+        for(uint32_t i = 0; i < indices.size(); i++){
+            indices[i] = i;
+        }
+        std::vector<uint32_t> slots(triangle_count);
+        for(auto& slot: slots){
+            slot = static_cast<uint32_t>(random() % slot_count);
+        }
+        auto counts = sort_triangles_by_slot(indices, slots, slot_count);
+        auto what = [&](std::string_view check_name){ return std::format("{} slots: {}", slot_count, check_name); };
+
+        check(counts.size() == slot_count && indices.size() == triangle_count * 3, what("sizes"));
+        bool whole = true, grouped = true, stable = true;
+        size_t triangle{};
+        for(uint32_t slot = 0; slot < counts.size(); slot++){
+            uint32_t previous{};
+            for(uint32_t i = 0; i < counts[slot]; i++, triangle++){
+                auto original = indices[triangle * 3] / 3;
+                whole = whole && indices[triangle * 3] % 3 == 0 && indices[triangle * 3 + 1] == indices[triangle * 3] + 1 &&
+                    indices[triangle * 3 + 2] == indices[triangle * 3] + 2;
+                grouped = grouped && slots[original] == slot;
+                stable = stable && (i == 0 || original > previous);
+                previous = original;
+            }
+        }
+        check(triangle == triangle_count, what("the counts add up to every triangle"));
+        check(whole, what("triangles move whole"));
+        check(grouped, what("each slot's triangles are contiguous, slots in order"));
+        check(stable, what("each slot keeps its triangle order"));
+    }
+
+    std::vector<uint32_t> empty;
+    check(sort_triangles_by_slot(empty, {}, 3) == std::vector<uint32_t>(3), "no triangles");
+}
+
+} // namespace
+
+int main(){
+    test_weld_order();
+    test_sort();
+    return test_result();
+}
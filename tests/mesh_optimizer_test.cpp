@@ -0,0 +1,125 @@
+// mesh_optimizer.h keeps every triangle (rotations allowed, winding kept) and every vertex through
+// Tipsify, the overdraw sort and the fetch remap, and never makes the vertex cache worse.
+#include <numeric>
+#include <random>
+#include <string>
+
+#include "mesh_optimizer.h"
+#include "test_check.h"
+#include "uv_sphere.h"
+
+namespace{
+
+// Random vertex numbering, triangle order and triangle rotation.
+void shuffle(Mesh& mesh, uint32_t seed){
+    std::mt19937 random{seed};
+    std::vector<uint32_t> remap(mesh.positions_.size());
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::shuffle(remap.begin(), remap.end(), random);
+    apply_vertex_remap(mesh.positions_, mesh.indices_, remap);
+
+    std::vector<std::array<uint32_t, 3>> triangles(mesh.indices_.size() / 3);
+    for(size_t i = 0; i < triangles.size(); i++){
+        auto first = random() % 3;
+        triangles[i] = {mesh.indices_[i * 3 + first], mesh.indices_[i * 3 + (first + 1) % 3], mesh.indices_[i * 3 + (first + 2) % 3]};
+    }
+    std::shuffle(triangles.begin(), triangles.end(), random);
+    for(size_t i = 0; i < triangles.size(); i++){
+        std::copy(triangles[i].begin(), triangles[i].end(), mesh.indices_.begin() + static_cast<std::ptrdiff_t>(i * 3));
+    }
+}
+
+// Every stage against the input, with the vertex remap undone before comparing triangles.
+void test_pipeline(const std::string& name, Mesh mesh){
+    const auto reference = canonical_triangles(mesh.indices_);
+    const auto reference_positions = mesh.positions_;
+    const auto vertex_count = mesh.positions_.size();
+    auto before = analyze_vertex_cache(mesh.indices_, vertex_count);
+
+    auto clusters = optimize_vertex_cache(mesh.indices_, vertex_count);
+    check(canonical_triangles(mesh.indices_) == reference, name + ": Tipsify keeps the triangles");
+    check(!clusters.empty() || mesh.indices_.empty(), name + ": Tipsify returns clusters");
+    check(std::is_sorted(clusters.begin(), clusters.end()) && (clusters.empty() || clusters[0] == 0) &&
+        (clusters.empty() || clusters.back() < mesh.indices_.size() / 3), name + ": clusters start in order at triangle 0");
+    auto tipsified = analyze_vertex_cache(mesh.indices_, vertex_count);
+    check(tipsified.acmr_ <= before.acmr_, name + ": Tipsify does not raise ACMR");
+
+    optimize_overdraw(mesh.indices_, clusters, [&](uint32_t vertex){ return mesh.positions_[vertex]; });
+    check(canonical_triangles(mesh.indices_) == reference, name + ": overdraw sort keeps the triangles");
+    auto sorted = analyze_vertex_cache(mesh.indices_, vertex_count);
+    check(sorted.acmr_ <= before.acmr_, name + ": overdraw sort stays below the input's ACMR");
+
+    auto remap = vertex_fetch_remap(mesh.indices_, vertex_count);
+    auto remapped_indices = mesh.indices_;
+    auto remapped_positions = mesh.positions_;
+    apply_vertex_remap(remapped_positions, remapped_indices, remap);
+    auto after = analyze_vertex_cache(remapped_indices, vertex_count);
+    check(after.acmr_ == sorted.acmr_, name + ": renumbering leaves ACMR alone");
+
+    std::vector<uint32_t> sorted_remap(remap);
+    std::sort(sorted_remap.begin(), sorted_remap.end());
+    bool permutation = true;
+    for(uint32_t i = 0; i < sorted_remap.size(); i++){
+        permutation = permutation && sorted_remap[i] == i;
+    }
+    check(permutation, name + ": remap is a permutation");
+    bool first_use = true;
+    uint32_t next{};
+    for(auto index: remapped_indices){
+        first_use = first_use && index <= next;
+        next = std::max(next, index + 1);
+    }
+    check(first_use, name + ": vertices are numbered in first use order");
+
+    bool positions_kept = true;
+    for(uint32_t i = 0; i < remap.size(); i++){
+        positions_kept = positions_kept && remapped_positions[remap[i]] == reference_positions[i];
+    }
+    check(positions_kept, name + ": every vertex moves with its index");
+    std::vector<uint32_t> inverse(remap.size());
+    for(uint32_t i = 0; i < remap.size(); i++){
+        inverse[remap[i]] = i;
+    }
+    for(auto& index: remapped_indices){
+        index = inverse[index];
+    }
+    check(canonical_triangles(remapped_indices) == reference, name + ": fetch remap keeps the triangles");
+}
+
+void test_cache_quality(){
+    // Tipsify on a shuffled sphere lands near the 0.5-0.7 of good orderings, far from the ~2 of random ones.
+    auto mesh = uv_sphere(100);
+    shuffle(mesh, 3);
+    auto before = analyze_vertex_cache(mesh.indices_, mesh.positions_.size());
+    optimize_vertex_cache(mesh.indices_, mesh.positions_.size());
+    auto after = analyze_vertex_cache(mesh.indices_, mesh.positions_.size());
+    check(before.acmr_ > 1.5 && after.acmr_ < 0.8, "Tipsify ACMR on a shuffled sphere");
+
+    // Already optimized input doesn't get worse on a second pass.
+    auto again = mesh.indices_;
+    optimize_vertex_cache(again, mesh.positions_.size());
+    check(analyze_vertex_cache(again, mesh.positions_.size()).acmr_ <= after.acmr_ + 0.05, "a second Tipsify pass keeps ACMR");
+}
+
+void test_edge_cases(){
+    test_pipeline("empty", {});
+    test_pipeline("one triangle", {{{0, 0, 0}, {1, 0, 0}, {0, 1, 0}}, {0, 1, 2}});
+    // Unreferenced vertices go after the referenced ones, a repeated triangle stays repeated.
+    test_pipeline("unreferenced and repeated", {{{0, 0, 0}, {9, 9, 9}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}}, {0, 2, 3, 3, 2, 4, 0, 2, 3}});
+    auto remap = vertex_fetch_remap(std::vector<uint32_t>{3, 2, 0}, 5);
+    check(remap == std::vector<uint32_t>{2, 3, 1, 0, 4}, "unreferenced vertices are numbered last");
+}
+
+} // namespace
+
+int main(){
+    for(uint32_t rings: {8u, 60u, 200u}){
+        auto mesh = uv_sphere(rings);
+        test_pipeline(std::format("sphere {}", rings), mesh);
+        shuffle(mesh, rings);
+        test_pipeline(std::format("shuffled sphere {}", rings), mesh);
+    }
+    test_cache_quality();
+    test_edge_cases();
+    return test_result();
+}
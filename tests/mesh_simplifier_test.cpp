@@ -0,0 +1,192 @@
+// The error bound of every LOD against a dense sampling of both surfaces: no point of the full
+// resolution surface is farther from the LOD than the bound, and no point of the LOD is farther from
+// the full resolution surface. Distances here don't use the simplifier's own helpers.
+#include <random>
+#include <string>
+
+#include "mesh_simplifier.h"
+#include "test_check.h"
+#include "uv_sphere.h"
+
+namespace{
+
+using Point = std::array<double, 3>;
+
+Point sub(const Point& a, const Point& b){
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+double dot(const Point& a, const Point& b){
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+double segment_distance(const Point& p, const Point& a, const Point& b){
+    auto ab = sub(b, a);
+    auto t = dot(ab, ab) > 0.0 ? std::clamp(dot(sub(p, a), ab) / dot(ab, ab), 0.0, 1.0) : 0.0;
+    auto offset = sub(p, {a[0] + t * ab[0], a[1] + t * ab[1], a[2] + t * ab[2]});
+    return std::sqrt(dot(offset, offset));
+}
+
+// Plane distance when p projects inside the triangle, otherwise the nearest edge.
+double triangle_distance(const Point& p, const std::array<Point, 3>& t){
+    auto edges = std::min({segment_distance(p, t[0], t[1]), segment_distance(p, t[1], t[2]), segment_distance(p, t[2], t[0])});
+    auto e0 = sub(t[1], t[0]), e1 = sub(t[2], t[0]);
+    Point normal{e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0]};
+    auto area = dot(normal, normal);
+    if(area == 0.0){
+        return edges;
+    }
+    auto ap = sub(p, t[0]);
+    auto plane = dot(ap, normal) / area;
+    Point projected{ap[0] - plane * normal[0], ap[1] - plane * normal[1], ap[2] - plane * normal[2]};
+    // Barycentrics of the projection.
+    auto d00 = dot(e0, e0), d01 = dot(e0, e1), d11 = dot(e1, e1), d20 = dot(projected, e0), d21 = dot(projected, e1);
+    auto denominator = d00 * d11 - d01 * d01;
+    auto v = (d11 * d20 - d01 * d21) / denominator;
+    auto w = (d00 * d21 - d01 * d20) / denominator;
+    if(v >= 0.0 && w >= 0.0 && v + w <= 1.0){
+        return std::abs(plane) * std::sqrt(area);
+    }
+    return edges;
+}
+
+std::vector<std::array<Point, 3>> triangles_of(const Mesh& mesh, std::span<const uint32_t> indices){
+    std::vector<std::array<Point, 3>> triangles;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        std::array<Point, 3> triangle{};
+        for(size_t corner = 0; corner < 3; corner++){
+            const auto& p = mesh.positions_[indices[i + corner]];
+            triangle[corner] = {p[0], p[1], p[2]};
+        }
+        triangles.push_back(triangle);
+    }
+    return triangles;
+}
+
+// Largest distance from the samples of from (a barycentric grid and random points per triangle) to to.
+double sampled_distance(const std::vector<std::array<Point, 3>>& from, const std::vector<std::array<Point, 3>>& to, uint32_t seed){
+    constexpr int GRID = 8;
+    constexpr int RANDOM = 16;
+    // Bounding spheres skip targets that can't be nearer than the best so far.
+    std::vector<std::pair<Point, double>> spheres;
+    for(const auto& t: to){
+        Point center{(t[0][0] + t[1][0] + t[2][0]) / 3.0, (t[0][1] + t[1][1] + t[2][1]) / 3.0, (t[0][2] + t[1][2] + t[2][2]) / 3.0};
+        double radius{};
+        for(const auto& corner: t){
+            radius = std::max(radius, std::sqrt(dot(sub(corner, center), sub(corner, center))));
+        }
+        spheres.emplace_back(center, radius);
+    }
+    std::mt19937 random{seed};
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    double farthest{};
+    size_t last_nearest{};
+    auto sample = [&](const std::array<Point, 3>& t, double v, double w){
+        auto u = 1.0 - v - w;
+        Point p{u * t[0][0] + v * t[1][0] + w * t[2][0], u * t[0][1] + v * t[1][1] + w * t[2][1], u * t[0][2] + v * t[1][2] + w * t[2][2]};
+        // The previous sample's nearest target is usually close, starting there makes the skipping effective.
+        double nearest = triangle_distance(p, to[last_nearest]);
+        for(size_t i = 0; i < to.size() && nearest > farthest; i++){
+            const auto& [center, radius] = spheres[i];
+            if(std::sqrt(dot(sub(p, center), sub(p, center))) - radius >= nearest){
+                continue;
+            }
+            auto distance = triangle_distance(p, to[i]);
+            if(distance < nearest){
+                nearest = distance;
+                last_nearest = i;
+            }
+        }
+        farthest = std::max(farthest, nearest);
+    };
+    for(const auto& triangle: from){
+        for(int i = 0; i <= GRID; i++){
+            for(int j = 0; i + j <= GRID; j++){
+                sample(triangle, double(i) / GRID, double(j) / GRID);
+            }
+        }
+        for(int i = 0; i < RANDOM; i++){
+            auto v = unit(random), w = unit(random);
+            if(v + w > 1.0){
+                v = 1.0 - v;
+                w = 1.0 - w;
+            }
+            sample(triangle, v, w);
+        }
+    }
+    return farthest;
+}
+
+// Scales the radius of every point of a sphere around the origin by 1 + bump * sin(3 phi) * sin(2 theta),
+// which gives the simplifier curvature of several frequencies. Coincident points stay coincident.
+Mesh bumpy(Mesh mesh, float bump){
+    for(auto& p: mesh.positions_){
+        auto horizontal = std::sqrt(p[0] * p[0] + p[2] * p[2]);
+        auto scale = 1.0f + bump * std::sin(3.0f * std::atan2(p[2], p[0])) * 2.0f * horizontal * p[1];
+        p = {p[0] * scale, p[1] * scale, p[2] * scale};
+    }
+    return mesh;
+}
+
+// Height field with an open border.
+Mesh terrain(uint32_t side){
+    Mesh mesh;
+    for(uint32_t y = 0; y <= side; y++){
+        for(uint32_t x = 0; x <= side; x++){
+            auto u = static_cast<float>(x) / static_cast<float>(side), v = static_cast<float>(y) / static_cast<float>(side);
+            mesh.positions_.push_back({u, 0.1f * std::sin(6.0f * u) * std::cos(4.0f * v) + 0.02f * std::sin(23.0f * u * v), v});
+        }
+    }
+    for(uint32_t y = 0; y < side; y++){
+        for(uint32_t x = 0; x < side; x++){
+            uint32_t a = y * (side + 1) + x;
+            uint32_t b = a + side + 1;
+            mesh.indices_.insert(mesh.indices_.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+    return mesh;
+}
+
+void test_chain(const std::string& name, Mesh mesh){
+    const auto full_detail_count = mesh.indices_.size();
+    auto position = [&](uint32_t vertex){ return mesh.positions_[vertex]; };
+    auto lods = build_lod_chain(mesh.indices_, mesh.positions_.size(), position);
+    check(lods.size() >= 3, name + ": several LODs");
+
+    std::span<const uint32_t> all{mesh.indices_};
+    const auto original = triangles_of(mesh, all.first(full_detail_count));
+    for(size_t lod = 1; lod < lods.size(); lod++){
+        const auto simplified = triangles_of(mesh, all.subspan(lods[lod].first_index_, lods[lod].index_count_));
+        auto to_lod = sampled_distance(original, simplified, static_cast<uint32_t>(lod));
+        auto to_original = sampled_distance(simplified, original, static_cast<uint32_t>(lod) + 100);
+        auto error = static_cast<double>(lods[lod].error_);
+        check(to_lod <= error, std::format("{} lod {}: full detail surface within the bound ({:.6f} > {:.6f})", name, lod, to_lod, error));
+        check(to_original <= error, std::format("{} lod {}: LOD surface within the bound ({:.6f} > {:.6f})", name, lod, to_original, error));
+        check(error >= lods[lod - 1].error_, std::format("{} lod {}: errors grow along the chain", name, lod));
+        // Conservative but still useful for picking LODs.
+        check(error <= 16.0 * std::max(to_lod, to_original) + 1e-6, std::format("{} lod {}: bound {:.6f} not far above the measured {:.6f}",
+            name, lod, error, std::max(to_lod, to_original)));
+    }
+}
+
+// Collapses inside a flat grid leave the surface where it was and must not cost anything.
+void test_fan_bound(){
+    Mesh flat = terrain(4);
+    for(auto& p: flat.positions_){
+        p[1] = 0.0f;
+    }
+    Mesh_simplifier simplifier{flat.positions_.size(), [&](uint32_t vertex){ return flat.positions_[vertex]; }};
+    auto simplified = simplifier.simplify(flat.indices_, flat.indices_.size() - 6);
+    check(simplified.size() < flat.indices_.size(), "flat grid simplifies");
+    check(simplifier.error() < 1e-3, std::format("flat grid error {:.6f} stays near zero", simplifier.error()));
+}
+
+} // namespace
+
+int main(){
+    test_chain("sphere", uv_sphere(12));
+    test_chain("bumpy sphere", bumpy(uv_sphere(16), 0.15f));
+    test_chain("terrain", terrain(24));
+    test_fan_bound();
+    return test_result();
+}
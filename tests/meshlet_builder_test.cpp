@@ -0,0 +1,108 @@
+// build_meshlets() on spheres and disconnected pieces with several limits: meshlets stay within their
+// limits, hold every triangle exactly once, and their cones and spheres are conservative.
+#include <map>
+#include <random>
+#include <string>
+
+#include "meshlet_builder.h"
+#include "test_check.h"
+#include "uv_sphere.h"
+
+namespace{
+
+void test_mesh(const std::string& name, const Mesh& mesh, uint32_t max_vertices, uint32_t max_triangles){
+    auto what = [&](std::string_view check_name){ return std::format("{} ({}/{}): {}", name, max_vertices, max_triangles, check_name); };
+    auto position = [&](uint32_t vertex){ return mesh.positions_[vertex]; };
+    auto indices = mesh.indices_;
+    optimize_vertex_cache(indices, mesh.positions_.size());
+    const auto original = indices;
+    auto meshlets = build_meshlets(indices, mesh.positions_.size(), position, max_vertices, max_triangles);
+
+    auto problem = validate_meshlets(std::span<const Meshlet>{meshlets}, original, indices, position, max_vertices, max_triangles);
+    check(problem.empty(), what(problem));
+
+    // Exactly once: every input triangle, rotated to its smallest index, is counted off by one meshlet triangle.
+    std::map<std::array<uint32_t, 3>, int> remaining;
+    for(const auto& triangle: canonical_triangles(original)){
+        remaining[triangle]++;
+    }
+    bool once = true;
+    for(const auto& meshlet: meshlets){
+        auto triangles = canonical_triangles(std::span<const uint32_t>{indices}.subspan(meshlet.first_index_, meshlet.index_count_));
+        for(const auto& triangle: triangles){
+            once = once && --remaining[triangle] >= 0;
+        }
+    }
+    for(const auto& [triangle, count]: remaining){
+        once = once && count == 0;
+    }
+    check(once, what("every triangle in exactly one meshlet"));
+
+    // A meshlet seen as backfacing from a camera has no triangle facing that camera.
+    std::mt19937 random{max_vertices * 1000 + max_triangles};
+    std::uniform_real_distribution<float> unit{-4.0f, 4.0f};
+    bool conservative = true;
+    for(int view = 0; view < 200 && conservative; view++){
+        std::array<float, 3> camera{unit(random), unit(random), unit(random)};
+        for(const auto& meshlet: meshlets){
+            if(!is_meshlet_backfacing(meshlet, camera)){
+                continue;
+            }
+            for(auto i = meshlet.first_index_; i < meshlet.first_index_ + meshlet.index_count_; i += 3){
+                auto a = position(indices[i]);
+                auto b = position(indices[i + 1]);
+                auto c = position(indices[i + 2]);
+                auto normal = meshlet_detail::cross({double{b[0]} - a[0], double{b[1]} - a[1], double{b[2]} - a[2]},
+                    {double{c[0]} - a[0], double{c[1]} - a[1], double{c[2]} - a[2]});
+                auto facing = meshlet_detail::dot(normal, {double{camera[0]} - a[0], double{camera[1]} - a[1], double{camera[2]} - a[2]});
+                conservative = conservative && facing <= 1e-9;
+            }
+        }
+    }
+    check(conservative, what("cone culling never drops a front facing triangle"));
+
+    // The next meshlet starts next to the last one whenever an unemitted triangle borders it.
+    bool adjacent = true;
+    for(size_t m = 1; m < meshlets.size(); m++){
+        const auto& previous = meshlets[m - 1];
+        std::vector<uint32_t> vertices(indices.begin() + previous.first_index_, indices.begin() + previous.first_index_ + previous.index_count_);
+        std::sort(vertices.begin(), vertices.end());
+        auto touches = [&](size_t first, size_t last){
+            for(auto i = first; i < last; i++){
+                if(std::binary_search(vertices.begin(), vertices.end(), indices[i])){
+                    return true;
+                }
+            }
+            return false;
+        };
+        const auto first = meshlets[m].first_index_;
+        if(touches(first, indices.size()) && !touches(first, first + 3)){
+            adjacent = false;
+        }
+    }
+    check(adjacent, what("a new meshlet starts at the border of the last"));
+}
+
+} // namespace
+
+int main(){
+    Mesh sphere = uv_sphere(40);
+    Mesh pieces;
+    for(int i = 0; i < 6; i++){
+        add_uv_sphere(pieces, 3 + i * 2, {static_cast<float>(i) - 2.5f, 0.5f * static_cast<float>(i % 2), 0.0f}, 0.4f);
+    }
+    // A degenerate triangle has no normal and must not widen any cone.
+    Mesh degenerate = sphere;
+    degenerate.indices_.insert(degenerate.indices_.end(), {0, 0, 1, 5, 5, 5});
+
+    for(auto [max_vertices, max_triangles]: {std::pair{MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES}, std::pair{64u, 32u},
+        std::pair{16u, 124u}, std::pair{3u, 1u}, std::pair{8u, 4u}}){
+        test_mesh("sphere", sphere, max_vertices, max_triangles);
+        test_mesh("pieces", pieces, max_vertices, max_triangles);
+        test_mesh("degenerate", degenerate, max_vertices, max_triangles);
+    }
+
+    std::vector<uint32_t> no_indices;
+    check(build_meshlets(no_indices, 0, [](uint32_t){ return std::array<float, 3>{}; }).empty(), "no triangles, no meshlets");
+    return test_result();
+}
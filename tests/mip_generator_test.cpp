@@ -0,0 +1,78 @@
+// generate_mip_chain() on every SIMD path this CPU runs: each level within one step of the double
+// precision reference filtering the same input, constant images kept exactly, threads and paths agreeing.
+#include <random>
+#include <string>
+
+#include "mip_generator.h"
+#include "test_check.h"
+
+namespace{
+
+std::vector<uint8_t> noise(uint32_t width, uint32_t height){
+    std::mt19937 random{width * 7919 + height};
+    std::vector<uint8_t> pixels(size_t{width} * height * 4);
+    for(auto& value: pixels){
+        value = static_cast<uint8_t>(random());
+    }
+    return pixels;
+}
+
+// Largest difference of any level to the reference downsampling the level above it in the same chain.
+int level_error(const Mip_chain& chain){
+    int error{};
+    std::vector<uint8_t> expected;
+    for(size_t level = 1; level < chain.levels_.size(); level++){
+        const auto& src_level = chain.levels_[level - 1];
+        const auto& dst_level = chain.levels_[level];
+        expected.resize(size_t{dst_level.width_} * dst_level.height_ * 4);
+        downsample_level_reference(chain.pixels_.data() + src_level.offset_, src_level, expected.data(), dst_level);
+        for(size_t i = 0; i < expected.size(); i++){
+            error = std::max(error, std::abs(expected[i] - chain.pixels_[dst_level.offset_ + i]));
+        }
+    }
+    return error;
+}
+
+void test_path(const std::string& path, Worker_pool& pool){
+    for(auto [width, height]: {std::pair{1u, 1u}, std::pair{2u, 2u}, std::pair{1u, 9u}, std::pair{13u, 1u}, std::pair{7u, 5u},
+        std::pair{257u, 129u}, std::pair{512u, 512u}}){
+        auto what = [&](std::string_view check_name){ return std::format("{} {}x{}: {}", path, width, height, check_name); };
+        auto pixels = noise(width, height);
+        auto single = generate_mip_chain(pixels, width, height);
+        check(single.levels_.size() == mip_chain_layout(width, height).size() && single.levels_.back().width_ == 1 &&
+            single.levels_.back().height_ == 1, what("full chain down to 1x1"));
+        check(std::equal(pixels.begin(), pixels.end(), single.pixels_.begin()), what("level 0 is the input"));
+        check(level_error(single) <= 1, what("every level within one step of the reference"));
+        check(generate_mip_chain(pixels, width, height, &pool).pixels_ == single.pixels_, what("threads don't change the output"));
+
+        std::vector<uint8_t> constant(pixels.size());
+        for(size_t i = 0; i < constant.size(); i += 4){
+            std::copy_n(std::array<uint8_t, 4>{10, 128, 250, 77}.begin(), 4, constant.begin() + i);
+        }
+        auto constant_chain = generate_mip_chain(constant, width, height, &pool);
+        bool constant_kept = true;
+        for(size_t i = 0; i < constant_chain.pixels_.size(); i++){
+            constant_kept = constant_kept && constant_chain.pixels_[i] == constant[i % 4];
+        }
+        check(constant_kept, what("a constant image stays exact"));
+    }
+}
+
+} // namespace
+
+int main(){
+    Worker_pool pool{4};
+    test_path(mip_simd_name(), pool);
+#if defined(MIP_AVX2_DISPATCH)
+    // The fallback path too, and both must agree since they share the tables and rounding.
+    if(mip_detail::use_avx2()){
+        auto pixels = noise(301, 77);
+        auto avx2 = generate_mip_chain(pixels, 301, 77);
+        mip_detail::use_avx2() = false;
+        test_path(mip_simd_name(), pool);
+        check(generate_mip_chain(pixels, 301, 77).pixels_ == avx2.pixels_, "AVX2 and the fallback give the same chain");
+        mip_detail::use_avx2() = true;
+    }
+#endif
+    return test_result();
+}
@@ -0,0 +1,173 @@
+// parse_obj against a sequential reference on files large enough to be split into several chunks.
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "obj_parser.h"
+#include "test_check.h"
+
+namespace{
+
+std::span<const std::byte> bytes(const std::string& text){
+    return std::as_bytes(std::span{text.data(), text.size()});
+}
+
+// Straightforward one-pass reading of the same subset: fans polygons, resolves negative indices
+// against the lines read so far.
+std::optional<Obj_mesh> parse_reference(const std::string& text){
+    Obj_mesh mesh;
+    std::istringstream lines{text};
+    std::string line;
+    while(std::getline(lines, line)){
+        std::istringstream words{line};
+        std::string kind;
+        words >> kind;
+        if(kind == "v"){
+            float x{}, y{}, z{};
+            words >> x >> y >> z;
+            mesh.positions_.insert(mesh.positions_.end(), {x, y, z});
+        }else if(kind == "vt"){
+            float u{}, v{};
+            words >> u >> v;
+            mesh.texcoords_.insert(mesh.texcoords_.end(), {u, v});
+        }else if(kind == "f"){
+            std::vector<Obj_corner> face;
+            std::string word;
+            while(words >> word){
+                auto resolve = [](long long index, size_t count) -> std::optional<uint32_t>{
+                    auto resolved = index < 0 ? static_cast<long long>(count) + index : index - 1;
+                    if(index == 0 || resolved < 0 || resolved >= static_cast<long long>(count)){
+                        return std::nullopt;
+                    }
+                    return static_cast<uint32_t>(resolved);
+                };
+                auto slash = word.find('/');
+                auto position = resolve(std::stoll(word.substr(0, slash)), mesh.positions_.size() / 3);
+                std::optional<uint32_t> texcoord = OBJ_NO_TEXCOORD;
+                if(slash != std::string::npos && slash + 1 < word.size() && word[slash + 1] != '/'){
+                    texcoord = resolve(std::stoll(word.substr(slash + 1)), mesh.texcoords_.size() / 2);
+                }
+                if(!position || !texcoord){
+                    return std::nullopt;
+                }
+                face.push_back({*position, *texcoord});
+            }
+            if(face.size() < 3){
+                return std::nullopt;
+            }
+            for(size_t i = 2; i < face.size(); i++){
+                mesh.corners_.insert(mesh.corners_.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+    return mesh;
+}
+
+bool same_mesh(const Obj_mesh& a, const Obj_mesh& b){
+    auto same_corner = [](const Obj_corner& x, const Obj_corner& y){
+        return x.position_ == y.position_ && x.texcoord_ == y.texcoord_;
+    };
+    return a.positions_ == b.positions_ && a.texcoords_ == b.texcoords_ &&
+        std::equal(a.corners_.begin(), a.corners_.end(), b.corners_.begin(), b.corners_.end(), same_corner);
+}
+
+// Several MiB of triangles, quads and pentagons in every index form, interleaved with new v/vt lines
+// so relative indices of late chunks reach back into earlier ones.
+std::string generate_obj(uint32_t seed){
+    std::mt19937 random{seed};
+    std::string text = "# generated\nmtllib none.mtl\no mesh\n";
+    size_t positions{}, texcoords{};
+    char line[128];
+    while(text.size() < (size_t{5} << 20)){
+        for(int i = 0; i < 4; i++){
+            std::snprintf(line, sizeof(line), "v %d.%03d %d.5 -%d.25\n", int(random() % 100), int(random() % 1000), int(random() % 50), int(random() % 9));
+            text += line;
+            positions++;
+        }
+        for(int i = 0; i < 3; i++){
+            std::snprintf(line, sizeof(line), "vt 0.%03d 0.%03d\n", int(random() % 1000), int(random() % 1000));
+            text += line;
+            texcoords++;
+        }
+        if(random() % 16 == 0){
+            text += "g group\nusemtl a\ns 1\n\n";
+        }
+        const auto corner_count = 3 + random() % 3;
+        text += "f";
+        const auto form = random() % 4;
+        for(uint32_t c = 0; c < corner_count; c++){
+            // Relative indices reach up to a few thousand lines back, past chunk boundaries.
+            auto position = static_cast<long long>(1 + random() % positions);
+            auto texcoord = static_cast<long long>(1 + random() % texcoords);
+            if(random() % 2){
+                position -= static_cast<long long>(positions) + 1;
+            }
+            if(random() % 2){
+                texcoord -= static_cast<long long>(texcoords) + 1;
+            }
+            switch(form){
+            case 0: std::snprintf(line, sizeof(line), " %lld/%lld", position, texcoord); break;
+            case 1: std::snprintf(line, sizeof(line), " %lld/%lld/1", position, texcoord); break;
+            case 2: std::snprintf(line, sizeof(line), " %lld//1", position); break;
+            default: std::snprintf(line, sizeof(line), " %lld", position); break;
+            }
+            text += line;
+        }
+        text += random() % 8 == 0 ? " \r\n" : "\n";
+    }
+    return text;
+}
+
+void test_matches_reference(Worker_pool& pool){
+    auto text = generate_obj(16);
+    auto reference = parse_reference(text);
+    auto mesh = parse_obj(bytes(text), pool);
+    check(reference && mesh, "generated file parses");
+    check(mesh && reference && same_mesh(*mesh, *reference), "parallel parse matches the sequential reference");
+    check(mesh && mesh->corners_.size() % 3 == 0, "whole triangles");
+}
+
+void test_small_files(Worker_pool& pool){
+    auto quad = parse_obj(bytes("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nf 1/1 2/1 3/1 4/1\n"), pool);
+    check(quad && quad->corners_.size() == 6, "quad fans into two triangles");
+    check(quad && quad->corners_[3].position_ == 0 && quad->corners_[4].position_ == 2 && quad->corners_[5].position_ == 3,
+        "second triangle of the fan");
+
+    auto relative = parse_obj(bytes("v 0 0 0\nv 1 0 0\nv 1 1 0\nf -3 -2 -1\nv 2 2 2\nf -4 -1 2\n"), pool);
+    check(relative && relative->corners_.size() == 6 && relative->corners_[0].position_ == 0 && relative->corners_[2].position_ == 2 &&
+        relative->corners_[3].position_ == 0 && relative->corners_[4].position_ == 3, "relative indices count back from the face");
+    check(relative && relative->corners_[0].texcoord_ == OBJ_NO_TEXCOORD, "no texture coordinate");
+
+    auto no_faces = parse_obj(bytes(""), pool);
+    check(no_faces && no_faces->corners_.empty(), "empty file");
+}
+
+void test_malformed(Worker_pool& pool){
+    for(const char* text: {
+        "v 0 0 0\nv 1 0 0\nf 1 2\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf -4 -2 -1\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 0 1 2\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nf 1/2 2/1 3/1\n",
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 x\n",
+        "v 0 zero 0\n"}){
+        check(!parse_obj(bytes(text), pool), text);
+    }
+
+    // A relative index reaching before the first line, in a late chunk.
+    auto text = generate_obj(17);
+    text += "f -1 -2 -1000000000\n";
+    check(!parse_obj(bytes(text), pool), "relative index before the file start");
+}
+
+} // namespace
+
+int main(){
+    Worker_pool pool{4};
+    test_matches_reference(pool);
+    test_small_files(pool);
+    test_malformed(pool);
+    return test_result();
+}
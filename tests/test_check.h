@@ -0,0 +1,28 @@
+#pragma once
+#include <iostream>
+#include <source_location>
+#include <string_view>
+
+#include "sformat.h"
+
+// Failed checks so far, a test's main() returns test_result().
+inline int& test_failures(){
+    static int failures{};
+    return failures;
+}
+
+inline bool check(bool condition, std::string_view what, std::source_location location = std::source_location::current()){
+    if(!condition){
+        std::cerr << std::format("{}:{}: check failed: {}\n", location.file_name(), location.line(), what);
+        test_failures()++;
+    }
+    return condition;
+}
+
+inline int test_result(){
+    if(test_failures() > 0){
+        std::cerr << std::format("{} checks failed.\n", test_failures());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// BC1 encoding of smooth and edge sized images, solid blocks and thread independence, then KTX2 files
+// of both formats: levels and keys survive a round trip, truncated, foreign or misordered files are rejected.
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "bc_encoder.h"
+#include "ktx2.h"
+#include "test_check.h"
+
+namespace{
+
+// Smooth gradients with a little noise, like albedo; white noise isn't something BC1 can represent.
+std::vector<uint8_t> smooth_image(uint32_t width, uint32_t height){
+    std::mt19937 random{width * 31 + height};
+    std::vector<uint8_t> pixels(size_t{width} * height * 4);
+    for(uint32_t y = 0; y < height; y++){
+        for(uint32_t x = 0; x < width; x++){
+            auto* pixel = pixels.data() + (size_t{y} * width + x) * 4;
+            pixel[0] = static_cast<uint8_t>(128 + 100 * std::sin(static_cast<float>(x) * 0.02f) + random() % 8);
+            pixel[1] = static_cast<uint8_t>(128 + 100 * std::cos(static_cast<float>(y) * 0.03f) + random() % 8);
+            pixel[2] = static_cast<uint8_t>((x + y) / 8 % 256);
+            pixel[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+double psnr(std::span<const uint8_t> expected, std::span<const uint8_t> decoded){
+    double squared_error{};
+    for(size_t i = 0; i < expected.size(); i++){
+        if(i % 4 != 3){
+            double delta = static_cast<double>(decoded[i]) - expected[i];
+            squared_error += delta * delta;
+        }
+    }
+    double mean_squared_error = squared_error / static_cast<double>(expected.size() / 4 * 3);
+    return mean_squared_error > 0 ? 10.0 * std::log10(255.0 * 255.0 / mean_squared_error) : 99.0;
+}
+
+void test_bc1(Worker_pool& pool){
+    for(auto [width, height]: {std::pair{256u, 256u}, std::pair{7u, 5u}, std::pair{1u, 1u}, std::pair{130u, 66u}}){
+        auto what = [&](std::string_view check_name){ return std::format("{}x{}: {}", width, height, check_name); };
+        auto pixels = smooth_image(width, height);
+        std::vector<uint8_t> single(bc1_size(width, height)), threaded(bc1_size(width, height));
+        encode_bc1_image(pixels, width, height, single.data());
+        encode_bc1_image(pixels, width, height, threaded.data(), &pool);
+        check(single == threaded, what("threads don't change the blocks"));
+        auto decoded = decode_bc1_image(single, width, height);
+        check(decoded.size() == pixels.size(), what("decodes to the image size"));
+        auto quality = psnr(pixels, decoded);
+        check(quality > 38.0, what(std::format("PSNR {:.2f} dB", quality)));
+        bool opaque = true;
+        for(size_t i = 3; i < decoded.size(); i += 4){
+            opaque = opaque && decoded[i] == 255;
+        }
+        check(opaque, what("decodes opaque"));
+    }
+
+    // A solid block only loses the 565 quantization: 5 bit channels are within 4, green within 2.
+    std::mt19937 random{23};
+    for(int i = 0; i < 1000; i++){
+        std::array<uint8_t, 4> color{static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), 255};
+        std::array<uint8_t, 64> solid{}, decoded{};
+        for(size_t texel = 0; texel < solid.size(); texel += 4){
+            std::copy_n(color.begin(), 4, solid.begin() + texel);
+        }
+        std::array<uint8_t, BC1_BLOCK_BYTES> block{};
+        encode_bc1_block(solid.data(), block.data());
+        decode_bc1_block(block.data(), decoded.data());
+        bool kept = true;
+        for(size_t texel = 0; texel < solid.size(); texel += 4){
+            kept = kept && std::abs(decoded[texel] - color[0]) <= 4 && std::abs(decoded[texel + 1] - color[1]) <= 2 &&
+                std::abs(decoded[texel + 2] - color[2]) <= 4 && decoded[texel + 3] == 255;
+        }
+        if(!kept){
+            check(false, std::format("solid block {} {} {} within 565 precision", color[0], color[1], color[2]));
+            break;
+        }
+    }
+}
+
+bool same_levels(const Ktx2_image& image, std::span<const uint8_t> file, const Mip_chain& chain){
+    if(image.levels_.size() != chain.levels_.size()){
+        return false;
+    }
+    for(size_t level = 0; level < chain.levels_.size(); level++){
+        const auto& expected = chain.levels_[level];
+        const auto& parsed = image.levels_[level];
+        auto size = image.format_.level_size(expected.width_, expected.height_);
+        if(parsed.width_ != expected.width_ || parsed.height_ != expected.height_ ||
+            std::memcmp(file.data() + parsed.offset_, chain.pixels_.data() + expected.offset_, size) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_ktx2(Worker_pool& pool){
+    auto pixels = smooth_image(37, 20);
+    auto chain = generate_mip_chain(pixels, 37, 20, &pool);
+    auto blocks = encode_bc1_chain(chain, &pool);
+    for(auto [format, levels]: {std::pair{KTX2_RGBA8_SRGB, &chain}, std::pair{KTX2_BC1_RGB_SRGB, &blocks}}){
+        auto what = [&](std::string_view check_name){ return std::format("{}: {}", format.format_ == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? "BC1" : "RGBA8", check_name); };
+        auto file = encode_ktx2(format, levels->levels_, levels->pixels_, {{"KTXwriter", "test"}, {"tinyvk.sourceHash", "0123456789abcdef"}});
+        auto parsed = decode_ktx2(std::as_bytes(std::span{file}));
+        check(parsed.has_value(), what("parses"));
+        check(parsed && parsed->format_.format_ == format.format_, what("format"));
+        check(parsed && same_levels(*parsed, file, *levels), what("every level round trips"));
+        check(parsed && parsed->value("tinyvk.sourceHash") == "0123456789abcdef" && parsed->value("KTXwriter") == "test", what("keys round trip"));
+        check(parsed && parsed->value("missing").empty(), what("missing key"));
+
+        // Level 0 is stored last, so cutting the file anywhere loses data.
+        bool truncated_rejected = true;
+        for(size_t size = 0; size < file.size(); size++){
+            truncated_rejected = truncated_rejected && !decode_ktx2(std::as_bytes(std::span{file}.first(size)));
+        }
+        check(truncated_rejected, what("every truncation is rejected"));
+
+        auto foreign = file;
+        foreign[1] ^= 1;
+        check(!decode_ktx2(std::as_bytes(std::span{foreign})), what("wrong identifier"));
+        foreign = file;
+        foreign[12] = static_cast<uint8_t>(VK_FORMAT_R8G8B8A8_UNORM);
+        foreign[13] = 0;
+        check(!decode_ktx2(std::as_bytes(std::span{foreign})), what("unsupported format"));
+
+        // Level 0's index entry at byte 80, level 1's at 104: swapping their offsets keeps each level in
+        // bounds but puts the smaller one after the larger one.
+        foreign = file;
+        std::swap_ranges(foreign.begin() + 80, foreign.begin() + 88, foreign.begin() + 104);
+        check(!decode_ktx2(std::as_bytes(std::span{foreign})), what("levels out of order"));
+        foreign = file;
+        uint64_t level_1_offset{};
+        std::memcpy(&level_1_offset, foreign.data() + 104, sizeof(level_1_offset));
+        level_1_offset += format.block_bytes_;
+        std::memcpy(foreign.data() + 104, &level_1_offset, sizeof(level_1_offset));
+        check(!decode_ktx2(std::as_bytes(std::span{foreign})), what("overlapping levels"));
+    }
+}
+
+} // namespace
+
+int main(){
+    Worker_pool pool{4};
+    test_bc1(pool);
+    test_ktx2(pool);
+    return test_result();
+}
@@ -0,0 +1,107 @@
+// Packed_vertex round trip: every position and texture coordinate decodes to within half a unorm16
+// step of the mesh bounds, plus the float rounding of the decode.
+#include <limits>
+#include <random>
+#include <string>
+
+#include "vertex_format.h"
+#include "test_check.h"
+
+namespace{
+
+// Largest error of each component over the vertices, in units of its bound.
+std::array<double, 5> relative_errors(const std::vector<Vertex>& vertices){
+    auto dequantization = compute_vertex_dequantization(vertices);
+    std::array<float, 5> scales{dequantization.position_scale_.x, dequantization.position_scale_.y, dequantization.position_scale_.z,
+        dequantization.tex_coord_scale_offset_.x, dequantization.tex_coord_scale_offset_.y};
+    std::array<float, 5> offsets{dequantization.position_offset_.x, dequantization.position_offset_.y, dequantization.position_offset_.z,
+        dequantization.tex_coord_scale_offset_.z, dequantization.tex_coord_scale_offset_.w};
+    std::array<double, 5> bounds{};
+    for(size_t i = 0; i < bounds.size(); i++){
+        auto magnitude = std::max(std::abs(offsets[i]), std::abs(offsets[i] + scales[i]));
+        bounds[i] = 0.5 * scales[i] / 65535.0 + 4.0 * std::numeric_limits<float>::epsilon() * magnitude;
+    }
+
+    std::array<double, 5> errors{};
+    for(const auto& vertex: vertices){
+        auto unpacked = unpack_vertex(pack_vertex(vertex, dequantization), dequantization);
+        std::array<float, 5> original{vertex.pos_.x, vertex.pos_.y, vertex.pos_.z, vertex.tex_coord_.x, vertex.tex_coord_.y};
+        std::array<float, 5> decoded{unpacked.pos_.x, unpacked.pos_.y, unpacked.pos_.z, unpacked.tex_coord_.x, unpacked.tex_coord_.y};
+        for(size_t i = 0; i < errors.size(); i++){
+            auto error = std::abs(static_cast<double>(decoded[i]) - original[i]);
+            errors[i] = std::max(errors[i], bounds[i] > 0.0 ? error / bounds[i] : (error > 0.0 ? 2.0 : 0.0));
+        }
+    }
+    return errors;
+}
+
+std::vector<Vertex> random_vertices(uint32_t seed, glm::vec3 center, float extent, size_t count){
+    std::mt19937 random{seed};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+    std::vector<Vertex> vertices(count);
+    for(auto& vertex: vertices){
+        vertex.pos_ = center + glm::vec3{unit(random), unit(random) * 0.25f, unit(random)} * extent;
+        vertex.color_ = {1.0f, 1.0f, 1.0f};
+        vertex.tex_coord_ = {unit(random) * 0.5f + 0.5f, unit(random) * 2.0f};
+    }
+    return vertices;
+}
+
+void test_round_trip(){
+    struct Case{
+        const char* name_;
+        glm::vec3 center_;
+        float extent_;
+    };
+    for(auto [name, center, extent]: {Case{"unit", {0.0f, 0.0f, 0.0f}, 1.0f}, Case{"tiny", {0.0f, 0.0f, 0.0f}, 1e-3f},
+        Case{"far from the origin", {1000.0f, -2500.0f, 40.0f}, 3.0f}, Case{"large", {0.0f, 0.0f, 0.0f}, 5000.0f}}){
+        auto errors = relative_errors(random_vertices(18, center, extent, 100000));
+        for(size_t i = 0; i < errors.size(); i++){
+            check(errors[i] <= 1.0, std::format("{}: component {} within half a step ({:.3f} of the bound)", name, i, errors[i]));
+        }
+    }
+}
+
+void test_bounds(){
+    auto vertices = random_vertices(7, {2.0f, 3.0f, 4.0f}, 10.0f, 1000);
+    auto dequantization = compute_vertex_dequantization(vertices);
+    uint16_t low = 65535, high = 0;
+    for(const auto& vertex: vertices){
+        auto packed = pack_vertex(vertex, dequantization);
+        low = std::min({low, packed.pos_[0], packed.pos_[1], packed.pos_[2], packed.tex_coord_[0], packed.tex_coord_[1]});
+        high = std::max({high, packed.pos_[0], packed.pos_[1], packed.pos_[2], packed.tex_coord_[0], packed.tex_coord_[1]});
+        check(packed.pos_[3] == 0, "unused fourth component");
+    }
+    check(low == 0 && high == 65535, "the bounds use the whole unorm16 range");
+
+    // A flat axis has scale 0 and decodes to its single value exactly.
+    for(auto& vertex: vertices){
+        vertex.pos_.y = -7.5f;
+    }
+    dequantization = compute_vertex_dequantization(vertices);
+    check(dequantization.position_scale_.y == 0.0f, "flat axis has no extent");
+    check(unpack_vertex(pack_vertex(vertices[0], dequantization), dequantization).pos_.y == -7.5f, "flat axis decodes exactly");
+    check(relative_errors(vertices)[1] == 0.0, "flat axis error");
+
+    std::vector<Vertex> single{vertices[0]};
+    auto errors = relative_errors(single);
+    check(*std::max_element(errors.begin(), errors.end()) == 0.0, "a single vertex decodes exactly");
+    check(relative_errors({}) == std::array<double, 5>{}, "no vertices");
+
+    vertices[5].color_ = {1.0f, 0.0f, 0.0f};
+    bool threw = false;
+    try{
+        compute_vertex_dequantization(vertices);
+    }catch(const std::runtime_error&){
+        threw = true;
+    }
+    check(threw, "per vertex colors can't be packed");
+}
+
+} // namespace
+
+int main(){
+    test_round_trip();
+    test_bounds();
+    return test_result();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+// Position only indexed triangles, the input of the CPU mesh passes in benchmarks and tests.
+struct Mesh{
+    std::vector<std::array<float, 3>> positions_;
+    std::vector<uint32_t> indices_;
+};
+
+// Appends a sphere of rings x 2 * rings quads. The seam column repeats the first column's positions
+// exactly and each pole is a row of coincident vertices, like a UV mapped model exported as an OBJ.
+// Triangles are counter-clockwise seen from outside, the app's front faces.
+inline void add_uv_sphere(Mesh& mesh, uint32_t rings, std::array<float, 3> center = {}, float radius = 1.0f){
+    const uint32_t segments = rings * 2;
+    const auto first = static_cast<uint32_t>(mesh.positions_.size());
+    for(uint32_t ring = 0; ring <= rings; ring++){
+        for(uint32_t segment = 0; segment <= segments; segment++){
+            auto theta = std::numbers::pi_v<float> * static_cast<float>(ring) / static_cast<float>(rings);
+            auto phi = 2.0f * std::numbers::pi_v<float> * static_cast<float>(segment % segments) / static_cast<float>(segments);
+            mesh.positions_.push_back({center[0] + radius * std::sin(theta) * std::cos(phi), center[1] + radius * std::cos(theta),
+                center[2] + radius * std::sin(theta) * std::sin(phi)});
+        }
+    }
+    for(uint32_t ring = 0; ring < rings; ring++){
+        for(uint32_t segment = 0; segment < segments; segment++){
+            uint32_t a = first + ring * (segments + 1) + segment;
+            uint32_t b = a + segments + 1;
+            mesh.indices_.insert(mesh.indices_.end(), {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+}
+
+inline Mesh uv_sphere(uint32_t rings, std::array<float, 3> center = {}, float radius = 1.0f){
+    Mesh mesh;
+    add_uv_sphere(mesh, rings, center, radius);
+    return mesh;
+}
@@ -6,15 +6,46 @@ layout(set = 0, binding = 0) uniform Uniform_buffer_object{
     mat4 proj_;
 } ubo;
 
+struct Instance_data{
+    mat4 model_;
+    vec4 tint_;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instance_buffer{
+    Instance_data instances_[];
+};
+
+#ifdef PACKED_VERTEX
+// Packed_vertex: unorm16 attributes relative to the mesh bounds, the color is the same for every vertex.
+layout(push_constant) uniform Vertex_dequantization{
+    vec4 position_scale_;
+    vec4 position_offset_;
+    vec4 tex_coord_scale_offset_;
+    vec4 color_;
+} dequantization;
+
+layout(location = 0) in vec4 in_packed_position;
+layout(location = 2) in vec2 in_packed_tex_coord;
+#else
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_color;
 layout(location = 2) in vec2 in_tex_coord;
+#endif
+
+// The depth prepass (depth.vert) computes the same positions.
+invariant gl_Position;
 
 layout(location = 0) out vec3 frag_color;
 layout(location = 1) out vec2 frag_tex_coord;
 
 void main(){
-    gl_Position = ubo.proj_ * ubo.view_ * ubo.model_ * vec4(in_position , 1.0);
-    frag_color = in_color;
+#ifdef PACKED_VERTEX
+    vec3 in_position = in_packed_position.xyz * dequantization.position_scale_.xyz + dequantization.position_offset_.xyz;
+    vec3 in_color = dequantization.color_.rgb;
+    vec2 in_tex_coord = in_packed_tex_coord * dequantization.tex_coord_scale_offset_.xy + dequantization.tex_coord_scale_offset_.zw;
+#endif
+    Instance_data instance = instances_[gl_InstanceIndex];
+    gl_Position = ubo.proj_ * ubo.view_ * ubo.model_ * instance.model_ * vec4(in_position , 1.0);
+    frag_color = in_color * instance.tint_.rgb;
     frag_tex_coord = in_tex_coord;
 }
\ No newline at end of file
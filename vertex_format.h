@@ -0,0 +1,246 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+// The app's vertex layouts: 32 byte float Vertex and 12 byte quantized Packed_vertex, and the vertex
+// input state of both, interleaved or as split position/attribute streams.
+
+// Vertex buffer bindings and attributes of a pipeline. Interleaved is one binding with every attribute.
+// Split streams put the position (location 0, the first member) in binding 0 and the other attributes
+// in binding 1, each tightly packed, so position-only passes fetch nothing else.
+struct Vertex_input_layout{
+    std::vector<VkVertexInputBindingDescription> bindings_;
+    std::vector<VkVertexInputAttributeDescription> attributes_;
+};
+
+inline Vertex_input_layout make_vertex_input_layout(std::span<const VkVertexInputAttributeDescription> attributes,
+    uint32_t stride, uint32_t position_size, bool split_streams, bool position_only){
+    Vertex_input_layout layout{};
+    layout.bindings_.push_back({0, split_streams ? position_size : stride, VK_VERTEX_INPUT_RATE_VERTEX});
+    if(split_streams && !position_only){
+        layout.bindings_.push_back({1, stride - position_size, VK_VERTEX_INPUT_RATE_VERTEX});
+    }
+    for(auto attribute: attributes){
+        if(attribute.location == 0){
+            layout.attributes_.push_back(attribute);
+        }else if(!position_only){
+            if(split_streams){
+                attribute.binding = 1;
+                attribute.offset -= position_size;
+            }
+            layout.attributes_.push_back(attribute);
+        }
+    }
+    return layout;
+}
+
+// Writes count interleaved vertices as the position stream followed by the attribute stream.
+inline void split_vertex_streams(std::span<const std::byte> interleaved, size_t count, size_t position_size, std::byte* out){
+    const size_t stride = count ? interleaved.size() / count : 0;
+    auto positions = out;
+    auto attributes = out + count * position_size;
+    for(size_t i = 0; i < count; i++){
+        memcpy(positions + i * position_size, interleaved.data() + i * stride, position_size);
+        memcpy(attributes + i * (stride - position_size), interleaved.data() + i * stride + position_size, stride - position_size);
+    }
+}
+
+struct Vertex{
+    glm::vec3 pos_;
+    glm::vec3 color_;
+    glm::vec2 tex_coord_;
+
+    bool operator==(const Vertex& other) const {
+        return pos_ == other.pos_ && color_ == other.color_ && tex_coord_ == other.tex_coord_;
+    }
+
+    static VkVertexInputBindingDescription get_binding_description(){
+        VkVertexInputBindingDescription binding_description{};
+
+        binding_description.binding = 0;
+        binding_description.stride = sizeof(Vertex);
+        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return binding_description;
+    }
+    static std::array<VkVertexInputAttributeDescription, 3> get_attribute_descriptions(){
+        std::array<VkVertexInputAttributeDescription, 3> attributes_description{};
+
+        attributes_description[0].binding = 0;
+        attributes_description[0].location = 0;
+        attributes_description[0].format =  VK_FORMAT_R32G32B32_SFLOAT;
+        attributes_description[0].offset = offsetof(Vertex, pos_);
+
+        attributes_description[1].binding = 0;
+        attributes_description[1].location = 1;
+        attributes_description[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributes_description[1].offset = offsetof(Vertex, color_);
+
+        attributes_description[2].binding = 0;
+        attributes_description[2].location = 2;
+        attributes_description[2].format = VK_FORMAT_R32G32_SFLOAT;
+        attributes_description[2].offset = offsetof(Vertex, tex_coord_);
+
+        return attributes_description;
+    }
+    static Vertex_input_layout get_input_layout(bool split_streams, bool position_only){
+        auto attributes = get_attribute_descriptions();
+        return make_vertex_input_layout(attributes, sizeof(Vertex), sizeof(Vertex::pos_), split_streams, position_only);
+    }
+};
+namespace std {
+    template<> struct hash<Vertex> {
+        size_t operator()(Vertex const& vertex) const {
+            return ((hash<glm::vec3>()(vertex.pos_) ^
+                   (hash<glm::vec3>()(vertex.color_) << 1)) >> 1) ^
+                   (hash<glm::vec2>()(vertex.tex_coord_) << 1);
+        }
+    };
+}
+
+// Hash for welding: the float bits are mixed 64 bits at a time, -0.0 is folded into 0.0 so vertices
+// equal under operator== hash equally. Grid-like positions spread well, unlike std::hash<Vertex>.
+struct Vertex_hash{
+    uint64_t operator()(const Vertex& vertex) const{
+        const std::array<float, 8> values{
+            vertex.pos_.x, vertex.pos_.y, vertex.pos_.z,
+            vertex.color_.x, vertex.color_.y, vertex.color_.z,
+            vertex.tex_coord_.x, vertex.tex_coord_.y,
+        };
+        auto bits = [](float value) -> uint64_t { return value == 0.0f ? 0 : std::bit_cast<uint32_t>(value); };
+        uint64_t hash = 0x9E3779B97F4A7C15ull;
+        for(size_t i = 0; i < values.size(); i += 2){
+            hash ^= bits(values[i]) | bits(values[i + 1]) << 32;
+            hash *= 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        return hash ^ hash >> 29;
+    }
+};
+
+// Push constant of the packed vertex shader, a unorm16 attribute u decodes to u * scale + offset.
+// The color is the same for every vertex, so it is stored once here instead of per vertex.
+struct Vertex_dequantization{
+    alignas(16) glm::vec4 position_scale_;
+    alignas(16) glm::vec4 position_offset_;
+    // xy scale, zw offset.
+    alignas(16) glm::vec4 tex_coord_scale_offset_;
+    alignas(16) glm::vec4 color_;
+};
+
+// 12 byte vertex: position and texture coordinate as unorm16 relative to the mesh bounds.
+// Position has a fourth unused component since three component 16-bit vertex formats are rarely supported.
+struct Packed_vertex{
+    std::array<uint16_t, 4> pos_;
+    std::array<uint16_t, 2> tex_coord_;
+
+    static VkVertexInputBindingDescription get_binding_description(){
+        VkVertexInputBindingDescription binding_description{};
+
+        binding_description.binding = 0;
+        binding_description.stride = sizeof(Packed_vertex);
+        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return binding_description;
+    }
+    // Same locations as Vertex, location 1 (color) comes from Vertex_dequantization.
+    static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions(){
+        std::array<VkVertexInputAttributeDescription, 2> attributes_description{};
+
+        attributes_description[0].binding = 0;
+        attributes_description[0].location = 0;
+        attributes_description[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributes_description[0].offset = offsetof(Packed_vertex, pos_);
+
+        attributes_description[1].binding = 0;
+        attributes_description[1].location = 2;
+        attributes_description[1].format = VK_FORMAT_R16G16_UNORM;
+        attributes_description[1].offset = offsetof(Packed_vertex, tex_coord_);
+
+        return attributes_description;
+    }
+    static Vertex_input_layout get_input_layout(bool split_streams, bool position_only){
+        auto attributes = get_attribute_descriptions();
+        return make_vertex_input_layout(attributes, sizeof(Packed_vertex), sizeof(Packed_vertex::pos_), split_streams, position_only);
+    }
+};
+static_assert(sizeof(Packed_vertex) == 12);
+
+// Bounds of the positions and texture coordinates; throws if the color isn't constant, the packed layout has none.
+inline Vertex_dequantization compute_vertex_dequantization(std::span<const Vertex> vertices){
+    glm::vec3 min_position{0.0f}, max_position{0.0f};
+    glm::vec2 min_tex_coord{0.0f}, max_tex_coord{0.0f};
+    glm::vec3 color{1.0f};
+    if(!vertices.empty()){
+        min_position = max_position = vertices[0].pos_;
+        min_tex_coord = max_tex_coord = vertices[0].tex_coord_;
+        color = vertices[0].color_;
+    }
+    for(const auto& vertex: vertices){
+        min_position = glm::min(min_position, vertex.pos_);
+        max_position = glm::max(max_position, vertex.pos_);
+        min_tex_coord = glm::min(min_tex_coord, vertex.tex_coord_);
+        max_tex_coord = glm::max(max_tex_coord, vertex.tex_coord_);
+        if(vertex.color_ != color){
+            throw std::runtime_error{"packed vertices need the same color for every vertex."};
+        }
+    }
+
+    Vertex_dequantization dequantization{};
+    dequantization.position_scale_ = glm::vec4(max_position - min_position, 0.0f);
+    dequantization.position_offset_ = glm::vec4(min_position, 0.0f);
+    auto tex_coord_extent = max_tex_coord - min_tex_coord;
+    dequantization.tex_coord_scale_offset_ = glm::vec4(tex_coord_extent.x, tex_coord_extent.y, min_tex_coord.x, min_tex_coord.y);
+    dequantization.color_ = glm::vec4(color, 1.0f);
+    return dequantization;
+}
+
+// Rounds to the nearest of the 65536 steps between offset and offset + scale.
+inline uint16_t quantize_unorm16(float value, float scale, float offset){
+    if(scale <= 0.0f){
+        return 0;
+    }
+    auto normalized = std::clamp((value - offset) / scale, 0.0f, 1.0f);
+    return static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+}
+
+inline Packed_vertex pack_vertex(const Vertex& vertex, const Vertex_dequantization& dequantization){
+    const auto& position_scale = dequantization.position_scale_;
+    const auto& position_offset = dequantization.position_offset_;
+    const auto& tex_coord = dequantization.tex_coord_scale_offset_;
+    return {
+        {quantize_unorm16(vertex.pos_.x, position_scale.x, position_offset.x),
+            quantize_unorm16(vertex.pos_.y, position_scale.y, position_offset.y),
+            quantize_unorm16(vertex.pos_.z, position_scale.z, position_offset.z), 0},
+        {quantize_unorm16(vertex.tex_coord_.x, tex_coord.x, tex_coord.z),
+            quantize_unorm16(vertex.tex_coord_.y, tex_coord.y, tex_coord.w)},
+    };
+}
+
+// What the packed vertex shader computes, for checking the quantization error on the CPU.
+inline Vertex unpack_vertex(const Packed_vertex& vertex, const Vertex_dequantization& dequantization){
+    auto unorm = [](uint16_t value){ return static_cast<float>(value) / 65535.0f; };
+    const auto& tex_coord = dequantization.tex_coord_scale_offset_;
+    return {
+        glm::vec3(unorm(vertex.pos_[0]), unorm(vertex.pos_[1]), unorm(vertex.pos_[2])) *
+            glm::vec3(dequantization.position_scale_) + glm::vec3(dequantization.position_offset_),
+        glm::vec3(dequantization.color_),
+        glm::vec2(unorm(vertex.tex_coord_[0]), unorm(vertex.tex_coord_[1])) * glm::vec2(tex_coord.x, tex_coord.y) +
+            glm::vec2(tex_coord.z, tex_coord.w),
+    };
+}
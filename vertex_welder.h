@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "worker_pool.h"
+
+// Merges equal vertices into an index list. Open addressing over a power of two slot array with
+// linear probing; a slot holds the vertex index and 32 bits of its hash, so most mismatches are
+// rejected without touching the vertex. The vertices live in the caller's array, in first use order.
+template<typename T, typename Hash, typename Equal = std::equal_to<T>>
+class Vertex_welder{
+    public:
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+    // Clears vertices. expected_count bounds the distinct vertices, e.g. the corner count, so the table never grows.
+    explicit Vertex_welder(std::vector<T>& vertices, size_t expected_count = 0):vertices_(vertices){
+        vertices_.clear();
+        resize(std::bit_ceil(std::max<size_t>(expected_count + expected_count / 3 + 1, 16)));
+    }
+
+    // Index of the vertex equal to value, appended first if there is none. One probe sequence per call.
+    uint32_t insert(const T& value){
+        if((count_ + 1) * 4 > slots_.size() * 3){
+            grow();
+        }
+        auto hash = Hash{}(value);
+        auto tag = static_cast<uint32_t>(hash >> 32);
+        for(size_t slot = hash & mask_;; slot = (slot + 1) & mask_){
+            auto& entry = slots_[slot];
+            if(entry.index_ == EMPTY){
+                entry = {static_cast<uint32_t>(vertices_.size()), tag};
+                vertices_.push_back(value);
+                count_++;
+                return entry.index_;
+            }
+            if(entry.tag_ == tag && Equal{}(vertices_[entry.index_], value)){
+                return entry.index_;
+            }
+        }
+    }
+
+    private:
+    struct Slot{
+        uint32_t index_;
+        uint32_t tag_;
+    };
+
+    void resize(size_t slot_count){
+        slots_.assign(slot_count, {EMPTY, 0});
+        mask_ = slot_count - 1;
+    }
+    void place(uint32_t index, uint64_t hash){
+        auto slot = hash & mask_;
+        while(slots_[slot].index_ != EMPTY){
+            slot = (slot + 1) & mask_;
+        }
+        slots_[slot] = {index, static_cast<uint32_t>(hash >> 32)};
+    }
+    void grow(){
+        resize(slots_.size() * 2);
+        for(uint32_t i = 0; i < vertices_.size(); i++){
+            place(i, Hash{}(vertices_[i]));
+        }
+    }
+
+    std::vector<T>& vertices_;
+    std::vector<Slot> slots_;
+    size_t mask_{};
+    size_t count_{};
+};
+
+// Welds corner(0) .. corner(corner_count - 1) into vertices and indices, replacing their contents.
+template<typename T, typename Hash, typename Equal = std::equal_to<T>, typename Corner>
+void weld_vertices(size_t corner_count, const Corner& corner, std::vector<T>& vertices, std::vector<uint32_t>& indices){
+    Vertex_welder<T, Hash, Equal> welder{vertices, corner_count};
+    indices.clear();
+    indices.reserve(corner_count);
+    for(size_t c = 0; c < corner_count; c++){
+        indices.push_back(welder.insert(corner(c)));
+    }
+}
+
+// Same output as weld_vertices(), for meshes with tens of millions of corners.
+// Corners are partitioned by the top bits of their hash, so equal vertices always meet in the same
+// shard, and the shards are welded concurrently. The distinct vertices are then numbered by the
+// corner that introduced them, which is the order the serial path appends them in.
+// corner(c) is called several times per corner and has to be cheap and thread safe.
+template<typename T, typename Hash, typename Equal = std::equal_to<T>, typename Corner>
+void weld_vertices_parallel(size_t corner_count, const Corner& corner, Worker_pool& pool,
+    std::vector<T>& vertices, std::vector<uint32_t>& indices){
+    const size_t chunk_count = pool.size() * 4;
+    const size_t shard_count = std::bit_ceil(pool.size() * 4);
+    const int shard_shift = 64 - std::countr_zero(shard_count);
+    auto chunk_begin = [&](size_t chunk){ return corner_count * chunk / chunk_count; };
+    auto shard_of = [&](const T& value){ return static_cast<size_t>(Hash{}(value) >> shard_shift); };
+
+    // Counting sort of the corner ids by shard, chunks keep their corners in order.
+    std::vector<size_t> offsets(chunk_count * shard_count);
+    pool.parallel_for(chunk_count, [&](size_t chunk){
+        auto* counts = &offsets[chunk * shard_count];
+        for(size_t c = chunk_begin(chunk); c < chunk_begin(chunk + 1); c++){
+            counts[shard_of(corner(c))]++;
+        }
+    });
+    std::vector<size_t> shard_begin(shard_count + 1);
+    size_t total{};
+    for(size_t shard = 0; shard < shard_count; shard++){
+        shard_begin[shard] = total;
+        for(size_t chunk = 0; chunk < chunk_count; chunk++){
+            auto count = offsets[chunk * shard_count + shard];
+            offsets[chunk * shard_count + shard] = total;
+            total += count;
+        }
+    }
+    shard_begin[shard_count] = total;
+    std::vector<uint32_t> shard_corners(corner_count);
+    pool.parallel_for(chunk_count, [&](size_t chunk){
+        auto* next = &offsets[chunk * shard_count];
+        for(size_t c = chunk_begin(chunk); c < chunk_begin(chunk + 1); c++){
+            shard_corners[next[shard_of(corner(c))]++] = static_cast<uint32_t>(c);
+        }
+    });
+
+    // Shard local ids go to indices for now, first marks the corners that introduced a vertex.
+    indices.assign(corner_count, 0);
+    std::vector<uint8_t> first(corner_count);
+    std::vector<std::vector<uint32_t>> global_ids(shard_count);
+    pool.parallel_for(shard_count, [&](size_t shard){
+        std::vector<T> shard_vertices;
+        Vertex_welder<T, Hash, Equal> welder{shard_vertices, shard_begin[shard + 1] - shard_begin[shard]};
+        for(auto i = shard_begin[shard]; i < shard_begin[shard + 1]; i++){
+            auto c = shard_corners[i];
+            auto local = welder.insert(corner(c));
+            if(local == global_ids[shard].size()){
+                global_ids[shard].push_back(0);
+                first[c] = 1;
+            }
+            indices[c] = local;
+        }
+    });
+
+    // Number the distinct vertices in corner order.
+    std::vector<size_t> chunk_firsts(chunk_count + 1);
+    pool.parallel_for(chunk_count, [&](size_t chunk){
+        chunk_firsts[chunk + 1] = std::count(first.begin() + chunk_begin(chunk), first.begin() + chunk_begin(chunk + 1), uint8_t{1});
+    });
+    for(size_t chunk = 0; chunk < chunk_count; chunk++){
+        chunk_firsts[chunk + 1] += chunk_firsts[chunk];
+    }
+    vertices.resize(chunk_firsts[chunk_count]);
+    pool.parallel_for(chunk_count, [&](size_t chunk){
+        auto next = chunk_firsts[chunk];
+        for(size_t c = chunk_begin(chunk); c < chunk_begin(chunk + 1); c++){
+            if(first[c]){
+                auto value = corner(c);
+                global_ids[shard_of(value)][indices[c]] = static_cast<uint32_t>(next);
+                vertices[next] = value;
+                next++;
+            }
+        }
+    });
+    pool.parallel_for(shard_count, [&](size_t shard){
+        for(auto i = shard_begin[shard]; i < shard_begin[shard + 1]; i++){
+            auto c = shard_corners[i];
+            indices[c] = global_ids[shard][indices[c]];
+        }
+    });
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for fork/join work, the calling thread takes part in every parallel_for().
+class Worker_pool{
+    public:
+    // thread_count includes the calling thread.
+    explicit Worker_pool(size_t thread_count){
+        for(size_t i = 1; i < thread_count; i++){
+            threads_.emplace_back([this]{ worker_loop(); });
+        }
+    }
+    ~Worker_pool(){
+        {
+            std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        for(auto& thread: threads_){
+            thread.join();
+        }
+    }
+    Worker_pool(const Worker_pool&) = delete;
+    Worker_pool& operator=(const Worker_pool&) = delete;
+
+    size_t size() const{
+        return threads_.size() + 1;
+    }
+
+    // Runs task(i) for every i in [0, task_count) and returns once all are done.
+    // A task index never runs twice concurrently, so it can pick per task resources.
+    void parallel_for(size_t task_count, const std::function<void(size_t)>& task){
+        if(task_count == 0){
+            return;
+        }
+        {
+            std::lock_guard lock{mutex_};
+            task_ = &task;
+            task_count_ = task_count;
+            next_task_ = 0;
+            finished_ = 0;
+            error_ = nullptr;
+            generation_++;
+        }
+        work_cv_.notify_all();
+
+        run_tasks(task, task_count);
+
+        std::unique_lock lock{mutex_};
+        done_cv_.wait(lock, [&]{ return finished_ == task_count_ && active_workers_ == 0; });
+        task_ = nullptr;
+        if(error_){
+            std::rethrow_exception(error_);
+        }
+    }
+
+    private:
+    void worker_loop(){
+        uint64_t seen_generation{};
+        while(true){
+            // Read under the lock, parallel_for() writes them before publishing the generation.
+            const std::function<void(size_t)>* task{};
+            size_t task_count{};
+            {
+                std::unique_lock lock{mutex_};
+                work_cv_.wait(lock, [&]{ return stopping_ || generation_ != seen_generation; });
+                if(stopping_){
+                    return;
+                }
+                seen_generation = generation_;
+                task = task_;
+                task_count = task_count_;
+                active_workers_++;
+            }
+            if(task){
+                run_tasks(*task, task_count);
+            }
+            {
+                std::lock_guard lock{mutex_};
+                active_workers_--;
+            }
+            done_cv_.notify_all();
+        }
+    }
+
+    void run_tasks(const std::function<void(size_t)>& task, size_t task_count){
+        size_t done{};
+        for(size_t i = next_task_++; i < task_count; i = next_task_++){
+            try{
+                task(i);
+            }catch(...){
+                std::lock_guard lock{mutex_};
+                if(!error_){
+                    error_ = std::current_exception();
+                }
+            }
+            done++;
+        }
+        if(done > 0){
+            std::lock_guard lock{mutex_};
+            finished_ += done;
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(size_t)>* task_{};
+    size_t task_count_{};
+    std::atomic<size_t> next_task_{};
+    size_t finished_{};
+    size_t active_workers_{};
+    uint64_t generation_{};
+    std::exception_ptr error_;
+    bool stopping_ = false;
+};